@@ -68,12 +68,16 @@
 #include <ctype.h>
 #include <string.h>
 #include <sys/stat.h> 
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 /*--------------------------------------------------------------------*/
 /* SAP includes                                                       */
 /*--------------------------------------------------------------------*/
 #include "vsaxxtyp.h"
 #include "csdecompr.h"
+#include "vsmime.h"
 
 static SAP_BYTE CsMagicHead[] = { "\037\235" };  /* 1F 9D */
 static unsigned short mask_bits[] =
@@ -286,6 +290,29 @@ NewInfo2(SAP_BYTE* inbuf, unsigned int len)
   return NULL;
 }
 
+/**********************************************************************
+ *  dupInfo()
+ *
+ *  Description:
+ *  Copies an info structure with a name of len bytes, the copy is
+ *  not linked to a list.
+ *
+ **********************************************************************/
+static struct SAREntry *
+dupInfo(struct SAREntry *src, unsigned int len)
+{
+    struct SAREntry *fi = NULL;
+    unsigned char   *_name = NULL;
+
+    if(src == NULL || (fi = NewInfo2(src->name, len)) == NULL)
+        return NULL;
+    _name = fi->name;
+    memcpy(fi,src,sizeof(struct SAREntry));
+    fi->name = _name;
+    fi->next = NULL;
+    return fi;
+}
+
 /**********************************************************************
  *  FreeInfoList()
  *
@@ -327,203 +354,221 @@ FreeInfo(struct SAREntry *fi)
 }
 
 /**********************************************************************
- *  getEntryHeader()
+ *  readOuter()
  *
  *  Description:
- *  Parses a single SAPCar EntryHeader info into 
- *  the corresponding structure.
+ *  Reads n bytes of an iterator of SarOpenEntry from the pieces of the
+ *  outer entry, without dest the bytes are passed over.
  *
  **********************************************************************/
-static struct SAREntry *
-getEntryHeader(FILE *fp)
-{  
-    BYTEARRAY_2    blocktype;
-    BYTEARRAY_4    blocksize;
-    BYTEARRAY_4    checksum;
-    unsigned short nameLen;
-    unsigned short usrInfoLen; 
-    size_t         lRead  = 0;
-    unsigned int   toMove = 0;
-    SAP_ULLONG     sizeLow;
-    unsigned int   sizeHigh;
-    unsigned int   _checksum = 0;
+static SAP_BOOL
+readOuter(struct SARIterator *it, SAP_BYTE *dest, size_t n)
+{
+    size_t _copy = 0;
 
-    struct SAREntry          *fi = NULL;
-    struct EntryHeaderBytes   entry;
+    while(n > 0) {
+        if(it->outerlen == 0) {
+            if(SarReadBlock(it->outer,&it->outerpiece,&it->outerlen) <= 0) {
+                it->outerlen = 0;
+                return FALSE;
+            }
+            it->outerdata = it->outerpiece;
+            continue;
+        }
+        _copy = n < it->outerlen ? n : it->outerlen;
+        if(dest != NULL) {
+            memcpy(dest,it->outerdata,_copy);
+            dest += _copy;
+        }
+        it->outerdata += _copy;
+        it->outerlen  -= _copy;
+        it->outerpos  += (long)_copy;
+        n             -= _copy;
+    }
+    return TRUE;
+}
 
-    /*   This function expects a FILE ptr (fp)
-     *   set to the begin of  the fix EntryHeader.
-     *   Read-in the raw byte information to the
-     *   structure to have access to attributes
-     *   by the EntryHeaderBytes structure
-     */
-    lRead = fread(&entry,sizeof(char),sizeof(struct EntryHeaderBytes),fp);
-    if(lRead != sizeof(struct EntryHeaderBytes))
-        return NULL;
-  
-    /* Position of the FILE pointer is now at the
-     * begin of  the dynamic EntryHeader block.
-     */
-    /* convert the entry name length to ushort */
-    BytesToUshort(entry.nameLength, &nameLen);
-    /* allocate and initialize a new SAPCARArchiveData */
-    fi = NewInfo(fp, nameLen);
-    if(fi==NULL)
-        return NULL;
+/**********************************************************************
+ *  seekOuter()
+ *
+ *  Description:
+ *  Moves an iterator of SarOpenEntry to pos in the outer entry. A
+ *  step back inside the current piece is served from the piece, the
+ *  outer entry is decompressed again from its beginning otherwise.
+ *
+ **********************************************************************/
+static SAP_BOOL
+seekOuter(struct SARIterator *it, long pos)
+{
+    if(pos < 0)
+        return FALSE;
+    if(pos < it->outerpos) {
+        if((size_t)(it->outerpos - pos) <= (size_t)(it->outerdata - it->outerpiece)) {
+            it->outerdata -= it->outerpos - pos;
+            it->outerlen  += (size_t)(it->outerpos - pos);
+            it->outerpos   = pos;
+            return TRUE;
+        }
+        if(!SarRewindEntry(it->outer))
+            return FALSE;
+        it->outerpiece = NULL;
+        it->outerdata  = NULL;
+        it->outerlen   = 0;
+        it->outerpos   = 0;
+    }
+    return readOuter(it,NULL,(size_t)(pos - it->outerpos));
+}
 
-    /*
-     * map the entry type, same as in doc, see sapcar.h
-     */
-    if(      !memcmp(entry.type, IA_RG, BLOCK_TYPE_SIZE) )
-        fi->type = FT_RG; /* regular file     */
-    else if (!memcmp(entry.type, IA_DR, BLOCK_TYPE_SIZE))
-        fi->type = FT_DR; /* directory        */
-    else if(!memcmp(entry.type,  IA_SC, BLOCK_TYPE_SIZE))
-        fi->type = FT_SC; /* windows shortcut */
-    else if(!memcmp(entry.type,  IA_LK, BLOCK_TYPE_SIZE))
-        fi->type = FT_LK; /* unix softlink    */
-    else if(!memcmp(entry.type,  IA_SV, BLOCK_TYPE_SIZE))
-        fi->type = FT_SV; /* AS/400 save file */
+/**********************************************************************
+ *  readIter()
+ *
+ *  Description:
+ *  Reads n bytes at the current position of the iterator, from the
+ *  archive file, the outer entry or the buffer.
+ *
+ **********************************************************************/
+static SAP_BOOL
+readIter(struct SARIterator *it, void *dest, size_t n)
+{
+    if(it->outer != NULL)
+        return readOuter(it,(SAP_BYTE *)dest,n);
+    if(it->fp != NULL)
+        return (SAP_BOOL)(fread(dest,sizeof(char),n,it->fp) == n);
+    if(it->inlen < n)
+        return FALSE;
+    memcpy(dest,it->inbuf,n);
+    it->inbuf += n;
+    it->inlen -= n;
+    return TRUE;
+}
 
-    /* convert the numeric parameters */
-    BytesToUint( entry.mode, &fi->mode);
-    BytesToUllong( entry.sizeLow, &sizeLow );
-    BytesToUint( entry.sizeHigh, &sizeHigh );
-    BytesToUshort(entry.userInfoLength, &usrInfoLen);
+/**********************************************************************
+ *  skipIter()
+ *
+ *  Description:
+ *  Moves the position of the iterator by n bytes, a negative n steps
+ *  back.
+ *
+ **********************************************************************/
+static SAP_BOOL
+skipIter(struct SARIterator *it, long n)
+{
+    if(it->outer != NULL)
+        return seekOuter(it,it->outerpos + n);
+    if(it->fp != NULL)
+        return (SAP_BOOL)(0 == fseek(it->fp,n,SEEK_CUR));
+    if(n > 0 && it->inlen < (size_t)n)
+        return FALSE;
+    it->inbuf += n;
+    it->inlen -= n;
+    return TRUE;
+}
 
-    /* calculate the uncompressed size
-     * with low and high value
-     * see archive specification for detailed
-     * information about this
-     */
-    fi->uncompressed_size = (size_t) ( (size_t)(sizeHigh*FOUR_GB) + sizeLow);
+/**********************************************************************
+ *  tellIter()
+ *
+ *  Description:
+ *  Returns the position of the iterator in the archive file or in the
+ *  outer entry, 0 for a buffer.
+ *
+ **********************************************************************/
+static long
+tellIter(struct SARIterator *it)
+{
+    if(it->outer != NULL)
+        return it->outerpos;
+    if(it->fp != NULL)
+        return ftell(it->fp);
+    if(it->map != NULL)
+        return (long)(it->inbuf - it->map);
+    return 0;
+}
 
-    /* 
-     * convert date bytes to time_t value
-     * with the rule:
-     */
-    if (sizeof(time_t) == SIZE_FOUR_BYTE){
-        /* 32-Bit environment: size_t is 4 bytes
-         * use a temporary 4 byte value
-         */
-        BYTEARRAY_4 tmp;
-        unsigned int _date = 0;
-        memcpy(tmp, entry.date, sizeof(tmp));
-        BytesToUint(tmp, &_date);
-        fi->date = _date;
-    }
-    else if(sizeof(time_t) == SIZE_EIGHT_BYTE){
-        /* 64-Bit environment: size_t is 8 bytes */
-        BytesToUllong( entry.date, (SAP_ULLONG*)&fi->date );
-    }
+/**********************************************************************
+ *  mapIterData()
+ *
+ *  Description:
+ *  Sets the first data block of the current entry of a mapped
+ *  archive from its position in the file.
+ *
+ **********************************************************************/
+static SAP_BOOL
+mapIterData(struct SARIterator *it, long pos)
+{
+    if(pos < 0 || (size_t)pos > it->maplen)
+        return FALSE;
+    it->databuf = it->map + pos;
+    it->datalen = it->maplen - (size_t)pos;
+    return TRUE;
+}
 
-    /*
-     * dont make use of user information
-     * therefore skip these bytes with fseek
-     */
-    fseek(fp,usrInfoLen, SEEK_CUR);
+/**********************************************************************
+ *  NewInfo3()
+ *
+ *  Description:
+ *  Allocates and initialises a new archive info structure, the name
+ *  is read from the outer entry of the iterator.
+ *
+ **********************************************************************/
+static struct SAREntry *
+NewInfo3(struct SARIterator *it, unsigned int len)
+{
+    /* allocate memory for a new structure */
+    struct SAREntry *fi = (struct SAREntry *)
+      malloc(sizeof(struct SAREntry));
 
-    /* read blocktype */
-    lRead = fread(blocktype,sizeof(char),sizeof(blocktype),fp);
-    /* loop while data block processing */
-    while(IsDataBlock(blocktype)){
-        /* size of the compressed data junk */
-        lRead = fread(blocksize,sizeof(char),sizeof(blocksize),fp);
-        if( lRead != sizeof(blocksize) )
+    if (fi != NULL) {
+        /* initialize structure */
+        memset(fi,0,sizeof(struct SAREntry));
+        /* allocates space for name and reads it */
+        fi->name = (unsigned char*)malloc( len * sizeof(char) );
+        if(fi->name == NULL || !readIter(it,fi->name,len))
+        {
+            if(fi->name) free(fi->name);
+            free(fi);
             return NULL;
-        /* convert to unsigned integer */
-        BytesToUint(blocksize, &toMove);
-        /* add to junk size to the compressed size.
-         * perform an addition in cases of several junks
-         */
-        fi->compressed_size += toMove;
-        /*-------------------------------------------------------
-         *
-         * >>> Compressed data block <<<
-         * Here we skip the block with fseek, but in cases an
-         * expand or decompression call should follow, then 
-         * perform here a fread to your local buffer.
-         * 
-         * In the moment an uncompress function is not available.
-         *
-         --------------------------------------------------------*/
-        fseek(fp, toMove, SEEK_CUR);
-
-        /* end block */
-        if (IsLastBlock(blocktype)) {
-            /* only the end block contains a checksum field */
-            lRead = fread(checksum, sizeof(char), sizeof(checksum), fp);
-            BytesToUint(checksum, &_checksum);
-            fi->checksum = (size_t)_checksum;
         }
-
-        /* read further 2 bytes for next loop step */
-        lRead = fread(blocktype,sizeof(char),sizeof(blocktype),fp);
-        if( lRead != sizeof(blocktype) )            
-            /* EOF encountered? */
-            break;
-    } 
-    /* if IsDataBlock returns false,
-     * step back which means reassign 
-     * the file ptr with fseek
-     */
-    fseek(fp, -BLOCK_TYPE_SIZE, SEEK_CUR);
+    }
     return fi;
 }
 
 /**********************************************************************
- *  getEntryHeader2()
+ *  getIterHeader()
  *
  *  Description:
- *  Parses a single SAPCar EntryHeader info into
- *  the corresponding structure.
+ *  Parses the fix and the dynamic part of the next EntryHeader. The
+ *  position of the iterator is the first data block afterwards,
+ *  namelen returns the length of the name field.
  *
  **********************************************************************/
 static struct SAREntry *
-getEntryHeader2(SAP_BYTE **inbuf, size_t *inlen)
+getIterHeader(struct SARIterator *it, unsigned short *namelen)
 {
-    BYTEARRAY_2    blocktype;
-    BYTEARRAY_4    blocksize;
-    BYTEARRAY_4    checksum;
     unsigned short nameLen;
     unsigned short usrInfoLen;
-    unsigned int   toMove = 0;
     SAP_ULLONG     sizeLow;
     unsigned int   sizeHigh;
-    unsigned int   _checksum = 0;
-    SAP_BYTE *     _ptr = NULL;
 
     struct SAREntry          *fi = NULL;
     struct EntryHeaderBytes   entry;
 
-    if(inbuf == NULL || *inbuf == NULL || inlen == NULL || *inlen < (signed)sizeof(struct EntryHeaderBytes))
-       return NULL;
-    _ptr = *inbuf;
-    /*   This function expects a input buffer
-     *   Read-in the raw byte information to the
-     *   structure to have access to attributes
-     *   by the EntryHeaderBytes structure
-     */
-    memcpy(&entry,_ptr,sizeof(struct EntryHeaderBytes));
-    _ptr  += sizeof(struct EntryHeaderBytes);
-    *inlen -= sizeof(struct EntryHeaderBytes);
-
-    /* Position of the FILE pointer is now at the
-     * begin of  the dynamic EntryHeader block.
-     */
+    if(!readIter(it,&entry,sizeof(struct EntryHeaderBytes)))
+        return NULL;
     /* convert the entry name length to ushort */
     BytesToUshort(entry.nameLength, &nameLen);
-    if((unsigned)*inlen < (unsigned)nameLen) {
-        return NULL;
-    }
+    (*namelen) = nameLen;
     /* allocate and initialise a new SAPCARArchiveData */
-    fi = NewInfo2(_ptr, nameLen);
-    if(fi==NULL) {
-        return NULL;
-    } else {
-        _ptr  += nameLen;
-        *inlen -= nameLen;
+    if(it->fp != NULL) {
+        fi = NewInfo(it->fp, nameLen);
+    } else if(it->outer != NULL) {
+        fi = NewInfo3(it, nameLen);
+    } else if(it->inlen >= nameLen) {
+        fi = NewInfo2(it->inbuf, nameLen);
+        if(fi != NULL)
+            skipIter(it, nameLen);
     }
+    if(fi==NULL)
+        return NULL;
 
     /*
      * map the entry type, same as in doc, see sapcar.h
@@ -545,21 +590,13 @@ getEntryHeader2(SAP_BYTE **inbuf, size_t *inlen)
     BytesToUint( entry.sizeHigh, &sizeHigh );
     BytesToUshort(entry.userInfoLength, &usrInfoLen);
 
-    /* calculate the uncompressed size
-     * with low and high value
-     * see archive specification for detailed
-     * information about this
-     */
+    /* uncompressed size with low and high value */
     fi->uncompressed_size = (size_t) ( (size_t)(sizeHigh*FOUR_GB) + sizeLow);
 
     /*
      * convert date bytes to time_t value
-     * with the rule:
      */
     if (sizeof(time_t) == SIZE_FOUR_BYTE){
-        /* 32-Bit environment: size_t is 4 bytes
-         * use a temporary 4 byte value
-         */
         BYTEARRAY_4 tmp;
         unsigned int _date = 0;
         memcpy(tmp, entry.date, sizeof(tmp));
@@ -567,680 +604,1175 @@ getEntryHeader2(SAP_BYTE **inbuf, size_t *inlen)
         fi->date = _date;
     }
     else if(sizeof(time_t) == SIZE_EIGHT_BYTE){
-        /* 64-Bit environment: size_t is 8 bytes */
         BytesToUllong( entry.date, (SAP_ULLONG*)&fi->date );
     }
 
-    /*
-     * dont make use of user information
-     * therefore skip these bytes with fseek
-     */
-    _ptr  += usrInfoLen;
-    *inlen -= usrInfoLen;
-
-    /* read blocktype */
-    memcpy(blocktype,_ptr,sizeof(blocktype));
-    _ptr  += sizeof(blocktype);
-    *inlen -= sizeof(blocktype);
-    /* loop while data block processing */
-    while(IsDataBlock(blocktype)){
-        /* size of the compressed data junk */
-        memcpy(blocksize,_ptr,sizeof(blocksize));
-        _ptr  += sizeof(blocksize);
-        *inlen -= sizeof(blocksize);
-        /* convert to unsigned integer */
-        BytesToUint(blocksize, &toMove);
-        /* add to junk size to the compressed size.
-         * perform an addition in cases of several junks
-         */
-        fi->compressed_size += toMove;
-        /* end block */
-        if(IsLastBlock(blocktype)) {
-            /* only the end block contains a checksum field */
-            memcpy(checksum,_ptr,sizeof(checksum));
-            _ptr  += sizeof(checksum);
-            *inlen -= sizeof(checksum);
-            BytesToUint(checksum, &_checksum);
-            fi->checksum = (size_t)_checksum;
-        }
-
-        /*-------------------------------------------------------
-         *
-         * >>> Compressed data block <<<
-         * Here we skip the block with fseek, but in cases an
-         * expand or decompression call should follow, then
-         * perform here a fread to your local buffer.
-         *
-         * In the function an uncompress function is not available.
-         *
-         --------------------------------------------------------*/
-        if( (unsigned)*inlen < (unsigned)toMove ) {
-            /* EOF encountered? */
-            break;
-        }
-        _ptr  += toMove;
-        *inlen -= toMove;
-
-        if( *inlen < (signed)sizeof(blocktype) ) {
-            /* EOF encountered? */
-            break;
-        }
-        /* read further 2 bytes for next loop step */
-        memcpy(blocktype,_ptr,sizeof(blocktype));
-        _ptr  += sizeof(blocktype);
-        *inlen -= sizeof(blocktype);
-    }
-    /* if IsDataBlock returns false,
-     * step back which means reassign
-     * the pointer
-     */
-    if(*inlen > BLOCK_TYPE_SIZE) {
-       _ptr   -= BLOCK_TYPE_SIZE;
-       *inlen += BLOCK_TYPE_SIZE;
+    /* dont make use of user information */
+    if(!skipIter(it, usrInfoLen)) {
+        FreeInfo(fi);
+        return NULL;
     }
-    *inbuf = _ptr;
     return fi;
 }
 
 /**********************************************************************
- *  ParseEntriesFromFile()
+ *  readIterBlock()
  *
  *  Description:
- *  Reads a complete SAPCar header and parses it. Returns a list of
- *  SAPCARArchiveData
+ *  Reads the next data block of the current entry. Returns 1 with
+ *  the compressed data, 0 at the end of the entry and -1 if the
+ *  structure is invalid. With skip the data is passed over, a block
+ *  of a file is read into buf, a block of a buffer is used in place.
  *
  **********************************************************************/
-struct SAREntry *
-ParseEntriesFromFile(PChar file)
+static int
+readIterBlock(struct SARIterator *it, SAP_BOOL skip, SAP_BYTE *buf,
+              SAP_BYTE **data, unsigned int *size, SAP_BOOL *compressed,
+              SAP_BOOL *last)
 {
-    FILE *fp    =NULL;
-
-    struct SAREntry *fi  = NULL; /* begin of list */
-    struct SAREntry *_fi = NULL; /* current ptr   */
-    struct SAREntry *__fi= NULL; /* tmp. pointer  */
-
-    if(file == NULL)
-        return NULL;
-    /* open the archive file */
-    if ((fp = fopen((const char*)file, "rb")) == NULL) {
-        return NULL;
-    }    
-    /*
-     *  skip the SAPCAR header information
-     *  which means the magic and version string. 
-     */
-    fseek(fp, ARCHIVE_HEADER_SIZE ,SEEK_SET );
-
-    /* call the function for the raw content list 
-     * as long a no new entry is retrieved.
-     * the function pointer will be increased
-     * automatically
-     */
-    while( (__fi = getEntryHeader(fp)) != NULL)
-    {        
-        /* first */
-        if(fi == NULL) {
-            fi = __fi;
-           _fi = __fi;
-        } else {
-           _fi->next = __fi;
-           _fi = _fi->next;
-        }
-    }  
-    /* close the file handle */
-    fclose(fp);
+    BYTEARRAY_2    blocktype;
+    BYTEARRAY_4    blocksize;
+    BYTEARRAY_4    checksum;
+    unsigned int   toMove = 0;
+    unsigned int   _checksum = 0;
 
-    return fi;
+    if(!it->pending)
+        return 0;
+    /* read blocktype, the end of the archive ends the entry */
+    if(!readIter(it,blocktype,sizeof(blocktype))) {
+        it->pending = FALSE;
+        return 0;
+    }
+    if(!IsDataBlock(blocktype)) {
+        /* the block type belongs to the next EntryHeader, step back */
+        skipIter(it,-BLOCK_TYPE_SIZE);
+        it->pending = FALSE;
+        return 0;
+    }
+    /* size of the compressed data junk */
+    if(!readIter(it,blocksize,sizeof(blocksize)))
+        return -1;
+    BytesToUint(blocksize, &toMove);
+    it->entry->compressed_size += toMove;
+    if(skip) {
+        if(!skipIter(it,(long)toMove))
+            return -1;
+    } else if(it->fp != NULL || it->outer != NULL) {
+        /* a file block is read once, a buffer block is used in place */
+        if(toMove > SAR_BLOCK_MAX || !readIter(it,buf,toMove))
+            return -1;
+        (*data) = buf;
+    } else {
+        if(it->inlen < toMove)
+            return -1;
+        (*data) = it->inbuf;
+        skipIter(it,(long)toMove);
+    }
+    (*size)       = toMove;
+    (*compressed) = (SAP_BOOL)IsCompressedDataBlock(blocktype);
+    (*last)       = (SAP_BOOL)IsLastBlock(blocktype);
+    /* only the end block contains a checksum field */
+    if(*last) {
+        if(!readIter(it,checksum,sizeof(checksum)))
+            return -1;
+        BytesToUint(checksum, &_checksum);
+        it->entry->checksum = (size_t)_checksum;
+    }
+    return 1;
 }
 
 /**********************************************************************
- *  ParseEntriesFromBuffer()
+ *  decomprIterBlock()
  *
  *  Description:
- *  Reads a complete SAPCar header and parses it. Returns a list of
- *  SAPCARArchiveData
+ *  Decompresses one data block into out buffer and continues the
+ *  checksum, which is verified with the end block.
  *
  **********************************************************************/
-struct SAREntry *
-ParseEntriesFromBuffer(PByte inbuf, size_t inlen)
+static SAP_BOOL
+decomprIterBlock(struct SARIterator *it, SAP_BYTE *data, unsigned int size,
+                 SAP_BOOL compressed, SAP_BOOL last, PByte out, size_t outlen,
+                 size_t *outdone)
 {
-    struct SAREntry *fi  = NULL; /* begin of list */
-    struct SAREntry *_fi = NULL; /* current ptr   */
-    struct SAREntry *__fi= NULL; /* tmp. pointer  */
-    PByte    _ptr = inbuf;
-    size_t  _inln = inlen;
-
-    if(inbuf == NULL || inlen < ARCHIVE_HEADER_SIZE)
-        return NULL;
-    /*
-     *  skip the SAPCAR header information
-     *  which means the magic and version string.
-     */
-    _ptr  += ARCHIVE_HEADER_SIZE;
-    _inln -= ARCHIVE_HEADER_SIZE;
+    SAP_INT read = 0, decom = 0;
+    CSHDL   cshandle;
 
-    /* call the function for the raw content list
-     * as long a no new entry is retrieved.
-     * the function pointer will be increased
-     * automatically
-     */
-    while( (__fi = getEntryHeader2(&_ptr,&_inln)) != NULL)
-    {
-        /* first */
-        if(fi == NULL) {
-            fi = __fi;
-           _fi = __fi;
-        } else {
-           _fi->next = __fi;
-           _fi = _fi->next;
-        }
+    if(compressed) {
+        CsDecompr(&cshandle,data,(SAP_INT)size,out,(SAP_INT)outlen,CS_INIT_DECOMPRESS,&read,&decom);
+    } else {
+        decom = (SAP_INT)(size <= outlen ? size : outlen);
+        memcpy(out, data, (size_t)decom);
     }
-    /* close the file handle */
-
-    return fi;
+    PartialCRC(&it->crc32,out,(UInt)decom);
+    it->done += (size_t)decom;
+    (*outdone) = (size_t)decom;
+    if(last && it->crc32 != (unsigned int)it->entry->checksum)
+        return FALSE;
+    return TRUE;
 }
 
 /**********************************************************************
- *  getEntryByIndex()
+ *  walkIterBlocks()
  *
  *  Description:
- *  Parses a single SAPCar EntryHeader info into
- *  the corresponding structure AND decompress the data into out buffer
+ *  Walks the data blocks of the current entry once. With an out
+ *  buffer the data is decompressed and the checksum is verified,
+ *  otherwise the blocks are skipped.
  *
  **********************************************************************/
-static struct SAREntry *
-getEntryByIndex(FILE *fp, PByte out, size_t *outlen)
+static SAP_BOOL
+walkIterBlocks(struct SARIterator *it, PByte out, size_t *outlen)
 {
-    BYTEARRAY_2    blocktype;
-    BYTEARRAY_4    blocksize;
-    BYTEARRAY_4    checksum;
-    unsigned short nameLen;
-    unsigned short usrInfoLen;
-    size_t         lRead  = 0;
-    unsigned int   toMove = 0;
-    unsigned int   toMove2= 0;
-    SAP_ULLONG     sizeLow;
-    unsigned int   sizeHigh;
-    unsigned int   _checksum = 0;
-    unsigned int   _crc32 = 0;
-    SAP_RAW        cBuffer[65536];
-    CSHDL          cshandle;
-    size_t        _outlen = (outlen?*outlen:0);
-    int            option = CS_INIT_DECOMPRESS;
+    size_t         _outlen = (out != NULL && outlen != NULL) ? *outlen : 0;
+    size_t         _done = 0;
+    size_t         decom = 0;
+    unsigned int   size = 0;
+    SAP_BOOL       compressed = FALSE;
+    SAP_BOOL       last = FALSE;
+    SAP_BYTE      *_data = NULL;
+    int            rc = 0;
 
-    struct SAREntry          *fi = NULL;
-    struct EntryHeaderBytes   entry;
+    /* loop while data block processing */
+    while((rc = readIterBlock(it,(SAP_BOOL)(out == NULL),it->block,&_data,&size,&compressed,&last)) > 0) {
+        if(out == NULL)
+            continue;
+        if(!decomprIterBlock(it,_data,size,compressed,last,out+_done,_outlen,&decom))
+            return FALSE;
+        _done   += decom;
+        _outlen -= decom;
+    }
+    it->pending = FALSE;
+    if(rc < 0)
+        return FALSE;
+    if(outlen != NULL)
+        (*outlen) = _done;
+    return TRUE;
+}
 
-    /*   This function expects a FILE ptr (fp)
-     *   set to the begin of  the fix EntryHeader.
-     *   Read-in the raw byte information to the
-     *   structure to have access to attributes
-     *   by the EntryHeaderBytes structure
-     */
-    lRead = fread(&entry,sizeof(char),sizeof(struct EntryHeaderBytes),fp);
-    if(lRead != sizeof(struct EntryHeaderBytes))
-        return NULL;
+/*
+ *  Parallel decompression: the blocks of a batch are decompressed by
+ *  the threads into their place in the output, each with an own
+ *  checksum, which is combined into the checksum of the entry.
+ */
+static unsigned int uigInflateThreads = 0;
 
-    /* Position of the FILE pointer is now at the
-     * begin of  the dynamic EntryHeader block.
-     */
-    /* convert the entry name length to ushort */
-    BytesToUshort(entry.nameLength, &nameLen);
-    /* allocate and initialise a new SAPCARArchiveData */
-    fi = NewInfo(fp, nameLen);
-    if(fi==NULL)
-        return NULL;
+struct SARInflateJob
+{
+  SAP_BYTE *data;
+  unsigned int size;
+  SAP_BOOL compressed;
 
-    /*
-     * map the entry type, same as in doc, see sapcar.h
-     */
-    if(      !memcmp(entry.type, IA_RG, BLOCK_TYPE_SIZE) )
-        fi->type = FT_RG; /* regular file     */
-    else if (!memcmp(entry.type, IA_DR, BLOCK_TYPE_SIZE))
-        fi->type = FT_DR; /* directory        */
-    else if(!memcmp(entry.type,  IA_SC, BLOCK_TYPE_SIZE))
-        fi->type = FT_SC; /* windows shortcut */
-    else if(!memcmp(entry.type,  IA_LK, BLOCK_TYPE_SIZE))
-        fi->type = FT_LK; /* unix softlink    */
-    else if(!memcmp(entry.type,  IA_SV, BLOCK_TYPE_SIZE))
-        fi->type = FT_SV; /* AS/400 save file */
+  /* place of the block in the output */
+  PByte out;
+  size_t outlen;
 
-    /* convert the numeric parameters */
-    BytesToUint( entry.mode, &fi->mode);
-    BytesToUllong( entry.sizeLow, &sizeLow );
-    BytesToUint( entry.sizeHigh, &sizeHigh );
-    BytesToUshort(entry.userInfoLength, &usrInfoLen);
+  /* result: decompressed bytes and their checksum */
+  size_t done;
+  unsigned int crc32;
+};
 
-    /* calculate the uncompressed size
-     * with low and high value
-     * see archive specification for detailed
-     * information about this
-     */
-    fi->uncompressed_size = (size_t) ( (size_t)(sizeHigh*FOUR_GB) + sizeLow);
+struct SARInflate
+{
+  VSA_MUTEX lock;
+  VSA_COND cond;
+  struct SARInflateJob *jobs;
+  unsigned int count;       /* jobs of the current batch */
+  unsigned int next;        /* next job to start */
+  unsigned int finished;    /* finished jobs of the batch */
+  SAP_BOOL stop;
+};
 
-    /*
-     * convert date bytes to time_t value
-     * with the rule:
-     */
-    if (sizeof(time_t) == SIZE_FOUR_BYTE){
-        /* 32-Bit environment: size_t is 4 bytes
-         * use a temporary 4 byte value
-         */
-        BYTEARRAY_4 tmp;
-        unsigned int _date = 0;
-        memcpy(tmp, entry.date, sizeof(tmp));
-        BytesToUint(tmp, &_date);
-        fi->date = _date;
+#ifdef VSA_ATOMIC_LOCK
+static pthread_mutex_t tAtomicLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**********************************************************************
+ *  CsLoadPtr()
+ *
+ *  Description:
+ *  VSA_LOAD_PTR without the atomic builtins, reads the pointer under
+ *  a process wide lock.
+ *
+ **********************************************************************/
+void *
+CsLoadPtr(void **p)
+{
+    void *_v;
+
+    pthread_mutex_lock(&tAtomicLock);
+    _v = *p;
+    pthread_mutex_unlock(&tAtomicLock);
+    return _v;
+}
+
+/**********************************************************************
+ *  CsStorePtr()
+ *
+ *  Description:
+ *  VSA_STORE_PTR without the atomic builtins, see CsLoadPtr.
+ *
+ **********************************************************************/
+void
+CsStorePtr(void **p, void *v)
+{
+    pthread_mutex_lock(&tAtomicLock);
+    *p = v;
+    pthread_mutex_unlock(&tAtomicLock);
+}
+#endif
+
+/**********************************************************************
+ *  SarSetInflateThreads()
+ *
+ *  Description:
+ *  Sets the number of threads of SarReadEntry, 0 or 1 decompresses
+ *  in the calling thread only.
+ *
+ **********************************************************************/
+void
+SarSetInflateThreads(unsigned int threads)
+{
+    uigInflateThreads = threads <= SAR_INFLATE_THREADS_MAX ? threads : SAR_INFLATE_THREADS_MAX;
+}
+
+/**********************************************************************
+ *  inflateJob()
+ *
+ *  Description:
+ *  Decompresses one block of a batch.
+ *
+ **********************************************************************/
+static void
+inflateJob(struct SARInflateJob *job)
+{
+    SAP_INT read = 0, decom = 0;
+    CSHDL   cshandle;
+
+    if(job->compressed) {
+        CsDecompr(&cshandle,job->data,(SAP_INT)job->size,job->out,(SAP_INT)job->outlen,CS_INIT_DECOMPRESS,&read,&decom);
+    } else {
+        decom = (SAP_INT)job->outlen;
+        memcpy(job->out, job->data, job->outlen);
     }
-    else if(sizeof(time_t) == SIZE_EIGHT_BYTE){
-        /* 64-Bit environment: size_t is 8 bytes */
-        BytesToUllong( entry.date, (SAP_ULLONG*)&fi->date );
+    job->crc32 = 0;
+    PartialCRC(&job->crc32,job->out,(UInt)decom);
+    job->done = (size_t)decom;
+}
+
+/**********************************************************************
+ *  inflateBatch()
+ *
+ *  Description:
+ *  Takes the jobs of the current batch until none is left. The
+ *  lock is held on entry and on return.
+ *
+ **********************************************************************/
+static void
+inflateBatch(struct SARInflate *inf)
+{
+    unsigned int _job;
+
+    while(!inf->stop && inf->next < inf->count) {
+        _job = inf->next++;
+        VSA_UNLOCK(&inf->lock);
+        inflateJob(&inf->jobs[_job]);
+        VSA_LOCK(&inf->lock);
+        if(++inf->finished == inf->count)
+            VSA_COND_SIGNAL(&inf->cond);
     }
+}
 
-    /*
-     * dont make use of user information
-     * therefore skip these bytes with fseek
-     */
-    fseek(fp,usrInfoLen, SEEK_CUR);
+/**********************************************************************
+ *  inflateWorker()
+ *
+ *  Description:
+ *  Thread of inflateIterBlocks, which waits for the next batch.
+ *
+ **********************************************************************/
+static VSA_THREAD_RC VSA_THREAD_API
+inflateWorker(void *arg)
+{
+    struct SARInflate *inf = (struct SARInflate *)arg;
 
-    /* read blocktype */
-    lRead = fread(blocktype,sizeof(char),sizeof(blocktype),fp);
-    /* loop while data block processing */
-    while(IsDataBlock(blocktype)){
-        /* size of the compressed data junk */
-        lRead = fread(blocksize,sizeof(char),sizeof(blocksize),fp);
-        if( lRead != sizeof(blocksize) )
-            return NULL;
-        /* convert to unsigned integer */
-        BytesToUint(blocksize, &toMove);
-        /* add to junk size to the compressed size.
-         * perform an addition in cases of several junks
-         */
-        fi->compressed_size += toMove;
-        /*-------------------------------------------------------
-         *
-         * >>> Compressed data block <<<
-         *
-         --------------------------------------------------------*/
-        if(toMove <= sizeof(cBuffer)) {
-            SAP_INT read, decom;
-            lRead = fread(cBuffer,sizeof(char),toMove,fp);
-            if( lRead != toMove ) {
-                return NULL;
-            }
-            if(IsCompressedDataBlock(blocktype)) {
-                CsDecompr(&cshandle,cBuffer,(SAP_INT)lRead,out+toMove2,(SAP_INT)_outlen,CS_INIT_DECOMPRESS,&read,&decom);
-                _outlen -= (unsigned int)decom;
-                PartialCRC(&_crc32,out+toMove2,decom);
-                toMove2 += (unsigned int)decom;
-            } else {
-                read  = lRead;
-                decom = lRead;
-                memcpy(out+toMove2, cBuffer, lRead);
-                PartialCRC(&_crc32,out+toMove2,lRead);
-                toMove2 += (unsigned int)lRead;
-            }
-            if(option == CS_INIT_DECOMPRESS) {
-                if(outlen) (*outlen) = decom;
-                option = 0;
+    VSA_LOCK(&inf->lock);
+    while(!inf->stop) {
+        inflateBatch(inf);
+        if(!inf->stop)
+            VSA_COND_WAIT(&inf->cond,&inf->lock);
+    }
+    VSA_UNLOCK(&inf->lock);
+    return (VSA_THREAD_RC)0;
+}
+
+/**********************************************************************
+ *  inflateIterBlocks()
+ *
+ *  Description:
+ *  Decompresses the data blocks of the current entry as
+ *  walkIterBlocks, but in batches on uigInflateThreads threads. The
+ *  place of a block in the output follows from the uncompressed
+ *  length in its header, so the blocks of a batch are read first and
+ *  decompressed in parallel, then the checksums are combined in
+ *  archive order.
+ *
+ **********************************************************************/
+static SAP_BOOL
+inflateIterBlocks(struct SARIterator *it, PByte out, size_t *outlen)
+{
+    struct SARInflate     inf;
+    struct SARInflateJob *_job = NULL;
+    VSA_THREAD            _threads[SAR_INFLATE_THREADS_MAX];
+    unsigned int          _started = 0;
+    unsigned int          _batch = SAR_INFLATE_BATCH * uigInflateThreads;
+    unsigned int          _count = 0;
+    unsigned int          _i = 0;
+    SAP_BYTE             *_slots = NULL;
+    size_t                _outlen = *outlen;
+    size_t                _done = 0;
+    size_t                _need = 0;
+    unsigned int          size = 0;
+    SAP_BOOL              compressed = FALSE;
+    SAP_BOOL              last = FALSE;
+    SAP_BOOL              valid = TRUE;
+    SAP_BYTE             *_data = NULL;
+    SAP_INT               _len = 0;
+    int                   rc = 1;
+
+    memset(&inf, 0, sizeof(inf));
+    inf.jobs = (struct SARInflateJob *)calloc(_batch, sizeof(struct SARInflateJob));
+    /* the blocks of a file are read into an own slot per job */
+    if(it->fp != NULL || it->outer != NULL)
+        _slots = (SAP_BYTE *)malloc((size_t)_batch * SAR_BLOCK_MAX);
+    if(inf.jobs == NULL || (_slots == NULL && (it->fp != NULL || it->outer != NULL))) {
+        if(inf.jobs) free(inf.jobs);
+        if(_slots) free(_slots);
+        return walkIterBlocks(it,out,outlen);
+    }
+    VSA_MUTEX_INIT(&inf.lock);
+    VSA_COND_INIT(&inf.cond);
+    /* the calling thread decompresses, too */
+    while(_started + 1 < uigInflateThreads) {
+        if(!VSA_THREAD_CREATE(&_threads[_started],inflateWorker,&inf))
+            break;
+        _started++;
+    }
+
+    while(valid && rc > 0) {
+        /* read the blocks of the next batch */
+        for(_count = 0; _count < _batch; _count++) {
+            rc = readIterBlock(it,FALSE,_slots != NULL ? _slots + (size_t)_count * SAR_BLOCK_MAX : it->block,
+                               &_data,&size,&compressed,&last);
+            if(rc <= 0)
+                break;
+            if(compressed) {
+                if(size < CS_HEAD_SIZE || (_len = CsGetLen(_data)) < 0) {
+                    valid = FALSE;
+                    break;
+                }
+                _need = (size_t)_len;
             } else {
-                if(outlen) (*outlen) += decom;
+                _need = size;
             }
+            if(_need > _outlen)
+                _need = _outlen;
+            _job = &inf.jobs[_count];
+            _job->data       = _data;
+            _job->size       = size;
+            _job->compressed = compressed;
+            _job->out        = out + _done;
+            _job->outlen     = _need;
+            _done   += _need;
+            _outlen -= _need;
         }
-        /* end block */
-        if(IsLastBlock(blocktype)) {
-            /* only the end block contains a checksum field */
-            lRead = fread(checksum,sizeof(char),sizeof(checksum),fp);
-            BytesToUint(checksum, &_checksum);
-            fi->checksum = (size_t)_checksum;
-            if(_crc32 != _checksum) {
-                /* Error */
-                vsaunlink((const char*)fi->name);
-                free(fi->name);
-                free(fi);
-                return NULL;
-            }
-        }
-        /* read further 2 bytes for next loop step */
-        lRead = fread(blocktype,sizeof(char),sizeof(blocktype),fp);
-        if( lRead != sizeof(blocktype) ) {
-            /* EOF encountred? */
+        if(_count == 0)
             break;
+        VSA_LOCK(&inf.lock);
+        inf.count    = _count;
+        inf.next     = 0;
+        inf.finished = 0;
+        VSA_COND_SIGNAL(&inf.cond);
+        inflateBatch(&inf);
+        while(inf.finished < inf.count)
+            VSA_COND_WAIT(&inf.cond,&inf.lock);
+        VSA_UNLOCK(&inf.lock);
+        /* continue the checksum of the entry in archive order */
+        for(_i = 0; _i < _count; _i++) {
+            _job = &inf.jobs[_i];
+            if(_job->done != _job->outlen)
+                valid = FALSE;
+            it->crc32 = (unsigned int)CombineCRC(it->crc32,_job->crc32,_job->done);
+            it->done += _job->done;
         }
     }
-    /* if IsDataBlock returns false,
-     * step back which means reassign
-     * the file ptr with fseek
-     */
-    fseek(fp, -BLOCK_TYPE_SIZE, SEEK_CUR);
-    return fi;
+
+    VSA_LOCK(&inf.lock);
+    inf.stop = TRUE;
+    VSA_COND_SIGNAL(&inf.cond);
+    VSA_UNLOCK(&inf.lock);
+    for(_i = 0; _i < _started; _i++)
+        VSA_THREAD_JOIN(_threads[_i]);
+    VSA_COND_FREE(&inf.cond);
+    VSA_MUTEX_FREE(&inf.lock);
+    free(inf.jobs);
+    if(_slots) free(_slots);
+
+    it->pending = FALSE;
+    if(rc < 0 || !valid)
+        return FALSE;
+    if(last && it->crc32 != (unsigned int)it->entry->checksum)
+        return FALSE;
+    (*outlen) = _done;
+    return TRUE;
 }
 
+/*
+ *  Index cache: the entries of archive files, which an iterator has
+ *  read to the end, in the order of the last use. An index is shared
+ *  by the iterators which replay it and freed with the last reference.
+ */
+struct SARIndexEntry
+{
+  struct SAREntry info;
+  unsigned short namelen;
+
+  /* first data block of the entry */
+  long datapos;
+};
+
+struct SARIndex
+{
+  struct SARIndex *next;
+  unsigned int refs;
+
+  /* identity of the archive file */
+  SAP_ULLONG dev;
+  SAP_ULLONG ino;
+  SAP_ULLONG size;
+  time_t mtime;
+  time_t ctime;
+  long mtimens;
+  long ctimens;
+
+  struct SARIndexEntry *entries;
+  size_t count;
+  size_t alloc;
+};
+
+static struct SARIndex *pgIndexCache = NULL;
+static unsigned int uigIndexCacheMax = 0;
+static VSA_MUTEX tIndexLock;
+#ifdef _WIN32
+static INIT_ONCE tIndexOnce = INIT_ONCE_STATIC_INIT;
+#else
+static pthread_once_t tIndexOnce = PTHREAD_ONCE_INIT;
+#endif
+
+/* nanoseconds of the file times, 0 where stat has only seconds */
+#if defined(__APPLE__)
+#define SAR_MTIME_NS(st) ((long)(st).st_mtimespec.tv_nsec)
+#define SAR_CTIME_NS(st) ((long)(st).st_ctimespec.tv_nsec)
+#elif defined(__linux) || defined(__sun) || defined(_AIX) || defined(__FreeBSD__)
+#define SAR_MTIME_NS(st) ((long)(st).st_mtim.tv_nsec)
+#define SAR_CTIME_NS(st) ((long)(st).st_ctim.tv_nsec)
+#else
+#define SAR_MTIME_NS(st) 0L
+#define SAR_CTIME_NS(st) 0L
+#endif
+
 /**********************************************************************
- *  getEntryByIndex2()
+ *  initIndexLock()
  *
  *  Description:
- *  Parses a single SAPCar EntryHeader info into
- *  the corresponding structure AND decompress the data into out buffer
+ *  Creates the lock of the index cache, runs once per process. The
+ *  lock is never destroyed, iterators may still use it after
+ *  SarFreeIndexCache.
  *
  **********************************************************************/
-static struct SAREntry *
-getEntryByIndex2(SAP_BYTE **inbuf, size_t *inlen, PByte out, size_t *outlen)
+#ifdef _WIN32
+static BOOL CALLBACK
+initIndexLock(PINIT_ONCE once, PVOID param, PVOID *context)
 {
-    BYTEARRAY_2    blocktype;
-    BYTEARRAY_4    blocksize;
-    BYTEARRAY_4    checksum;
-    unsigned short nameLen;
-    unsigned short usrInfoLen;
-    unsigned int   toMove = 0;
-    unsigned int   toMove2= 0;
-    SAP_ULLONG     sizeLow;
-    unsigned int   sizeHigh;
-    unsigned int   _checksum = 0;
-    unsigned int   _crc32 = 0;
-    SAP_BYTE *     _ptr = NULL;
-    CSHDL          cshandle;
-    size_t        _outlen = (outlen?*outlen:0);
-    int            option = CS_INIT_DECOMPRESS;
+    VSA_MUTEX_INIT(&tIndexLock);
+    return TRUE;
+}
+#else
+static void
+initIndexLock(void)
+{
+    VSA_MUTEX_INIT(&tIndexLock);
+}
+#endif
 
-    struct SAREntry          *fi = NULL;
-    struct EntryHeaderBytes   entry;
+/**********************************************************************
+ *  lockIndexCache()
+ *
+ *  Description:
+ *  Takes the lock of the index cache, creates it on the first call.
+ *
+ **********************************************************************/
+static void
+lockIndexCache(void)
+{
+#ifdef _WIN32
+    InitOnceExecuteOnce(&tIndexOnce,initIndexLock,NULL,NULL);
+#else
+    pthread_once(&tIndexOnce,initIndexLock);
+#endif
+    VSA_LOCK(&tIndexLock);
+}
 
-    if(inbuf == NULL || *inbuf == NULL || inlen == NULL || *inlen < (signed)sizeof(struct EntryHeaderBytes))
-       return NULL;
-    _ptr = *inbuf;
-    /*   This function expects a input buffer
-     *   Read-in the raw byte information to the
-     *   structure to have access to attributes
-     *   by the EntryHeaderBytes structure
-     */
-    memcpy(&entry,_ptr,sizeof(struct EntryHeaderBytes));
-    _ptr  += sizeof(struct EntryHeaderBytes);
-    *inlen -= sizeof(struct EntryHeaderBytes);
+/**********************************************************************
+ *  freeIndex()
+ *
+ *  Description:
+ *  Frees an index with the names of the entries.
+ *
+ **********************************************************************/
+static void
+freeIndex(struct SARIndex *idx)
+{
+    size_t _i;
 
-    /* Position of the FILE pointer is now at the
-     * begin of  the dynamic EntryHeader block.
-     */
-    /* convert the entry name length to ushort */
-    BytesToUshort(entry.nameLength, &nameLen);
-    /* allocate and initialise a new SAPCARArchiveData */
-    fi = NewInfo2(_ptr, nameLen);
-    if(fi==NULL) {
-        return NULL;
-    } else {
-        _ptr  += nameLen;
-        *inlen -= nameLen;
+    if(idx == NULL)
+        return;
+    for(_i = 0; _i < idx->count; _i++) {
+        if(idx->entries[_i].info.name != NULL)
+            free(idx->entries[_i].info.name);
     }
+    if(idx->entries != NULL)
+        free(idx->entries);
+    free(idx);
+}
 
-    /*
-     * map the entry type, same as in doc, see sapcar.h
-     */
-    if(      !memcmp(entry.type, IA_RG, BLOCK_TYPE_SIZE) )
-        fi->type = FT_RG; /* regular file     */
-    else if (!memcmp(entry.type, IA_DR, BLOCK_TYPE_SIZE))
-        fi->type = FT_DR; /* directory        */
-    else if(!memcmp(entry.type,  IA_SC, BLOCK_TYPE_SIZE))
-        fi->type = FT_SC; /* windows shortcut */
-    else if(!memcmp(entry.type,  IA_LK, BLOCK_TYPE_SIZE))
-        fi->type = FT_LK; /* unix softlink    */
-    else if(!memcmp(entry.type,  IA_SV, BLOCK_TYPE_SIZE))
-        fi->type = FT_SV; /* AS/400 save file */
+/**********************************************************************
+ *  releaseIndex()
+ *
+ *  Description:
+ *  Drops a reference, the lock must be held.
+ *
+ **********************************************************************/
+static void
+releaseIndex(struct SARIndex *idx)
+{
+    if(idx != NULL && --idx->refs == 0)
+        freeIndex(idx);
+}
 
-    /* convert the numeric parameters */
-    BytesToUint( entry.mode, &fi->mode);
-    BytesToUllong( entry.sizeLow, &sizeLow );
-    BytesToUint( entry.sizeHigh, &sizeHigh );
-    BytesToUshort(entry.userInfoLength, &usrInfoLen);
+/**********************************************************************
+ *  SarSetIndexCache()
+ *
+ *  Description:
+ *  Keeps the entries of up to archives files for later iterators on
+ *  the same file, 0 disables the cache. Must be called before any
+ *  iterator is opened.
+ *
+ **********************************************************************/
+void
+SarSetIndexCache(unsigned int archives)
+{
+    lockIndexCache();
+    uigIndexCacheMax = archives <= SAR_INDEX_CACHE_MAX ? archives : SAR_INDEX_CACHE_MAX;
+    VSA_UNLOCK(&tIndexLock);
+}
 
-    /* calculate the uncompressed size
-     * with low and high value
-     * see archive specification for detailed
-     * information about this
-     */
-    fi->uncompressed_size = (size_t) ( (size_t)(sizeHigh*FOUR_GB) + sizeLow);
+/**********************************************************************
+ *  SarFreeIndexCache()
+ *
+ *  Description:
+ *  Disables the cache and drops its references. An index which is
+ *  still replayed by an open iterator is freed when the last of these
+ *  iterators is closed.
+ *
+ **********************************************************************/
+void
+SarFreeIndexCache(void)
+{
+    struct SARIndex *_idx = NULL;
+
+    lockIndexCache();
+    uigIndexCacheMax = 0;
+    while(pgIndexCache != NULL) {
+        _idx = pgIndexCache;
+        pgIndexCache = _idx->next;
+        releaseIndex(_idx);
+    }
+    VSA_UNLOCK(&tIndexLock);
+}
 
-    /*
-     * convert date bytes to time_t value
-     * with the rule:
-     */
-    if (sizeof(time_t) == SIZE_FOUR_BYTE){
-        /* 32-Bit environment: size_t is 4 bytes
-         * use a temporary 4 byte value
-         */
-        BYTEARRAY_4 tmp;
-        unsigned int _date = 0;
-        memcpy(tmp, entry.date, sizeof(tmp));
-        BytesToUint(tmp, &_date);
-        fi->date = _date;
+/**********************************************************************
+ *  openIndex()
+ *
+ *  Description:
+ *  Looks up the archive file of the iterator in the cache. A cached
+ *  index is replayed, otherwise a new index is recorded. Files
+ *  without an inode number are not cached.
+ *
+ **********************************************************************/
+static void
+openIndex(struct SARIterator *it)
+{
+    struct stat      _st;
+    struct SARIndex *_idx = NULL;
+    struct SARIndex *_prev = NULL;
+
+    if(uigIndexCacheMax == 0 || 0 != fstat(fileno(it->fp),&_st) || _st.st_ino == 0)
+        return;
+    it->index = (struct SARIndex *)calloc(1,sizeof(struct SARIndex));
+    if(it->index == NULL)
+        return;
+    it->index->dev   = (SAP_ULLONG)_st.st_dev;
+    it->index->ino   = (SAP_ULLONG)_st.st_ino;
+    it->index->size  = (SAP_ULLONG)_st.st_size;
+    it->index->mtime = _st.st_mtime;
+    it->index->ctime = _st.st_ctime;
+    it->index->mtimens = SAR_MTIME_NS(_st);
+    it->index->ctimens = SAR_CTIME_NS(_st);
+    it->index->refs  = 1;
+    lockIndexCache();
+    for(_idx = pgIndexCache; _idx != NULL; _prev = _idx, _idx = _idx->next) {
+        if(_idx->dev == it->index->dev && _idx->ino == it->index->ino &&
+           _idx->size == it->index->size && _idx->mtime == it->index->mtime &&
+           _idx->ctime == it->index->ctime && _idx->mtimens == it->index->mtimens &&
+           _idx->ctimens == it->index->ctimens)
+            break;
     }
-    else if(sizeof(time_t) == SIZE_EIGHT_BYTE){
-        /* 64-Bit environment: size_t is 8 bytes */
-        BytesToUllong( entry.date, (SAP_ULLONG*)&fi->date );
+    if(_idx != NULL) {
+        /* move to the front, the last one is evicted first */
+        if(_prev != NULL) {
+            _prev->next  = _idx->next;
+            _idx->next   = pgIndexCache;
+            pgIndexCache = _idx;
+        }
+        _idx->refs++;
     }
+    VSA_UNLOCK(&tIndexLock);
+    if(_idx != NULL) {
+        freeIndex(it->index);
+        it->index  = _idx;
+        it->replay = TRUE;
+    }
+}
 
-    /*
-     * dont make use of user information
-     * therefore skip these bytes with fseek
-     */
-    _ptr  += usrInfoLen;
-    *inlen -= usrInfoLen;
-
-    /* read blocktype */
-    memcpy(blocktype,_ptr,sizeof(blocktype));
-    _ptr  += sizeof(blocktype);
-    *inlen -= sizeof(blocktype);
-    /* loop while data block processing */
-    while(IsDataBlock(blocktype)){
-        /* size of the compressed data junk */
-        memcpy(blocksize,_ptr,sizeof(blocksize));
-        _ptr  += sizeof(blocksize);
-        *inlen -= sizeof(blocksize);
-        /* convert to unsigned integer */
-        BytesToUint(blocksize, &toMove);
-        /* add to junk size to the compressed size.
-         * perform an addition in cases of several junks
-         */
-        fi->compressed_size += toMove;
-
-        /*-------------------------------------------------------
-         *
-         * >>> Compressed data block <<<
-         *
-         --------------------------------------------------------*/
-        if(toMove <= (unsigned)*inlen) {
-            SAP_INT read = 0, decom = 0;
-            if(IsCompressedDataBlock(blocktype)) {
-                CsDecompr(&cshandle,_ptr, toMove, out+toMove2,(SAP_INT)_outlen,CS_INIT_DECOMPRESS,&read,&decom);
-                _outlen -= (unsigned int)decom;
-                PartialCRC(&_crc32,out+toMove2,decom);
-                toMove2 += (unsigned int)decom;
-            } else {
-                read  = toMove;
-                decom = toMove;
-                memcpy(out+toMove2, _ptr, read);
-                PartialCRC(&_crc32,out+toMove2,read);
-                toMove2 += (unsigned int)read;
-            }
-            if(option == CS_INIT_DECOMPRESS) {
-                if(outlen) (*outlen) = decom;
-                option = 0;
+/**********************************************************************
+ *  closeIndex()
+ *
+ *  Description:
+ *  Ends the use of the index by the iterator. With publish a recorded
+ *  index is complete and put into the cache.
+ *
+ **********************************************************************/
+static void
+closeIndex(struct SARIterator *it, SAP_BOOL publish)
+{
+    struct SARIndex *_idx = NULL;
+    struct SARIndex *_prev = NULL;
+    unsigned int     _n = 1;
+
+    if(it->index == NULL)
+        return;
+    if(!it->replay && !publish) {
+        freeIndex(it->index);
+        it->index = NULL;
+        return;
+    }
+    lockIndexCache();
+    if(it->replay) {
+        releaseIndex(it->index);
+    } else if(uigIndexCacheMax > 0) {
+        /* the reference of the recorder belongs to the cache now */
+        it->index->next = pgIndexCache;
+        pgIndexCache    = it->index;
+        /* drop an older index of the file and the least recent ones */
+        for(_prev = pgIndexCache; (_idx = _prev->next) != NULL; ) {
+            if(_n >= uigIndexCacheMax ||
+               (_idx->dev == pgIndexCache->dev && _idx->ino == pgIndexCache->ino)) {
+                _prev->next = _idx->next;
+                releaseIndex(_idx);
             } else {
-                if(outlen) (*outlen) += decom;
-            }
-        }
-
-        /* Move pointer past the data block so we can read the checksum if this is an end block  */
-        _ptr  += toMove;
-        *inlen -= toMove;
-
-        /* end block */
-        if(IsLastBlock(blocktype)) {
-            /* only the end block contains a checksum field */
-            memcpy(checksum,_ptr,sizeof(checksum));
-            _ptr  += sizeof(checksum);
-            *inlen -= sizeof(checksum);
-            BytesToUint(checksum, &_checksum);
-            fi->checksum = (size_t)_checksum;
-            if(_crc32 != _checksum) {
-                /* Error */
-                free(fi->name);
-                free(fi);
-                return NULL;
+                _prev = _idx;
+                _n++;
             }
         }
+    } else {
+        releaseIndex(it->index);
+    }
+    VSA_UNLOCK(&tIndexLock);
+    it->index    = NULL;
+    it->indexpos = 0;
+    it->replay   = FALSE;
+}
 
-        if( (signed)*inlen < (signed)sizeof(blocktype) ) {
-            /* EOF encountred? */
-            break;
+/**********************************************************************
+ *  recordIndex()
+ *
+ *  Description:
+ *  Adds the current entry to the recorded index, after its data
+ *  blocks were read. Archives with too many entries are not cached.
+ *
+ **********************************************************************/
+static void
+recordIndex(struct SARIterator *it)
+{
+    struct SARIndex      *_idx = it->index;
+    struct SARIndexEntry *_entries = NULL;
+    struct SARIndexEntry *_e = NULL;
+    size_t                _alloc = 0;
+
+    if(_idx->count == _idx->alloc) {
+        _alloc = _idx->alloc ? _idx->alloc * 2 : 64;
+        if(_alloc > SAR_INDEX_ENTRIES_MAX ||
+           (_entries = (struct SARIndexEntry *)realloc(_idx->entries,_alloc * sizeof(struct SARIndexEntry))) == NULL) {
+            closeIndex(it,FALSE);
+            return;
         }
-        /* read further 2 bytes for next loop step */
-        memcpy(blocktype,_ptr,sizeof(blocktype));
-        _ptr  += sizeof(blocktype);
-        *inlen -= sizeof(blocktype);
-    }
-    /* if IsDataBlock returns false,
-     * step back which means reassign
-     * the pointer
-     */
-    if(*inlen > BLOCK_TYPE_SIZE) {
-       _ptr   -= BLOCK_TYPE_SIZE;
-       *inlen += BLOCK_TYPE_SIZE;
+        _idx->entries = _entries;
+        _idx->alloc   = _alloc;
     }
-    *inbuf = _ptr;
-    return fi;
+    _e = &_idx->entries[_idx->count];
+    memcpy(&_e->info,it->entry,sizeof(struct SAREntry));
+    _e->info.next = NULL;
+    _e->info.name = (unsigned char *)malloc(it->namelen ? it->namelen : 1);
+    if(_e->info.name == NULL) {
+        closeIndex(it,FALSE);
+        return;
+    }
+    memcpy(_e->info.name,it->entry->name,it->namelen);
+    _e->namelen = it->namelen;
+    _e->datapos = it->datapos;
+    _idx->count++;
 }
 
 /**********************************************************************
- *  ExtractEntryFromFile()
+ *  replayIndex()
  *
  *  Description:
- *  Decompress the data of a certain entry in archive into out buffer
+ *  Makes the next cached entry the current entry of the iterator and
+ *  positions it at the first data block.
  *
  **********************************************************************/
-size_t
-ExtractEntryFromFile(PChar file, Int index, PByte outbuf, size_t outlen)
+static struct SAREntry *
+replayIndex(struct SARIterator *it)
 {
-    FILE *fp    =NULL;
-    int counter = 0;
-    size_t _outlen = outlen;
+    struct SARIndexEntry *_e = NULL;
 
-    struct SAREntry *fi  = NULL; /* begin of list */
-    struct SAREntry *_fi = NULL; /* current ptr   */
-    struct SAREntry *__fi= NULL; /* tmp. pointer  */
+    FreeInfo(it->entry);
+    it->entry = NULL;
+    if(it->indexpos >= it->index->count) {
+        it->eof = TRUE;
+        return NULL;
+    }
+    _e = &it->index->entries[it->indexpos++];
+    it->entry = dupInfo(&_e->info,_e->namelen);
+    if(it->entry == NULL) {
+        it->eof = TRUE;
+        return NULL;
+    }
+    it->namelen = _e->namelen;
+    it->datapos = _e->datapos;
+    if((it->map != NULL && !mapIterData(it,it->datapos)) || !SarRewindEntry(it)) {
+        it->eof = TRUE;
+        return NULL;
+    }
+    return it->entry;
+}
+
+/**********************************************************************
+ *  SarOpenFile()
+ *
+ *  Description:
+ *  Opens the iterator on an archive file. The file is mapped and
+ *  parsed as a buffer, if the mapping fails it is read with stdio.
+ *
+ **********************************************************************/
+struct SARIterator *
+SarOpenFile(PChar file)
+{
+    struct SARIterator *it = NULL;
+#ifndef _WIN32
+    struct stat         _st;
+    void               *_map = NULL;
+#endif
 
     if(file == NULL)
-        return 0;
+        return NULL;
+    it = (struct SARIterator *)calloc(1,sizeof(struct SARIterator));
+    if(it == NULL)
+        return NULL;
     /* open the archive file */
-    if ((fp = fopen((const char*)file, "rb")) == NULL) {
-        return 0;
+    if ((it->fp = fopen((const char*)file, "rb")) == NULL) {
+        free(it);
+        return NULL;
     }
-    /*
-     *  skip the SAPCAR header information
-     *  which means the magic and version string.
-     */
-    fseek(fp, ARCHIVE_HEADER_SIZE ,SEEK_SET );
-
-    /* call the function for the raw content list
-     * as long a no new entry is retrieved.
-     * the function pointer will be increased
-     * automatically
-     */
-    do {
-        if(counter == index) {
-            __fi = getEntryByIndex(fp,outbuf,&_outlen);
-            /* first */
-            if(fi == NULL) {
-                fi = __fi;
-               _fi = __fi;
-            } else {
-               _fi->next = __fi;
-               _fi = _fi->next;
-            }
-            break;
-        } else {
-            __fi = getEntryHeader(fp);
-            /* first */
-            if(fi == NULL) {
-                fi = __fi;
-               _fi = __fi;
-            } else {
-               _fi->next = __fi;
-               _fi = _fi->next;
-            }
-            counter++;
+    openIndex(it);
+#ifndef _WIN32
+    /* a mapping of a truncated file raises SIGBUS, see IO_MAP_ENV */
+    if(vsaIoMapFile() == TRUE &&
+       0 == fstat(fileno(it->fp),&_st) && _st.st_size >= ARCHIVE_HEADER_SIZE &&
+       (off_t)(size_t)_st.st_size == _st.st_size)
+    {
+        _map = mmap(NULL,(size_t)_st.st_size,PROT_READ,MAP_PRIVATE,fileno(it->fp),0);
+        if(_map != MAP_FAILED)
+        {
+            /* the mapping stays valid without the descriptor */
+            fclose(it->fp);
+            it->fp     = NULL;
+            it->map    = (SAP_BYTE *)_map;
+            it->maplen = (size_t)_st.st_size;
+            vsaIoAdviseMap(it->map,it->maplen);
+            /* skip the magic and version string */
+            it->inbuf  = it->map + ARCHIVE_HEADER_SIZE;
+            it->inlen  = it->maplen - ARCHIVE_HEADER_SIZE;
+            return it;
         }
-    } while(__fi != NULL);
+    }
+#endif
+    if ((it->block = (SAP_BYTE *)malloc(SAR_BLOCK_MAX)) == NULL) {
+        SarClose(it);
+        return NULL;
+    }
+    vsaIoAdviseOpen(fileno(it->fp),0); /* archive is read sequentially */
+    /* skip the magic and version string */
+    fseek(it->fp, ARCHIVE_HEADER_SIZE ,SEEK_SET );
+    return it;
+}
+
+/**********************************************************************
+ *  SarOpenBuffer()
+ *
+ *  Description:
+ *  Opens the iterator on an archive in memory, the buffer must be
+ *  valid until SarClose.
+ *
+ **********************************************************************/
+struct SARIterator *
+SarOpenBuffer(PByte inbuf, size_t inlen)
+{
+    struct SARIterator *it = NULL;
+
+    if(inbuf == NULL || inlen < ARCHIVE_HEADER_SIZE)
+        return NULL;
+    it = (struct SARIterator *)calloc(1,sizeof(struct SARIterator));
+    if(it == NULL)
+        return NULL;
+    /* skip the magic and version string */
+    it->inbuf = inbuf + ARCHIVE_HEADER_SIZE;
+    it->inlen = inlen - ARCHIVE_HEADER_SIZE;
+    return it;
+}
 
-    /* close the file handle */
-    fclose(fp);
-    FreeInfo(fi);
+/**********************************************************************
+ *  SarOpenEntry()
+ *
+ *  Description:
+ *  Opens the iterator on an archive, which is the current entry of
+ *  outer. The entry is read with SarReadBlock of outer, so only its
+ *  current piece is held, and must stay current until SarClose.
+ *  SarRewindEntry on an entry of the inner archive decompresses the
+ *  outer entry again from its beginning up to this entry.
+ *
+ **********************************************************************/
+struct SARIterator *
+SarOpenEntry(struct SARIterator *outer)
+{
+    struct SARIterator *it = NULL;
 
-    return (size_t)(_outlen);
+    if(outer == NULL || !SarRewindEntry(outer))
+        return NULL;
+    it = (struct SARIterator *)calloc(1,sizeof(struct SARIterator));
+    if(it == NULL)
+        return NULL;
+    it->outer = outer;
+    /* skip the magic and version string */
+    if((it->block = (SAP_BYTE *)malloc(SAR_BLOCK_MAX)) == NULL ||
+       !readOuter(it,NULL,ARCHIVE_HEADER_SIZE)) {
+        SarClose(it);
+        return NULL;
+    }
+    return it;
 }
 
 /**********************************************************************
- *  ExtractEntryFromBuffer()
+ *  SarNextEntry()
  *
  *  Description:
- *  Decompress the data of a certain entry in archive into out buffer
+ *  Returns the header of the next entry or NULL at the end. The entry
+ *  belongs to the iterator and is valid until the next call.
+ *
+ **********************************************************************/
+struct SAREntry *
+SarNextEntry(struct SARIterator *it)
+{
+    long           _pos = 0;
+
+    if(it == NULL || it->eof)
+        return NULL;
+    /* the cached entries need no headers and no walk over the data */
+    if(it->replay)
+        return replayIndex(it);
+    /* data of the current entry was not read */
+    if(it->pending && !walkIterBlocks(it,NULL,NULL))
+        it->eof = TRUE;
+    if(it->index != NULL) {
+        if(it->eof)
+            closeIndex(it,FALSE);
+        else if(it->entry != NULL)
+            recordIndex(it);
+    }
+    FreeInfo(it->entry);
+    it->entry = NULL;
+    if(it->eof)
+        return NULL;
+    _pos = tellIter(it);
+    it->entry = getIterHeader(it,&it->namelen);
+    if(it->entry == NULL) {
+        /* an archive read to the end goes into the cache */
+        if(it->index != NULL)
+            closeIndex(it,(SAP_BOOL)((SAP_ULLONG)_pos == it->index->size));
+        it->eof = TRUE;
+        return NULL;
+    }
+    /* remember the first data block for SarRewindEntry */
+    it->datapos = tellIter(it);
+    it->databuf = it->inbuf;
+    it->datalen = it->inlen;
+    it->done    = 0;
+    it->crc32   = 0;
+    it->pending = TRUE;
+    it->inblock = FALSE;
+    return it->entry;
+}
+
+/**********************************************************************
+ *  SarReadEntry()
+ *
+ *  Description:
+ *  Decompresses the data of the current entry into out buffer.
+ *  Returns the length or 0 if the data is invalid or already read.
  *
  **********************************************************************/
 size_t
-ExtractEntryFromBuffer(PByte inbuf, size_t inlen, Int index, PByte outbuf, size_t outlen)
+SarReadEntry(struct SARIterator *it, PByte outbuf, size_t outlen)
 {
-    int counter = 0;
     size_t _outlen = outlen;
-    SAP_BYTE *ptr = inbuf;
-    size_t _inln = inlen;
 
-    struct SAREntry *fi  = NULL; /* begin of list */
-    struct SAREntry *_fi = NULL; /* current ptr   */
-    struct SAREntry *__fi= NULL; /* tmp. pointer  */
-
-    if(inbuf == NULL || inlen < ARCHIVE_HEADER_SIZE)
-       return 0;
+    if(it == NULL || it->entry == NULL || !it->pending || outbuf == NULL)
+        return 0;
+    if(uigInflateThreads > 1 && outlen >= SAR_INFLATE_MIN) {
+        if(!inflateIterBlocks(it,outbuf,&_outlen)) {
+            it->eof = TRUE;
+            return 0;
+        }
+    } else if(!walkIterBlocks(it,outbuf,&_outlen)) {
+        /* the position in the archive is lost */
+        it->eof = TRUE;
+        return 0;
+    }
+    return _outlen;
+}
 
-    /*
-     *  skip the SAPCAR header information
-     *  which means the magic and version string.
-     */
-    ptr   += ARCHIVE_HEADER_SIZE;
-    _inln -= ARCHIVE_HEADER_SIZE;
+/**********************************************************************
+ *  SarReadBlock()
+ *
+ *  Description:
+ *  Returns the next piece of the current entry. A stored block is
+ *  passed in place, a compressed block is decompressed in pieces of
+ *  at most SAR_WINDOW_SIZE bytes into the window of the iterator, so
+ *  the size in the block header does not decide the memory. Returns
+ *  1 with the piece, 0 at the end of the entry and -1 if the data is
+ *  invalid. The piece is valid until the next call.
+ *
+ **********************************************************************/
+int
+SarReadBlock(struct SARIterator *it, PByte *block, size_t *blocklen)
+{
+    unsigned int   size = 0;
+    SAP_BOOL       compressed = FALSE;
+    SAP_BOOL       last = FALSE;
+    SAP_BYTE      *_data = NULL;
+    size_t         _need = 0;
+    size_t         _rest = 0;
+    SAP_INT        _len = 0;
+    SAP_INT        _read = 0;
+    SAP_INT        _decom = 0;
+    SAP_INT        _option = 0;
+    int            rc = 0;
+
+    if(it == NULL || it->entry == NULL || block == NULL || blocklen == NULL)
+        return -1;
+    (*block)    = NULL;
+    (*blocklen) = 0;
+    if(!it->inblock) {
+        rc = readIterBlock(it,FALSE,it->block,&_data,&size,&compressed,&last);
+        if(rc <= 0) {
+            if(rc < 0)
+                it->eof = TRUE; /* the position in the archive is lost */
+            return rc;
+        }
+        _rest = it->entry->uncompressed_size > it->done ? it->entry->uncompressed_size - it->done : 0;
+        if(!compressed) {
+            /* a stored block is passed in place */
+            _need = size <= _rest ? size : _rest;
+            PartialCRC(&it->crc32,_data,(UInt)_need);
+            it->done += _need;
+            if(last && it->crc32 != (unsigned int)it->entry->checksum)
+                return -1;
+            (*block)    = _data;
+            (*blocklen) = _need;
+            return 1;
+        }
+        if(size < CS_HEAD_SIZE || (_len = CsGetLen(_data)) < 0)
+            return -1;
+        if(it->hdl == NULL && (it->hdl = (CSHDL *)malloc(sizeof(CSHDL))) == NULL)
+            return -1;
+        if(it->window == NULL && (it->window = (SAP_BYTE *)malloc(SAR_WINDOW_SIZE)) == NULL)
+            return -1;
+        it->blockdata = _data;
+        it->blocksize = size;
+        it->blockrest = (size_t)_len <= _rest ? (size_t)_len : _rest;
+        it->blocklast = last;
+        it->inblock   = TRUE;
+        _option = CS_INIT_DECOMPRESS;
+    }
+    _need = it->blockrest < SAR_WINDOW_SIZE ? it->blockrest : SAR_WINDOW_SIZE;
+    if(_need > 0) {
+        rc = CsDecompr(it->hdl,it->blockdata,(SAP_INT)it->blocksize,it->window,(SAP_INT)_need,_option,&_read,&_decom);
+        if(rc < 0 || _read < 0 || (size_t)_read > it->blocksize || _decom < 0 || (size_t)_decom > _need)
+            return -1;
+        it->blockdata += _read;
+        it->blocksize -= (unsigned int)_read;
+        it->blockrest -= (size_t)_decom;
+        PartialCRC(&it->crc32,it->window,(UInt)_decom);
+        it->done += (size_t)_decom;
+    }
+    /* the block ends with its data or with the rest of the entry */
+    if(_need == 0 || it->blockrest == 0 || rc != CS_END_OUTBUFFER) {
+        it->inblock = FALSE;
+        if(it->blocklast && it->crc32 != (unsigned int)it->entry->checksum)
+            return -1;
+    } else if(_decom == 0) {
+        return -1; /* no progress */
+    }
+    (*block)    = it->window;
+    (*blocklen) = (size_t)_decom;
+    return 1;
+}
 
-    /* call the function for the raw content list
-     * as long a no new entry is retrieved.
-     * the function pointer will be increased
-     * automatically
-     */
-    do {
-        if(counter == index) {
-            __fi = getEntryByIndex2(&ptr,&_inln,outbuf,&_outlen);
-            /* first */
-            if(fi == NULL) {
-                fi = __fi;
-               _fi = __fi;
-            } else {
-               _fi->next = __fi;
-               _fi = _fi->next;
-            }
-            break;
-        } else {
-            __fi = getEntryHeader2(&ptr,&_inln);
-            /* first */
-            if(fi == NULL) {
-                fi = __fi;
-               _fi = __fi;
-            } else {
-               _fi->next = __fi;
-               _fi = _fi->next;
-            }
-            counter++;
+/**********************************************************************
+ *  SarRewindEntry()
+ *
+ *  Description:
+ *  Positions the iterator at the first data block of the current
+ *  entry again, so that SarReadBlock starts from the beginning.
+ *
+ **********************************************************************/
+SAP_BOOL
+SarRewindEntry(struct SARIterator *it)
+{
+    if(it == NULL || it->entry == NULL)
+        return FALSE;
+    if(it->outer != NULL) {
+        if(!seekOuter(it,it->datapos)) {
+            it->eof = TRUE;
+            return FALSE;
         }
-    } while(__fi != NULL);
+    } else if(it->fp != NULL) {
+        if(0 != fseek(it->fp,it->datapos,SEEK_SET)) {
+            it->eof = TRUE;
+            return FALSE;
+        }
+    } else {
+        it->inbuf = it->databuf;
+        it->inlen = it->datalen;
+    }
+    it->entry->compressed_size = 0;
+    it->done    = 0;
+    it->crc32   = 0;
+    it->eof     = FALSE;
+    it->pending = TRUE;
+    it->inblock = FALSE;
+    return TRUE;
+}
 
-    FreeInfo(fi);
+/**********************************************************************
+ *  SarMarkEntry()
+ *
+ *  Description:
+ *  Returns the position of the current entry for SarSeekEntry.
+ *
+ **********************************************************************/
+void
+SarMarkEntry(struct SARIterator *it, struct SARMark *mark)
+{
+    if(mark == NULL)
+        return;
+    memset(mark,0,sizeof(struct SARMark));
+    if(it == NULL || it->entry == NULL)
+        return;
+    mark->datapos = it->datapos;
+    mark->databuf = it->databuf;
+    mark->datalen = it->datalen;
+    mark->uncompressed_size = it->entry->uncompressed_size;
+}
+
+/**********************************************************************
+ *  SarSeekEntry()
+ *
+ *  Description:
+ *  Makes the marked entry the current entry of the iterator, which
+ *  must be opened on the same archive. The data is read with
+ *  SarReadBlock or SarReadEntry, the entry has no name.
+ *
+ **********************************************************************/
+SAP_BOOL
+SarSeekEntry(struct SARIterator *it, const struct SARMark *mark)
+{
+    if(it == NULL || mark == NULL)
+        return FALSE;
+    /* the entries are no longer read in order */
+    closeIndex(it,FALSE);
+    FreeInfo(it->entry);
+    it->entry = (struct SAREntry *)calloc(1,sizeof(struct SAREntry));
+    if(it->entry == NULL)
+        return FALSE;
+    it->entry->type = FT_RG;
+    it->entry->uncompressed_size = mark->uncompressed_size;
+    it->datapos = mark->datapos;
+    it->databuf = mark->databuf;
+    it->datalen = mark->datalen;
+    /* a mapped archive is positioned by the offset in the file */
+    if(it->map != NULL && !mapIterData(it,it->datapos)) {
+        it->eof = TRUE;
+        return FALSE;
+    }
+    return SarRewindEntry(it);
+}
 
-    return (size_t)(_outlen);
+/**********************************************************************
+ *  SarClose()
+ *
+ *  Description:
+ *  Closes the iterator.
+ *
+ **********************************************************************/
+void
+SarClose(struct SARIterator *it)
+{
+    if(it == NULL)
+        return;
+    closeIndex(it,FALSE);
+    FreeInfo(it->entry);
+    if(it->fp != NULL)
+        fclose(it->fp);
+#ifndef _WIN32
+    if(it->map != NULL)
+        munmap((void *)it->map,it->maplen);
+#endif
+    if(it->block != NULL)
+        free(it->block);
+    if(it->window != NULL)
+        free(it->window);
+    if(it->hdl != NULL)
+        free(it->hdl);
+    free(it);
 }
 
 /* forward declaration for compiler */
@@ -1256,224 +1788,89 @@ static unsigned char* MakeAbsPath(PChar pPath, PChar tempFolder);
 struct SAREntry *
 ExtractSar(PChar file, PChar tempFolder)
 {
-    FILE *fp    =NULL;
+    struct SARIterator *it = NULL;
 
     struct SAREntry *fi  = NULL; /* begin of list */
     struct SAREntry *_fi = NULL; /* current ptr   */
     struct SAREntry *__fi= NULL; /* tmp. pointer  */
+    struct SAREntry *_entry = NULL;
     unsigned char   _name[MAX_PATH_LN];
-    SAP_BYTE iBuffer[65536];
-    SAP_BYTE oBuffer[65536];
+    PByte           _block = NULL;
+    size_t          _blocklen = 0;
+    int             rc = 0;
 
-    if(file == NULL)
-        return NULL;
-    /* open the archive file */
-    if ((fp = fopen((const char*)file, "rb")) == NULL) {
+    if((it = SarOpenFile(file)) == NULL)
         return NULL;
-    }
-    /*
-     *  skip the SAPCAR header information
-     *  which means the magic and version string.
-     */
-    fseek(fp, ARCHIVE_HEADER_SIZE ,SEEK_SET );
+    /* every entry is decompressed block by block into its file */
+    while((_entry = SarNextEntry(it)) != NULL) {
+        FILE *fpOut = NULL;
 
-    /* call the function for the raw content list
-     * as long a no new entry is retrieved.
-     * the function pointer will be increased
-     * automatically
-     */
-    do {
-        FILE           *fpOut = NULL;
-        BYTEARRAY_2    blocktype;
-        BYTEARRAY_4    blocksize;
-        BYTEARRAY_4    checksum;
-        unsigned short nameLen;
-        unsigned short usrInfoLen;
-        size_t         lRead  = 0;
-        unsigned int   toMove = 0;
-        SAP_ULLONG     sizeLow;
-        unsigned int   sizeHigh;
-        unsigned int   _checksum = 0;
-        SAP_UINT       _crc32    = 0;
-        CSHDL          cshandle;
-        int            openFile = 1;
-
-        struct EntryHeaderBytes   entry;
-
-        /*   This function expects a FILE ptr (fp)
-         *   set to the begin of  the fix EntryHeader.
-         *   Read-in the raw byte information to the
-         *   structure to have access to attributes
-         *   by the EntryHeaderBytes structure
-         */
-        lRead = fread(&entry,sizeof(char),sizeof(struct EntryHeaderBytes),fp);
-        if(lRead != sizeof(struct EntryHeaderBytes)) {
-            __fi = NULL;
+        if(it->namelen >= sizeof(_name))
             break;
-        }
-
-        /* Position of the FILE pointer is now at the
-         * begin of  the dynamic EntryHeader block.
-         */
-        /* convert the entry name length to ushort */
-        BytesToUshort(entry.nameLength, &nameLen);
-        /* allocate and initialize a new SAPCARArchiveData */
-
         __fi = (struct SAREntry *)calloc(1,sizeof(struct SAREntry));
-        if(__fi==NULL) {
+        if(__fi == NULL)
             break;
-        }
-        lRead = fread(_name,sizeof(char),nameLen,fp);
-        if(lRead != nameLen)
-        {
-            free(__fi);
-            __fi = NULL;
-            break;
-        }
-        _name[nameLen] = 0;
+        memcpy(_name,_entry->name,it->namelen);
+        _name[it->namelen] = 0;
         __fi->name = MakeAbsPath(_name,tempFolder);
-
-        /*
-         * map the entry type, same as in doc, see sapcar.h
-         */
-        if(      !memcmp(entry.type, IA_RG, BLOCK_TYPE_SIZE) ) {
-            __fi->type = FT_RG; /* regular file     */
-        } else if (!memcmp(entry.type, IA_DR, BLOCK_TYPE_SIZE)) {
-            __fi->type = FT_DR; /* directory        */
-        } else if(!memcmp(entry.type,  IA_SC, BLOCK_TYPE_SIZE)) {
-            __fi->type = FT_SC; /* windows shortcut */
-        } else if(!memcmp(entry.type,  IA_LK, BLOCK_TYPE_SIZE)) {
-            __fi->type = FT_LK; /* unix softlink    */
-        } else if(!memcmp(entry.type,  IA_SV, BLOCK_TYPE_SIZE)) {
-            __fi->type = FT_SV; /* AS/400 save file */
+        __fi->type = _entry->type;
+        __fi->mode = _entry->mode;
+        __fi->date = _entry->date;
+        __fi->uncompressed_size = _entry->uncompressed_size;
+        while((rc = SarReadBlock(it,&_block,&_blocklen)) > 0) {
+            if(fpOut == NULL && (fpOut = fopen((const char*)__fi->name,"w")) == NULL) {
+                rc = -1;
+                break;
+            }
+            fwrite(_block,1,_blocklen,fpOut);
         }
-
-        /* convert the numeric parameters */
-        BytesToUint( entry.mode, &__fi->mode);
-        BytesToUllong( entry.sizeLow, &sizeLow );
-        BytesToUint( entry.sizeHigh, &sizeHigh );
-        BytesToUshort(entry.userInfoLength, &usrInfoLen);
-
-        /* calculate the uncompressed size
-         * with low and high value
-         * see archive specification for detailed
-         * information about this
-         */
-        __fi->uncompressed_size = (size_t) ( (size_t)(sizeHigh*FOUR_GB) + sizeLow);
-
-        /*
-         * convert date bytes to time_t value
-         * with the rule:
-         */
-        if (sizeof(time_t) == SIZE_FOUR_BYTE){
-            /* 32-Bit environment: size_t is 4 bytes
-             * use a temporary 4 byte value
-             */
-            BYTEARRAY_4 tmp;
-            unsigned int _date = 0;
-            memcpy(tmp, entry.date, sizeof(tmp));
-            BytesToUint(tmp, &_date);
-            __fi->date = _date;
+        if(fpOut != NULL)
+            fclose(fpOut);
+        if(rc < 0) {
+            /* invalid data or checksum */
+            if(fpOut != NULL)
+                vsaunlink((const char*)__fi->name);
+            FreeInfo(__fi);
+            break;
         }
-        else if(sizeof(time_t) == SIZE_EIGHT_BYTE){
-            /* 64-Bit environment: size_t is 8 bytes */
-            BytesToUllong( entry.date, (SAP_ULLONG*)&__fi->date );
+        __fi->compressed_size = _entry->compressed_size;
+        __fi->checksum = _entry->checksum;
+        /* first */
+        if(fi == NULL) {
+            fi = __fi;
+           _fi = __fi;
+        } else {
+           _fi->next = __fi;
+           _fi = _fi->next;
         }
+    }
+    SarClose(it);
+    return fi;
+}
 
-        /*
-         * dont make use of user information
-         * therefore skip these bytes with fseek
-         */
-        fseek(fp,usrInfoLen, SEEK_CUR);
-
-        /* read blocktype */
-        lRead = fread(blocktype,sizeof(char),sizeof(blocktype),fp);
-        /* loop while data block processing */
-        while(IsDataBlock(blocktype)){
-            /* size of the compressed data junk */
-            lRead = fread(blocksize,sizeof(char),sizeof(blocksize),fp);
-            if( lRead != sizeof(blocksize) ) {
-                free(__fi->name);
-                free(__fi);
-                __fi = NULL;
-                break;
-            }
-            /* convert to unsigned integer */
-            BytesToUint(blocksize, &toMove);
-            /* add to junk size to the compressed size.
-             * perform an addition in cases of several junks
-             */
-            __fi->compressed_size += toMove;
-            /*-------------------------------------------------------
-             *
-             * >>> Compressed data block <<<
-             *
-             --------------------------------------------------------*/
-            if(toMove <= sizeof(iBuffer)) {
-                SAP_INT read, decom;
-                lRead = fread(iBuffer,sizeof(char),toMove,fp);
-                if( lRead != toMove ) {
-                    free(__fi->name);
-                    free(__fi);
-                    __fi = NULL;
-                    break;
-                }
-                /*
-                 * tested, output buffer always is limited to 64k, therefore use 64k for in and output
-                 */
-                if(IsCompressedDataBlock(blocktype)) {
-                    CsDecompr(&cshandle,iBuffer,(SAP_INT)lRead,oBuffer,sizeof(oBuffer),CS_INIT_DECOMPRESS,&read,&decom);
-                } else {
-                    read  = lRead;
-                    decom = lRead;
-                    memcpy(oBuffer, iBuffer, lRead);
-                }
+/**********************************************************************
+ *  parseIterEntries()
+ *
+ *  Description:
+ *  Returns the list of all entries of the iterator, with the
+ *  compressed size and the checksum of the data blocks, and closes
+ *  the iterator.
+ *
+ **********************************************************************/
+static struct SAREntry *
+parseIterEntries(struct SARIterator *it)
+{
+    struct SAREntry *fi  = NULL; /* begin of list */
+    struct SAREntry *_fi = NULL; /* current ptr   */
+    struct SAREntry *__fi= NULL; /* tmp. pointer  */
 
-                if(openFile == 1) {
-                    openFile = 0;
-                    fpOut = fopen((const char*)__fi->name,"w");
-                    if(fpOut==NULL) {
-                        free(__fi->name);
-                        free(__fi);
-                        __fi = NULL;
-                        break;
-                    }
-                }
-                PartialCRC(&_crc32,oBuffer,decom);
-                fwrite(oBuffer,1,decom,fpOut);
-            } else {
-                free(__fi->name);
-                free(__fi);
-                __fi = NULL;
-                break;
-            }
-            /* end block */
-            if(IsLastBlock(blocktype)) {
-                /* only the end block contains a checksum field */
-                lRead = fread(checksum,sizeof(char),sizeof(checksum),fp);
-                BytesToUint(checksum, &_checksum);
-                __fi->checksum = (size_t)_checksum;
-                fclose(fpOut);
-                if(_crc32 != _checksum) {
-                    /* Error */
-                    vsaunlink((const char*)__fi->name);
-                    free(__fi->name);
-                    free(__fi);
-                    __fi = NULL;
-                    break;
-                }
-            }
-            /* read further 2 bytes for next loop step */
-            lRead = fread(blocktype,sizeof(char),sizeof(blocktype),fp);
-            if( lRead != sizeof(blocktype) )
-                /* EOF encountered? */
-                break;
-        }
-        /* if IsDataBlock returns false,
-         * step back which means reassign
-         * the file ptr with fseek
-         */
-        fseek(fp, -BLOCK_TYPE_SIZE, SEEK_CUR);
+    if(it == NULL)
+        return NULL;
+    while(SarNextEntry(it) != NULL) {
+        /* the data blocks complete the compressed size and checksum */
+        if(!walkIterBlocks(it,NULL,NULL) ||
+           (__fi = dupInfo(it->entry,it->namelen)) == NULL)
+            break;
         /* first */
         if(fi == NULL) {
             fi = __fi;
@@ -1482,11 +1879,92 @@ ExtractSar(PChar file, PChar tempFolder)
            _fi->next = __fi;
            _fi = _fi->next;
         }
-    } while(__fi != NULL);
-    fclose(fp);
+    }
+    SarClose(it);
     return fi;
 }
 
+/**********************************************************************
+ *  ParseEntriesFromFile()
+ *
+ *  Description:
+ *  Reads a complete SAPCar header and parses it. Returns a list of
+ *  SAPCARArchiveData
+ *
+ **********************************************************************/
+struct SAREntry *
+ParseEntriesFromFile(PChar file)
+{
+    return parseIterEntries(SarOpenFile(file));
+}
+
+/**********************************************************************
+ *  ParseEntriesFromBuffer()
+ *
+ *  Description:
+ *  Reads a complete SAPCar header and parses it. Returns a list of
+ *  SAPCARArchiveData
+ *
+ **********************************************************************/
+struct SAREntry *
+ParseEntriesFromBuffer(PByte inbuf, size_t inlen)
+{
+    return parseIterEntries(SarOpenBuffer(inbuf,inlen));
+}
+
+/**********************************************************************
+ *  extractIterEntry()
+ *
+ *  Description:
+ *  Decompresses the data of the entry with index into out buffer and
+ *  closes the iterator. Returns the length or 0 if there is no such
+ *  entry or the data is invalid.
+ *
+ **********************************************************************/
+static size_t
+extractIterEntry(struct SARIterator *it, Int index, PByte outbuf, size_t outlen)
+{
+    size_t _outlen = 0;
+    Int    counter = 0;
+
+    if(it == NULL)
+        return 0;
+    while(SarNextEntry(it) != NULL) {
+        if(counter++ == index) {
+            _outlen = SarReadEntry(it,outbuf,outlen);
+            break;
+        }
+    }
+    SarClose(it);
+    return _outlen;
+}
+
+/**********************************************************************
+ *  ExtractEntryFromFile()
+ *
+ *  Description:
+ *  Decompress the data of a certain entry in archive into out buffer
+ *
+ **********************************************************************/
+size_t
+ExtractEntryFromFile(PChar file, Int index, PByte outbuf, size_t outlen)
+{
+    return extractIterEntry(SarOpenFile(file),index,outbuf,outlen);
+}
+
+/**********************************************************************
+ *  ExtractEntryFromBuffer()
+ *
+ *  Description:
+ *  Decompress the data of a certain entry in archive into out buffer
+ *
+ **********************************************************************/
+size_t
+ExtractEntryFromBuffer(PByte inbuf, size_t inlen, Int index, PByte outbuf, size_t outlen)
+{
+    return extractIterEntry(SarOpenBuffer(inbuf,inlen),index,outbuf,outlen);
+}
+
 /**********************************************************************
  *  
  *    H E L P E R     F U N C T I O N S
@@ -1708,10 +2186,22 @@ PrintInfo(struct SAREntry *fi, FILE *fp)
  *  CRC32 Calculation()
  *
  *  Description:
- *  Calculates the checksum for SAR entries.
+ *  Calculates the checksum for SAR entries. InitializeTable builds the
+ *  byte table and the slice-by-8 tables and selects the kernel for the
+ *  CPU: PCLMULQDQ folding on x86, the CRC32 instructions on ARMv8 and
+ *  slice-by-8 otherwise. All kernels return the result of the byte
+ *  table, build with -DCS_BENCHMARK for a throughput test. CombineCRC
+ *  joins the checksums of parts decompressed in parallel.
  *
  **********************************************************************/
 unsigned int crc_table[256];
+static unsigned int crc_slice[8][256];
+static SAP_UINT crc_x2n[32];    /* x^(2^n) modulo the polynomial */
+
+static void crcSlice8(SAP_UINT *iCRC, SAP_BYTE *sData, SAP_UINT iDataLength);
+static void (*pCRCKernel)(SAP_UINT *, SAP_BYTE *, SAP_UINT) = crcSlice8;
+static SAP_UINT crcMultModP(SAP_UINT a, SAP_UINT b);
+
 SAP_UINT Reflect(SAP_UINT iReflect, SAP_BYTE cChar)
 {
         unsigned int iValue = 0;
@@ -1729,6 +2219,184 @@ SAP_UINT Reflect(SAP_UINT iReflect, SAP_BYTE cChar)
         return iValue;
 }
 
+/*
+ *  slice-by-8: eight bytes per step, one table per byte position
+ */
+static void crcSlice8(SAP_UINT *iCRC, SAP_BYTE *sData, SAP_UINT iDataLength)
+{
+    SAP_UINT _crc = *iCRC;
+    SAP_UINT _lo, _hi;
+
+    while(iDataLength >= 8)
+    {
+        _lo = _crc ^ ((SAP_UINT)sData[0]       | ((SAP_UINT)sData[1] << 8) |
+                      ((SAP_UINT)sData[2] << 16) | ((SAP_UINT)sData[3] << 24));
+        _hi =         ((SAP_UINT)sData[4]       | ((SAP_UINT)sData[5] << 8) |
+                      ((SAP_UINT)sData[6] << 16) | ((SAP_UINT)sData[7] << 24));
+        _crc = crc_slice[7][_lo & 0xFF]         ^
+               crc_slice[6][(_lo >> 8) & 0xFF]  ^
+               crc_slice[5][(_lo >> 16) & 0xFF] ^
+               crc_slice[4][_lo >> 24]          ^
+               crc_slice[3][_hi & 0xFF]         ^
+               crc_slice[2][(_hi >> 8) & 0xFF]  ^
+               crc_slice[1][(_hi >> 16) & 0xFF] ^
+               crc_slice[0][_hi >> 24];
+        sData += 8;
+        iDataLength -= 8;
+    }
+    while(iDataLength--)
+    {
+        _crc = (_crc >> 8) ^ crc_slice[0][(_crc ^ *sData++) & 0xFF];
+    }
+    *iCRC = _crc;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CRC_PCLMUL
+/*
+ *  carry-less multiplication folding of 64 bytes per step, see Intel
+ *  "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ". The
+ *  constants are those of the reflected polynomial 0xEDB88320.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static void crcPclmul(SAP_UINT *iCRC, SAP_BYTE *sData, SAP_UINT iDataLength)
+{
+    static const unsigned long long k1k2[2] __attribute__((aligned(16))) =
+        { 0x0154442bd4ULL, 0x01c6e41596ULL };
+    static const unsigned long long k3k4[2] __attribute__((aligned(16))) =
+        { 0x01751997d0ULL, 0x00ccaa009eULL };
+    static const unsigned long long k5k0[2] __attribute__((aligned(16))) =
+        { 0x0163cd6124ULL, 0x0000000000ULL };
+    static const unsigned long long poly[2] __attribute__((aligned(16))) =
+        { 0x01db710641ULL, 0x01f7011641ULL };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    SAP_UINT _tail;
+
+    if(iDataLength < 64)
+    {
+        crcSlice8(iCRC, sData, iDataLength);
+        return;
+    }
+    _tail = iDataLength & 15;
+    iDataLength -= _tail;
+
+    x1 = _mm_loadu_si128((const __m128i *)(sData + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(sData + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(sData + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(sData + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)*iCRC));
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    sData += 64;
+    iDataLength -= 64;
+
+    /* fold four blocks of 16 bytes in parallel */
+    while(iDataLength >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i *)(sData + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                           _mm_loadu_si128((const __m128i *)(sData + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                           _mm_loadu_si128((const __m128i *)(sData + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                           _mm_loadu_si128((const __m128i *)(sData + 0x30)));
+        sData += 64;
+        iDataLength -= 64;
+    }
+
+    /* fold the four blocks into one */
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* remaining blocks of 16 bytes */
+    while(iDataLength >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i *)sData);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        sData += 16;
+        iDataLength -= 16;
+    }
+
+    /* 128 to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    *iCRC = (SAP_UINT)_mm_extract_epi32(x1, 1);
+
+    if(_tail)
+        crcSlice8(iCRC, sData, _tail);
+}
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <arm_acle.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#define CRC_ARMV8
+/*
+ *  ARMv8 CRC32X/CRC32B, same polynomial as the byte table
+ */
+__attribute__((target("+crc")))
+static void crcArmv8(SAP_UINT *iCRC, SAP_BYTE *sData, SAP_UINT iDataLength)
+{
+    SAP_UINT _crc = *iCRC;
+    unsigned long long _word;
+
+    while(iDataLength && ((size_t)sData & 7))
+    {
+        _crc = __crc32b(_crc, *sData++);
+        iDataLength--;
+    }
+    while(iDataLength >= 8)
+    {
+        memcpy(&_word, sData, 8);
+        _crc = __crc32d(_crc, _word);
+        sData += 8;
+        iDataLength -= 8;
+    }
+    while(iDataLength--)
+    {
+        _crc = __crc32b(_crc, *sData++);
+    }
+    *iCRC = _crc;
+}
+#endif
+
 void InitializeTable(void)
 {
     int iPos, iCodes;
@@ -1746,9 +2414,93 @@ void InitializeTable(void)
             }
             crc_table[iCodes] = Reflect(crc_table[iCodes], 32);
     }
+    /* table n continues the byte n positions before the end */
+    for(iCodes = 0; iCodes <= 0xFF; iCodes++)
+    {
+            crc_slice[0][iCodes] = crc_table[iCodes];
+    }
+    for(iPos = 1; iPos < 8; iPos++)
+    {
+            for(iCodes = 0; iCodes <= 0xFF; iCodes++)
+            {
+                crc_slice[iPos][iCodes] = (crc_slice[iPos-1][iCodes] >> 8)
+                            ^ crc_table[crc_slice[iPos-1][iCodes] & 0xFF];
+            }
+    }
+
+    /* powers of x for CombineCRC, bit 31 is x^0 */
+    crc_x2n[0] = (SAP_UINT)1 << 30;
+    for(iPos = 1; iPos < 32; iPos++)
+    {
+            crc_x2n[iPos] = crcMultModP(crc_x2n[iPos-1], crc_x2n[iPos-1]);
+    }
+
+    pCRCKernel = crcSlice8;
+#ifdef CRC_PCLMUL
+    if(getenv(CRC_PORTABLE_ENV) == NULL &&
+       __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+        pCRCKernel = crcPclmul;
+#endif
+#ifdef CRC_ARMV8
+    if(getenv(CRC_PORTABLE_ENV) == NULL && (getauxval(AT_HWCAP) & HWCAP_CRC32))
+        pCRCKernel = crcArmv8;
+#endif
 }
 
 void PartialCRC(SAP_UINT *iCRC, SAP_BYTE *sData, SAP_UINT iDataLength)
+{
+    pCRCKernel(iCRC, sData, iDataLength);
+}
+
+/*
+ *  checksum of two concatenated parts from the checksums of the parts:
+ *  the first one is continued with lLength2 zero bytes, that is
+ *  multiplied by x^(8*lLength2) modulo the polynomial, as
+ *  crc32_combine of zlib
+ */
+static SAP_UINT crcMultModP(SAP_UINT a, SAP_UINT b)
+{
+    SAP_UINT m = (SAP_UINT)1 << 31;
+    SAP_UINT p = 0;
+
+    for(;;)
+    {
+        if(a & m)
+        {
+            p ^= b;
+            if((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ 0xEDB88320u : b >> 1;
+    }
+    return p;
+}
+
+SAP_UINT CombineCRC(SAP_UINT iCRC1, SAP_UINT iCRC2, size_t lLength2)
+{
+    SAP_UINT p = (SAP_UINT)1 << 31;     /* x^0 */
+    int      k = 3;                     /* x^(2^3) for one byte */
+
+    while(lLength2)
+    {
+        if(lLength2 & 1)
+            p = crcMultModP(crc_x2n[k & 31], p);
+        lLength2 >>= 1;
+        k++;
+    }
+    return crcMultModP(p, iCRC1) ^ iCRC2;
+}
+
+#ifdef CS_BENCHMARK
+/*
+ *  throughput of the CRC kernels and of the decompression of the SAR
+ *  archives given as arguments:
+ *  cc -O2 -DCS_BENCHMARK -I../include -I. csdecompr.c vsmime.c -ldl
+ */
+#include <time.h>
+
+static void crcBytewise(SAP_UINT *iCRC, SAP_BYTE *sData, SAP_UINT iDataLength)
 {
     while(iDataLength--)
     {
@@ -1756,6 +2508,114 @@ void PartialCRC(SAP_UINT *iCRC, SAP_BYTE *sData, SAP_UINT iDataLength)
     }
 }
 
+static void crcMeasure(const char *name,
+                       void (*kernel)(SAP_UINT *, SAP_BYTE *, SAP_UINT),
+                       SAP_BYTE *data, SAP_UINT len, SAP_UINT expect)
+{
+    SAP_UINT _crc = 0, _off;
+    int      _loop, _loops = 64;
+    clock_t  _start;
+    double   _sec;
+
+    /* all lengths and alignments of the first bytes */
+    for(_off = 0; _off < 256; _off++)
+    {
+        SAP_UINT _a = 0, _b = 0;
+        crcBytewise(&_a, data + _off, 1000 - _off);
+        kernel(&_b, data + _off, 1000 - _off);
+        if(_a != _b)
+        {
+            printf("%-10s wrong checksum at offset %u\n", name, _off);
+            return;
+        }
+    }
+    kernel(&_crc, data, len);
+    if(_crc != expect)
+    {
+        printf("%-10s wrong checksum %08x, expected %08x\n", name, _crc, expect);
+        return;
+    }
+    _start = clock();
+    for(_loop = 0; _loop < _loops; _loop++)
+        kernel(&_crc, data, len);
+    _sec = (double)(clock() - _start) / CLOCKS_PER_SEC;
+    printf("%-10s %10.1f MB/s\n", name,
+           _sec > 0 ? (double)len * _loops / _sec / (1024 * 1024) : 0.0);
+}
+
+static void sarMeasure(const char *archive)
+{
+    struct SARIterator *_it;
+    struct SAREntry    *_entry;
+    PByte               _block;
+    size_t              _blocklen, _total = 0;
+    int                 _loops = 0, _rc = 0;
+    clock_t             _start;
+    double              _sec;
+
+    _start = clock();
+    do
+    {
+        _it = SarOpenFile((PChar)archive);
+        if(_it == NULL)
+        {
+            printf("%s: not a SAR archive\n", archive);
+            return;
+        }
+        _total = 0;
+        while((_entry = SarNextEntry(_it)) != NULL)
+        {
+            while((_rc = SarReadBlock(_it, &_block, &_blocklen)) > 0)
+                _total += _blocklen;
+            if(_rc < 0)
+                break;
+        }
+        SarClose(_it);
+        _loops++;
+        _sec = (double)(clock() - _start) / CLOCKS_PER_SEC;
+    } while(_rc >= 0 && _sec < 1.0);
+    if(_rc < 0)
+    {
+        printf("%s: extraction failed\n", archive);
+        return;
+    }
+    printf("%-10s %10.1f MB/s %s\n", "extract",
+           _sec > 0 ? (double)_total * _loops / _sec / (1024 * 1024) : 0.0,
+           archive);
+}
+
+int main(int argc, char **argv)
+{
+    SAP_UINT  _len = 16 * 1024 * 1024, _i, _expect = 0;
+    SAP_BYTE *_data = (SAP_BYTE *)malloc(_len);
+
+    if(_data == NULL)
+        return 1;
+    for(_i = 0; _i < _len; _i++)
+        _data[_i] = (SAP_BYTE)(_i * 2654435761u >> 13);
+    InitializeTable();
+    vsaSetIoMap((PChar)getenv(IO_MAP_ENV));
+    crcBytewise(&_expect, _data, _len);
+
+    crcMeasure("bytewise", crcBytewise, _data, _len, _expect);
+    crcMeasure("slice-by-8", crcSlice8, _data, _len, _expect);
+#ifdef CRC_PCLMUL
+    if(__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+        crcMeasure("pclmul", crcPclmul, _data, _len, _expect);
+#endif
+#ifdef CRC_ARMV8
+    if(getauxval(AT_HWCAP) & HWCAP_CRC32)
+        crcMeasure("armv8", crcArmv8, _data, _len, _expect);
+#endif
+    crcMeasure("selected", pCRCKernel, _data, _len, _expect);
+    free(_data);
+
+    for(_i = 1; _i < (SAP_UINT)argc; _i++)
+        sarMeasure(argv[_i]);
+    return 0;
+}
+#endif
+
 int CsExtraLenBits[LENGTH_CODES+2] /* extra bits for each length code */
    = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0,99,99};
 static int *cplext = &CsExtraLenBits[0];
@@ -2059,6 +2919,138 @@ int FlushOut (CSHU *cshu, unsigned w)          /* number of bytes to flush */
   return 0;
 }
 
+static int DecompCodesFast ( CSHU *cshu,
+              unsigned *wp,       /* current window position .........*/
+              HUFTREE  *tl,       /* literal/length decoder tables */
+              HUFTREE  *td,       /* distance decoder tables */
+              unsigned  ml,       /* mask for the bits of tl[] */
+              unsigned  md)       /* mask for the bits of td[] */
+/*--------------------------------------------------------------------*/
+/* Inflate codes as DecompCodes, but with a local 64 bit buffer that  */
+/* is refilled once per code without the checks of NEEDBITS. Runs as */
+/* long as FAST_IN_MIN input bytes are left and a match cannot reach  */
+/* the end of the window, so that no state has to be saved. Unused    */
+/* whole bytes of the buffer are returned to the input at the end.   */
+/* Returns 0 to continue with DecompCodes, EOBCODE at the end of the  */
+/* block or an error code. ...........................................*/
+/*--------------------------------------------------------------------*/
+{
+  SAP_ULLONG hold;       /* bit buffer ...............................*/
+  unsigned   bits;       /* bits in bit buffer .......................*/
+  SAP_BYTE  *in;         /* next input byte ..........................*/
+  SAP_BYTE  *in_start;   /* first input byte of this run .............*/
+  SAP_BYTE  *in_last;    /* last position for a refill ...............*/
+  HUFTREE   *h;          /* current table entry ......................*/
+  unsigned   e;          /* table entry flag/number of extra bits ....*/
+  unsigned   n, d;       /* length and index for copy ................*/
+  unsigned   w;          /* current window position ..................*/
+  int        rc = 0;
+
+  hold     = (SAP_ULLONG)cshu->bb;
+  bits     = cshu->bk;
+  w        = *wp;
+  in_start = in = cshu->MemInbuffer + cshu->MemInoffset;
+  in_last  = cshu->MemInbuffer + cshu->MemInsize - FAST_IN_MIN;
+
+  while (in <= in_last && w < WSIZE - FAST_OUT_MIN)
+  {
+    /* a length and a distance code take at most 48 bits ............*/
+    while (bits <= 56)
+    {
+      hold |= (SAP_ULLONG)(*in++) << bits;
+      bits += 8;
+    }
+
+    h = tl + ((unsigned)hold & ml);
+    while ((e = h->e) > LITCODE)
+    {
+      if (e == INVALIDCODE)
+      {
+        rc = CS_E_INVALIDCODE;
+        goto done;
+      }
+      hold >>= h->b;
+      bits  -= h->b;
+      e     -= LITCODE;
+      h = h->v.t + ((unsigned)hold & mask_bits[e]);
+    }
+    hold >>= h->b;
+    bits  -= h->b;
+
+    if (e == LITCODE)           /* then it's a literal ...............*/
+    {
+      cshu->Slide[w++] = (unsigned char)h->v.n;
+      continue;
+    }
+    if (e == EOBCODE)           /* end of block ......................*/
+    {
+      rc = EOBCODE;
+      break;
+    }
+
+    /* get length of block to copy ...................................*/
+    n = h->v.n + ((unsigned)hold & mask_bits[e]);
+    hold >>= e;
+    bits  -= e;
+
+    /* decode distance of block to copy ..............................*/
+    h = td + ((unsigned)hold & md);
+    while ((e = h->e) > LITCODE)
+    {
+      if (e == INVALIDCODE)
+      {
+        rc = CS_E_INVALIDCODE;
+        goto done;
+      }
+      hold >>= h->b;
+      bits  -= h->b;
+      e     -= LITCODE;
+      h = h->v.t + ((unsigned)hold & mask_bits[e]);
+    }
+    hold >>= h->b;
+    bits  -= h->b;
+
+    d = w - h->v.n - ((unsigned)hold & mask_bits[e]);
+    hold >>= e;
+    bits  -= e;
+
+    /* do the copy, the window end is not reached ....................*/
+    do
+    {
+      n -= (e = (e = WSIZE - ((d &= WSIZE-1) > w ? d : w)) > n ? n : e);
+
+      if (w - d >= e)      /* (this test assumes unsigned comparison) */
+      {
+        memcpy (cshu->Slide + w, cshu->Slide + d, e);
+        w += e;
+        d += e;
+      }
+      else                  /* do it slow to avoid memcpy() overlap ..*/
+      {
+        do
+        {
+          cshu->Slide[w++] = cshu->Slide[d++];
+        } while (--e);
+      }
+    } while (n);
+  }
+
+done:
+  /* give back the whole bytes, which are not used ...................*/
+  n = bits >> 3;
+  if (n > (unsigned)(in - in_start))
+    n = (unsigned)(in - in_start);
+  in   -= n;
+  bits -= n << 3;
+
+  cshu->bb          = (SAP_UINT)(hold & (((SAP_ULLONG)1 << bits) - 1));
+  cshu->bk          = bits;
+  cshu->MemInoffset = (unsigned)(in - cshu->MemInbuffer);
+  *wp = w;
+
+  return rc;
+}
+
 int DecompCodes ( CSHU *cshu,
               int     *state,     /* state of last run ...............*/
               HUFTREE *tl,        /* literal/length decoder tables */
@@ -2133,6 +3125,15 @@ int DecompCodes ( CSHU *cshu,
 
   for (;;)
   {
+    /* most codes are decoded by the fast loop .......................*/
+    if (cshu->MemInsize - cshu->MemInoffset >= FAST_IN_MIN &&
+        w < WSIZE - FAST_OUT_MIN)
+    {
+      rc = DecompCodesFast (cshu, &w, tl, td, ml, md);
+      if (rc == EOBCODE) break;
+      if (rc) return rc;
+    }
+
     NEEDBITS((unsigned)bl)
     if (bitcount == 0)
     {
@@ -2828,6 +3829,22 @@ CODE_INT GetCode (struct CSC *csc)
   return code;
 }
 
+/* Next code of the input: the codes of the current group are taken
+   directly from buf1, GetCode reads the next group or the rest of the
+   input buffer and handles the code size changes ...................*/
+#define GETCODE(code)                                                   \
+  if (csc->get_r_bits <= 0 && csc->clear_flg <= 0 &&                    \
+      csc->csc_offset < csc->get_size && csc->free_ent <= csc->maxcode) \
+  {                                                                     \
+    bp   = csc->buf1 + (csc->csc_offset >> 3);                          \
+    code = (CODE_INT) ((((SAP_UINT) bp[0]) |                            \
+                        ((SAP_UINT) bp[1] << 8) |                       \
+                        ((SAP_UINT) bp[2] << 16)) >> (csc->csc_offset & 7)) \
+           & MAXCODE (csc->n_bits);                                     \
+    csc->csc_offset += csc->n_bits;                                     \
+  }                                                                     \
+  else code = GetCode (csc);
+
 int CsDecomprLZC (CSC      * csc,
                   SAP_BYTE * inbuf,
                   SAP_INT    inlen,
@@ -2882,6 +3899,10 @@ int CsDecomprLZC (CSC      * csc,
   register BYTE_TYP *stackp;
   register CODE_INT code, oldcode, incode, finchar;
   register SAP_INT rest_lenr;
+  BYTE_TYP *bp;                          /* current group of codes ...*/
+  BYTE_TYP *sp;                          /* string in output buffer ..*/
+  CODE_INT  strcode;                     /* code of the string .......*/
+  SAP_INT   strlen_;                     /* length of the string .....*/
 
 /*
   static BYTE_TYP *sstackp = (BYTE_TYP *) 0;
@@ -2947,7 +3968,9 @@ int CsDecomprLZC (CSC      * csc,
     {
       TAB_PREFIXOF(code) = 0;
       TAB_SUFFIXOF(code) = (BYTE_TYP) code;
+      TAB_LENOF(code)    = 1;
     }
+    TAB_LENOF(CLEAR) = 0;
 
     csc->free_ent = ((csc->block_compress) ? FIRST : 256);   /* first entry ....*/
 
@@ -3015,7 +4038,7 @@ int CsDecomprLZC (CSC      * csc,
 
   for (;;)                            /* until not end of inbuf ......*/
   {
-    code = GetCode (csc);
+    GETCODE(code)
     if (code < 0) break;
 
     if ((code == CLEAR) && csc->block_compress)
@@ -3031,59 +4054,97 @@ int CsDecomprLZC (CSC      * csc,
 
     incode = code;
 
-    /* Special case for ababa string .................................*/
-    if (code >= csc->free_ent)
+    /* length of the string, 0 if it must go over the stack ..........*/
+    if (code < csc->free_ent)
     {
-      *stackp++ = (BYTE_TYP) finchar;
-      OVERFLOW_CHECK
-      code = oldcode;
+      strcode = code;
+      strlen_ = TAB_LENOF(code);
     }
-
-    /* Generate output characters in reverse order ...................*/
-    while (code >= 256)
+    else if (code == csc->free_ent && oldcode < code &&
+             TAB_LENOF(oldcode) != 0)
     {
-      /* Check for end of stack */
-      if (stackp >= (DE_STACK + DE_STACK_OFFSET)){
-          return (CS_E_STACK_OVERFLOW);
-      }
-      *stackp++ = TAB_SUFFIXOF(code);
-      OVERFLOW_CHECK
-      code = TAB_PREFIXOF(code);
+      strcode = oldcode;             /* ababa string .................*/
+      strlen_ = TAB_LENOF(oldcode) + 1;
     }
+    else
+      strlen_ = 0;
 
-    finchar = TAB_SUFFIXOF(code);
-    *stackp++ = (BYTE_TYP) finchar;
-    OVERFLOW_CHECK
-
-contin:
-    /* and put them out in forward order .............................*/
-    for (;;)
+    if (strlen_ != 0 && strlen_ < rest_lenr &&
+        strlen_ <= (SAP_INT) (csc->end_outbuf - csc->outptr))
     {
-      if (csc->outptr >= csc->end_outbuf)        /* End of outbuffer ...........*/
+      /* the string fits: write it from its end to the output ........*/
+      sp = csc->outptr + strlen_ - 1;
+      if (strcode != code)
+        *sp-- = (BYTE_TYP) finchar;
+      while (strcode >= 256)
       {
-        csc->scode    = code;
-        csc->sincode  = incode;
-        csc->restart  = 1;
-        code     = CS_END_OUTBUFFER;
-        goto ende;
+        *sp-- = TAB_SUFFIXOF(strcode);
+        strcode = TAB_PREFIXOF(strcode);
       }
+      finchar = TAB_SUFFIXOF(strcode);
+      *sp = (BYTE_TYP) finchar;
 
-      *csc->outptr++ = *--stackp;
+      csc->outptr += strlen_;
+      rest_lenr   -= strlen_;
+    }
+    else
+    {
+      /* Special case for ababa string ...............................*/
+      if (code >= csc->free_ent)
+      {
+        *stackp++ = (BYTE_TYP) finchar;
+        OVERFLOW_CHECK
+        code = oldcode;
+      }
 
-      if (--rest_lenr <= 0)            /* End of Stream ..............*/
+      /* Generate output characters in reverse order .................*/
+      while (code >= 256)
       {
-        code = CS_END_OF_STREAM;
-        goto ende;
+        /* Check for end of stack, one byte is left for finchar */
+        if (stackp >= csc->Suffixtab + sizeof (csc->Suffixtab) - 1){
+            return (CS_E_STACK_OVERFLOW);
+        }
+        *stackp++ = TAB_SUFFIXOF(code);
+        OVERFLOW_CHECK
+        code = TAB_PREFIXOF(code);
       }
 
-      if (stackp == DE_STACK) break;   /* End of Stack ...............*/
-    }  /* end for (;;) ...............................................*/
+      finchar = TAB_SUFFIXOF(code);
+      *stackp++ = (BYTE_TYP) finchar;
+      OVERFLOW_CHECK
+
+contin:
+      /* and put them out in forward order ...........................*/
+      for (;;)
+      {
+        if (csc->outptr >= csc->end_outbuf)      /* End of outbuffer .........*/
+        {
+          csc->scode    = code;
+          csc->sincode  = incode;
+          csc->restart  = 1;
+          code     = CS_END_OUTBUFFER;
+          goto ende;
+        }
+
+        *csc->outptr++ = *--stackp;
+
+        if (--rest_lenr <= 0)          /* End of Stream ............*/
+        {
+          code = CS_END_OF_STREAM;
+          goto ende;
+        }
+
+        if (stackp == DE_STACK) break; /* End of Stack .............*/
+      }  /* end for (;;) .............................................*/
+    }
 
     /* Generate the new entry ........................................*/
     if ((code = csc->free_ent) < csc->maxmaxcode)
     {
       TAB_PREFIXOF(code) = (CODE_ENTRY)oldcode;
       TAB_SUFFIXOF(code) = (BYTE_TYP) finchar;
+      TAB_LENOF(code)    = (CODE_ENTRY) ((oldcode < code && TAB_LENOF(oldcode) != 0) ?
+                                         TAB_LENOF(oldcode) + 1 : 0);
       csc->free_ent = code + 1;
     }
 
@@ -3157,9 +4218,11 @@ int CsDecompr (CSHDL    * hdl,           /* handle           */
   if (option & CS_INIT_DECOMPRESS)
   {
     if (inlen < CS_HEAD_SIZE) return CS_E_IN_BUFFER_LEN;
+    hdl->algorithm = CsGetAlgorithm (inbuf);
   }
 
-  switch (CsGetAlgorithm (inbuf))
+  /* a further call continues the stream after bytes_read */
+  switch (hdl->algorithm)
   {
     case CS_ALGORITHM_LZC:
       return CsDecomprLZC (&hdl->handle.csc, inbuf, inlen, outbuf, outlen,
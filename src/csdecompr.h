@@ -65,6 +65,7 @@
 # define vsaunlink              _unlink
 #else
 # include <unistd.h>
+# include <pthread.h>
 # define DIRSLASH               '/'
 # define DIRSLASH_STR           "/"
 # define vsamkdir( mydir )      mkdir( (mydir) , 0744 )
@@ -72,6 +73,58 @@
 # define vsaunlink              unlink
 #endif
 
+/*--------------------------------------------------------------------*/
+/* Locks, threads and published pointers of the adapters and the SAR  */
+/* decompression                                                      */
+/*--------------------------------------------------------------------*/
+#ifdef _WIN32
+typedef CRITICAL_SECTION        VSA_MUTEX;
+#define VSA_MUTEX_INIT(m)       InitializeCriticalSection(m)
+#define VSA_MUTEX_FREE(m)       DeleteCriticalSection(m)
+#define VSA_LOCK(m)             EnterCriticalSection(m)
+#define VSA_UNLOCK(m)           LeaveCriticalSection(m)
+typedef CONDITION_VARIABLE      VSA_COND;
+#define VSA_COND_INIT(c)        InitializeConditionVariable(c)
+#define VSA_COND_FREE(c)
+#define VSA_COND_SIGNAL(c)      WakeAllConditionVariable(c)
+#define VSA_COND_WAIT(c,m)      SleepConditionVariableCS(c,m,INFINITE)
+typedef HANDLE                  VSA_THREAD;
+typedef DWORD                   VSA_THREAD_RC;
+#define VSA_THREAD_API          WINAPI
+#define VSA_THREAD_CREATE(t,f,a) ((*(t) = CreateThread(NULL,0,f,a,0,NULL)) != NULL)
+#define VSA_THREAD_JOIN(t)      { WaitForSingleObject(t,INFINITE); CloseHandle(t); }
+#define VSA_LOAD_PTR(p)         InterlockedCompareExchangePointer((PVOID volatile *)(p),NULL,NULL)
+#define VSA_STORE_PTR(p,v)      InterlockedExchangePointer((PVOID volatile *)(p),(PVOID)(v))
+#else
+typedef pthread_mutex_t         VSA_MUTEX;
+#define VSA_MUTEX_INIT(m)       pthread_mutex_init(m,NULL)
+#define VSA_MUTEX_FREE(m)       pthread_mutex_destroy(m)
+#define VSA_LOCK(m)             pthread_mutex_lock(m)
+#define VSA_UNLOCK(m)           pthread_mutex_unlock(m)
+typedef pthread_cond_t          VSA_COND;
+#define VSA_COND_INIT(c)        pthread_cond_init(c,NULL)
+#define VSA_COND_FREE(c)        pthread_cond_destroy(c)
+#define VSA_COND_SIGNAL(c)      pthread_cond_broadcast(c)
+#define VSA_COND_WAIT(c,m)      pthread_cond_wait(c,m)
+typedef pthread_t               VSA_THREAD;
+typedef void *                  VSA_THREAD_RC;
+#define VSA_THREAD_API
+#define VSA_THREAD_CREATE(t,f,a) (pthread_create(t,NULL,f,a) == 0)
+#define VSA_THREAD_JOIN(t)      pthread_join(t,NULL)
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define VSA_LOAD_PTR(p)         __atomic_load_n(p,__ATOMIC_ACQUIRE)
+#define VSA_STORE_PTR(p,v)      __atomic_store_n(p,v,__ATOMIC_RELEASE)
+#else
+/* compilers without the GCC atomic builtins, such as aCC, xlc or Sun cc */
+#define VSA_ATOMIC_LOCK
+#define VSA_LOAD_PTR(p)         CsLoadPtr((void **)(p))
+#define VSA_STORE_PTR(p,v)      CsStorePtr((void **)(p),(void *)(v))
+void *CsLoadPtr(void **p);
+void  CsStorePtr(void **p, void *v);
+#endif
+#endif
+typedef VSA_THREAD_RC (VSA_THREAD_API VSA_THREAD_FUNC)(void *);
+
 /*--------------------------------------------------------------------*/
 /* Flags for CsCompr and CsDecompr                                    */
 /*--------------------------------------------------------------------*/
@@ -262,6 +315,129 @@ struct SAREntry
   size_t checksum;
 };
 
+/* cached entries of an archive file, see SarSetIndexCache */
+struct SARIndex;
+
+/*
+ *  Iterator over the entries of an archive file, a buffer or of an
+ *  archive inside the entry of another iterator.
+ *  Every header and data block is read exactly once: SarNextEntry
+ *  returns the header of the next entry, SarReadEntry decompresses
+ *  the data of this entry. Data which is not read is skipped by the
+ *  next call of SarNextEntry.
+ *  SarReadBlock decompresses the data block by block into the window
+ *  of the iterator instead, SarRewindEntry starts the entry again.
+ */
+struct SARIterator
+{
+  /* archive file read with stdio, NULL for a buffer */
+  FILE *fp;
+
+  /* mapping of an archive file, which is parsed as a buffer */
+  SAP_BYTE *map;
+  size_t maplen;
+
+  /* current position and rest of the buffer */
+  SAP_BYTE *inbuf;
+  size_t inlen;
+
+  /* archive inside the current entry of outer, which is read with
+   * SarReadBlock, see SarOpenEntry. outerdata and outerlen are the
+   * rest of the piece at outerpiece, outerpos the position in the entry
+   */
+  struct SARIterator *outer;
+  SAP_BYTE *outerpiece;
+  SAP_BYTE *outerdata;
+  size_t outerlen;
+  long outerpos;
+
+  /* header of the current entry and the length of its name field */
+  struct SAREntry *entry;
+  unsigned short namelen;
+
+  /* the data blocks of the current entry are not consumed yet */
+  SAP_BOOL pending;
+
+  /* first data block of the current entry, see SarRewindEntry */
+  long datapos;
+  SAP_BYTE *databuf;
+  size_t datalen;
+
+  /* compressed block read from the file */
+  SAP_BYTE *block;
+
+  /* SarReadBlock decompresses a block in pieces of SAR_WINDOW_SIZE
+   * into window, hdl keeps the state of the block between the pieces
+   */
+  SAP_BYTE *window;
+  struct CSHDL *hdl;
+  SAP_BYTE *blockdata;
+  unsigned int blocksize;
+  size_t blockrest;
+  SAP_BOOL blocklast;
+  SAP_BOOL inblock;
+
+  /* bytes and checksum of the data decompressed so far */
+  size_t done;
+  unsigned int crc32;
+
+  /* end of archive or invalid structure, no further entry */
+  SAP_BOOL eof;
+
+  /* entries of the archive file from the index cache, or the index
+   * which is recorded for the cache, see SarSetIndexCache
+   */
+  struct SARIndex *index;
+  size_t indexpos;
+  SAP_BOOL replay;
+};
+
+/*
+ *  Position of an entry, which another iterator on the same archive
+ *  reads again, see SarMarkEntry and SarSeekEntry.
+ */
+struct SARMark
+{
+  /* first data block in the file or the buffer */
+  long datapos;
+  SAP_BYTE *databuf;
+  size_t datalen;
+
+  /* uncompressed size of the entry */
+  size_t uncompressed_size;
+};
+
+/* maximum size of a compressed data block */
+#define SAR_BLOCK_MAX          65536
+
+/* size of the pieces of SarReadBlock */
+#define SAR_WINDOW_SIZE        ((size_t)256*1024)
+
+/* entries with a larger uncompressed size are not extracted, the
+ * environment CLAMSAP_SAR_ENTRY_MAX overrides the default
+ */
+#define SAR_ENTRY_MAX_ENV      "CLAMSAP_SAR_ENTRY_MAX"
+#define SAR_ENTRY_MAX_DEFAULT  ((size_t)1024*1024*1024)
+
+/* with CLAMSAP_SAR_INFLATE_THREADS=<n> SarReadEntry decompresses the
+ * blocks of entries from SAR_INFLATE_MIN bytes with n threads, every
+ * thread gets SAR_INFLATE_BATCH blocks per batch
+ */
+#define SAR_INFLATE_THREADS_ENV "CLAMSAP_SAR_INFLATE_THREADS"
+#define SAR_INFLATE_THREADS_MAX 64
+#define SAR_INFLATE_MIN         ((size_t)1024*1024)
+#define SAR_INFLATE_BATCH       4
+
+/* with CLAMSAP_SAR_INDEX_CACHE=<n> the entries of the last n archive
+ * files read to the end are kept, an iterator on the same unchanged
+ * file (device, inode, size, mtime and ctime in nanoseconds)
+ * continues at the data of the next entry without reading headers or
+ * unread data blocks
+ */
+#define SAR_INDEX_CACHE_ENV     "CLAMSAP_SAR_INDEX_CACHE"
+#define SAR_INDEX_CACHE_MAX     256
+#define SAR_INDEX_ENTRIES_MAX   65536
+
 #define REGISTER register
 /* The minimum and maximum match lengths .............................*/
 #define MIN_MATCH  3
@@ -442,6 +618,13 @@ typedef unsigned short  CODE_ENTRY;
 #define TAB_PREFIXOF(i) csc->Prefixtab[i]
 #define TAB_SUFFIXOF(i) csc->Suffixtab[i]
 
+/*
+ * CsDecomprLZC keeps the string length of every code in the codetab,
+ * which is not used by the decompression. A length of 0 marks a code,
+ * whose string must be built on the output stack.
+ */
+#define TAB_LENOF(i)    csc->codetab[i]
+
 /* following definition gives a compiler warning on HP 64 bit (2001-05-15)
    Maybe this will work again some time later.
 
@@ -495,6 +678,12 @@ extern CODE_INT DE_STACK_OFFSET;
 #define LBITS 9
 #define DBITS 6
 
+/* DecompCodesFast runs while a 64 bit refill (8 bytes) is in the input
+ * and the longest match (258 bytes) fits into the window
+ */
+#define FAST_IN_MIN   8
+#define FAST_OUT_MIN  258
+
 /* If BMAX needs to be larger than 16, then h and x[] should be ULONG */
 #define BMAX 16    /* maximum bit length of any code (16 for explode) */
 #define N_MAX 288  /* maximum number of codes in any set .............*/
@@ -659,6 +848,7 @@ typedef struct CSHDL
 	   CSC csc;
 	   CSHU cshu;
    } handle;
+   SAP_INT algorithm;   /* of the stream, from the CS_INIT_DECOMPRESS call */
 
 } CSHDL;
 
@@ -671,10 +861,16 @@ int CsDecompr (CSHDL    * hdl,           /* handle           */
                SAP_INT *  bytes_read,    /* bytes read ......*/
                SAP_INT *  bytes_decompressed); /* bytes decompr.  */
 
+SAP_INT CsGetLen (SAP_BYTE * data);
+
 /*
- * CRC32 for checksum
+ * CRC32 for checksum, CLAMSAP_CRC_PORTABLE=1 disables the CPU
+ * specific kernels
  */
+#define CRC_PORTABLE_ENV       "CLAMSAP_CRC_PORTABLE"
+
 void PartialCRC(UInt *iCRC, PByte sData, UInt iDataLength);
+UInt CombineCRC(UInt iCRC1, UInt iCRC2, size_t lLength2);
 void InitializeTable(void);
 SAP_UINT Reflect(UInt iReflect, Byte cChar);
 
@@ -695,6 +891,35 @@ size_t ExtractEntryFromBuffer(PByte inbuf, size_t inlen, Int index, PByte outbuf
 
 void FreeInfo(struct SAREntry *fi);
 
+/*
+ * Single pass iterator, see struct SARIterator
+ */
+struct SARIterator *SarOpenFile(PChar file);
+
+struct SARIterator *SarOpenBuffer(PByte inbuf, size_t inlen);
+
+struct SARIterator *SarOpenEntry(struct SARIterator *outer);
+
+struct SAREntry *SarNextEntry(struct SARIterator *it);
+
+size_t SarReadEntry(struct SARIterator *it, PByte outbuf, size_t outlen);
+
+void SarSetInflateThreads(unsigned int threads);
+
+void SarSetIndexCache(unsigned int archives);
+
+void SarFreeIndexCache(void);
+
+int SarReadBlock(struct SARIterator *it, PByte *block, size_t *blocklen);
+
+SAP_BOOL SarRewindEntry(struct SARIterator *it);
+
+void SarMarkEntry(struct SARIterator *it, struct SARMark *mark);
+
+SAP_BOOL SarSeekEntry(struct SARIterator *it, const struct SARMark *mark);
+
+void SarClose(struct SARIterator *it);
+
 #endif   /* CSDECOMPR_H */
 
 
@@ -77,6 +77,58 @@
 /*      freeVSA_INIT                                                  */
 /*      freeVSA_CONFIG                                                */
 /*      getFileSize                                                   */
+/*      vsaCompileEngine                                              */
+/*      vsaFindEngine                                                 */
+/*      vsaLookupEngine                                               */
+/*      vsaRegisterEngine                                             */
+/*      vsaReleaseEngine                                              */
+/*      vsaAcquireGeneration                                          */
+/*      vsaSelectVariant                                              */
+/*      vsaVariantThread                                              */
+/*      vsaCompileVariants                                            */
+/*      vsaReleaseGeneration                                          */
+/*      vsaCheckReload                                                */
+/*      vsaReloadThread                                               */
+/*      vsaStartThread                                                */
+/*      vsaRefreshDriverInfo                                          */
+/*      vsaUnlinkEngine                                               */
+/*      vsaLoadThread                                                 */
+/*      vsaWaitEngineReady                                            */
+/*      vsaWaitGeneration                                             */
+/*      vsaSetTimingText                                              */
+/*      vsaGetMillis                                                  */
+/*      vsaSetLoadProfile                                             */
+/*      vsaEqualString                                                */
+/*      vsaGetResidentKB                                              */
+/*      vsaGetUniqueKB                                                */
+/*      vsaPreloadEngine                                              */
+/*      vsaForkPrepare                                                */
+/*      vsaForkParent                                                 */
+/*      vsaForkChild                                                  */
+/*      vsaWarmupEngine                                               */
+/*      vsaScanMemory                                                 */
+/*      vsaOpenClientIO                                               */
+/*      vsaReadClientIO                                               */
+/*      vsaCloseClientIO                                              */
+/*      vsaScanClientIO                                               */
+/*      scanClientIO                                                  */
+/*      checkSarEntry                                                 */
+/*      scanSarEntry                                                  */
+/*      vsaReadSarEntry                                               */
+/*      vsaScanSarEntry                                               */
+/*      vsaOpenSarPool                                                */
+/*      vsaQueueSarEntry                                              */
+/*      vsaMergeSarPool                                               */
+/*      vsaCloseSarPool                                               */
+/*      vsaSarWorker                                                  */
+/*      vsaStreamSession                                              */
+/*      vsaCheckStreamTail                                            */
+/*      vsaReleaseStream                                              */
+/*      vsaReleaseStreams                                             */
+/*      freeSTREAMSESSION                                             */
+/*      freeSARJOB                                                    */
+/*      freeLOADPROFILE                                               */
+/*      freeENGINEENTRY                                               */
 /*                                                                    */
 /**********************************************************************/
 /*--------------------------------------------------------------------*/
@@ -112,6 +164,13 @@
 #include <string.h>
 #include <stddef.h>
 #include <sys/stat.h>
+#include <time.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 /*--------------------------------------------------------------------*/
 /* ClamAV includes                                                    */
@@ -120,11 +179,9 @@
 /* Own includes                                                       */
 /*--------------------------------------------------------------------*/
 #include "vsaxxtyp.h"
-#include "vsclam.h"
-#ifdef VSI2_COMPATIBLE
 #include "csdecompr.h"
+#include "vsclam.h"
 #include "vsmime.h"
-#endif
 
 /*--------------------------------------------------------------------*/
 /* static globals                                                     */
@@ -135,6 +192,30 @@ static time_t         tEngineDate           =   0;
 static PChar          pLibPath              =   NULL;
 static PChar          pDbPath               =   NULL;
 static PChar          pLoadError            =   NULL;
+static PENGINEENTRY   pEngineList           =   NULL;
+static VSA_MUTEX      tEngineLock;
+static VSA_MUTEX      tVariantLock;
+static VSA_COND       tEngineReady;
+static time_t         tgReloadCheck         =   ENGINE_RELOAD_CHECK;
+static Bool           bgAsyncInit           =   FALSE;
+static unsigned long  ulgLoadLib            =   0;
+#ifndef _WIN32
+static Bool           bgAtFork              =   FALSE;
+static Bool           bgForkLocked          =   FALSE;
+#endif
+static PENGINEENTRY   pgPreload             =   NULL;
+static Bool           bgWarmup              =   FALSE;
+static size_t         lgCioWindow           =   CIO_WINDOW_DEFAULT;
+#ifdef VSI2_COMPATIBLE
+static size_t         lgSarEntryMax         =   SAR_ENTRY_MAX_DEFAULT;
+static UInt           uigSarWorkers         =   0;
+static UInt           uigSarWorkersMax      =   SAR_WORKERS_MAX;
+static UInt           uigSarWorkersUsed     =   0;
+static VSA_MUTEX      tSarLock;
+#endif
+static VSA_MUTEX      tStreamLock;
+static PSTREAMSESSION pStreamList           =   NULL;
+static size_t         lgStreamMax           =   STREAM_MAX_DEFAULT;
 static const char        builddate[]        =   "[DATE]CLAMSAP: " __DATE__ ", " __TIME__ ;
 #ifdef __cplusplus
 static const char        version[]          =   "@[CPP]CLAMSAP: " VSA_ADAPTER_VERSION;
@@ -148,7 +229,8 @@ static const UInt     uigVS_SAP_ALL = VS_M_ERROR              |
                                       VS_M_VIRUS              |
                                       VS_M_CLEAN              |
                                       VS_M_NOTSCANNED         |
-                                      VS_M_OBJECTFOUND;
+                                      VS_M_OBJECTFOUND        |
+                                      VS_M_EXPIRED;
 
 /*         CLAMAV function pointers                */
 static struct clamav_function_s clamav_fps[] =
@@ -167,11 +249,77 @@ static struct clamav_function_s clamav_fps[] =
                 DLL_DEFINE(cl_engine_set_num),
                 DLL_DEFINE(cl_retflevel),
                 DLL_DEFINE(cl_scanfile),
+                DLL_DEFINE(cl_scandesc),
+                DLL_DEFINE(cl_statinidir),
+                DLL_DEFINE(cl_statchkdir),
+                DLL_DEFINE(cl_statfree),
+                DLL_DEFINE(cl_fmap_open_memory),
+                DLL_DEFINE(cl_fmap_open_handle),
+                DLL_DEFINE(cl_fmap_close),
+                DLL_DEFINE(cl_scanmap_callback),
                 { NULL }
 };
 
 static clamav_function_pointers clptr;
 static clamav_function_pointers *pClamFPtr = &clptr;
+
+/*         signature load profiles                 */
+static LOADPROFILE tLoadProfiles[] =
+{
+    /* name         cl_load DB options                 PUA    drivers */
+    { (PChar)"default",  0,                                 NULL,  CLAMAV_DRIVERS },
+    { (PChar)"lean",     CL_DB_OFFICIAL_ONLY,               NULL,  "main.cvd,daily.cvd" },
+    { (PChar)"standard", CL_DB_STDOPT,                      NULL,  CLAMAV_DRIVERS },
+    { (PChar)"full",     CL_DB_STDOPT | CL_DB_PUA,          NULL,  CLAMAV_DRIVERS },
+    { NULL }
+};
+
+/*         synthetic objects of the warm-up,       */
+/*         one for each type of getByteType        */
+static const unsigned char ucWarmupZip[] =
+{
+    0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x21, 0x50, 0xc1, 0xda,
+    0x56, 0x76, 0x10, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x00, 0x77, 0x61,
+    0x72, 0x6d, 0x75, 0x70, 0x2e, 0x74, 0x78, 0x74, 0x63, 0x6c, 0x61, 0x6d, 0x73, 0x61, 0x70, 0x20,
+    0x77, 0x61, 0x72, 0x6d, 0x2d, 0x75, 0x70, 0x0a, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x21, 0x50, 0xc1, 0xda, 0x56, 0x76, 0x10, 0x00, 0x00, 0x00,
+    0x10, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x80, 0x01, 0x00, 0x00, 0x00, 0x00, 0x77, 0x61, 0x72, 0x6d, 0x75, 0x70, 0x2e, 0x74, 0x78, 0x74,
+    0x50, 0x4b, 0x05, 0x06, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x38, 0x00, 0x00, 0x00,
+    0x38, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+static const unsigned char ucWarmupPe[] =
+{
+    0x4d, 0x5a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00,
+    0x50, 0x45, 0x00, 0x00, 0x4c, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xe0, 0x00, 0x02, 0x01
+};
+static const unsigned char ucWarmupOle2[512] =
+{
+    0xd0, 0xcf, 0x11, 0xe0, 0xa1, 0xb1, 0x1a, 0xe1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3e, 0x00, 0x03, 0x00, 0xfe, 0xff, 0x09, 0x00,
+    0x06, 0x00
+};
+static const char szWarmupPdf[]  = "%PDF-1.4\n1 0 obj<</Type/Catalog/Pages 2 0 R>>endobj\n"
+                                   "2 0 obj<</Type/Pages/Kids[]/Count 0>>endobj\n"
+                                   "trailer<</Root 1 0 R>>\n%%EOF\n";
+static const char szWarmupHtml[] = "<html><head><script>var a=1;</script></head>"
+                                   "<body><a href=\"http://localhost/\">clamsap</a></body></html>\n";
+static const char szWarmupSar[]  = "CAR 2.00";
+
+static WARMUPSAMPLE tWarmupSamples[] =
+{
+    { "pdf",  (const unsigned char*)szWarmupPdf,  sizeof(szWarmupPdf)-1  },
+    { "doc",  ucWarmupOle2,                       sizeof(ucWarmupOle2)   },
+    { "zip",  ucWarmupZip,                        sizeof(ucWarmupZip)    },
+    { "sar",  (const unsigned char*)szWarmupSar,  sizeof(szWarmupSar)-1  },
+    { "html", (const unsigned char*)szWarmupHtml, sizeof(szWarmupHtml)-1 },
+    { "exe",  ucWarmupPe,                         sizeof(ucWarmupPe)     },
+    { NULL }
+};
 /*--------------------------------------------------------------------*/
 /* helper functions                                                   */
 /*--------------------------------------------------------------------*/
@@ -180,6 +328,7 @@ static VSA_RC scanFile(
     void           *pEngine,
     UInt            uiJobID,
     PChar           pszObjectName,
+    int             iFd,
     USRDATA        *pUsrData,
     PChar           errorReason);
 
@@ -190,6 +339,84 @@ static VSA_RC scanCompressed(
     USRDATA        *pUsrData,
     PChar           errorReason);
 
+static VSA_RC scanBuffer(
+    void           *pEngine,
+    UInt            uiJobID,
+    PChar           pszObjectName,
+    PByte           pObject,
+    size_t          lObjectSize,
+    USRDATA        *pUsrData,
+    PChar           errorReason);
+
+static VSA_RC scanCompressedBuffer(
+    void           *pEngine,
+    UInt            uiJobID,
+    PChar           pszObjectName,
+    PByte           pObject,
+    size_t          lObjectSize,
+    struct SARIterator *pOuter,
+    USRDATA        *pUsrData,
+    PChar           errorReason);
+
+/*
+ *  SAR entries decompressed block by block, see SARSTREAM
+ */
+static VSA_RC checkSarEntry(
+    UInt                uiJobID,
+    PChar               pszObjectName,
+    PChar               pszFileName,
+    struct SARIterator *pSar,
+    size_t              lLength,
+    USRDATA            *pUsrData);
+
+static VSA_RC scanSarEntry(
+    void               *pEngine,
+    UInt                uiJobID,
+    PChar               pszFileName,
+    struct SARIterator *pSar,
+    size_t              lLength,
+    USRDATA            *pUsrData,
+    PChar               errorReason);
+
+static off_t vsaReadSarEntry(void *handle, void *buf, size_t count, off_t offset);
+static int vsaScanSarEntry(const struct cl_engine *engine,
+                           PChar              pszObjectName,
+                           PSARSTREAM         pStream,
+                           const char       **pVirname,
+                           unsigned long int *pScanned,
+                           USRDATA           *pUsrData);
+
+/*
+ *  Worker pool for the entries of a SAR archive, see SARPOOL
+ */
+static PSARPOOL vsaOpenSarPool(void          *pEngine,
+                               PChar          pszArchive,
+                               PByte          pObject,
+                               size_t         lObjectSize,
+                               USRDATA       *pUsrData);
+static VSA_RC vsaQueueSarEntry(PSARPOOL            pPool,
+                               struct SARIterator *pSar,
+                               UInt                uiJobID,
+                               PChar               pszObjectName,
+                               PChar               pszFileName,
+                               size_t              lLength);
+static VSA_RC vsaMergeSarPool(PSARPOOL       pPool,
+                              UInt           uiQueued,
+                              USRDATA       *pUsrData,
+                              PChar          errorReason,
+                              VSA_RC        *pRc);
+static void vsaCloseSarPool(PSARPOOL pPool);
+static VSA_THREAD_RC VSA_THREAD_API vsaSarWorker(void *pArg);
+static void freeSARJOB(SARJOB **);
+
+static VSA_RC scanClientIO(
+    void           *pEngine,
+    UInt            uiJobID,
+    PChar           pszObjectName,
+    PCIOSTREAM      pStream,
+    USRDATA        *pUsrData,
+    PChar           errorReason);
+
 static VSA_RC vsaSetContentTypeParametes(VSA_OPTPARAM *,
     USRDATA *
     );
@@ -210,8 +437,7 @@ static VSA_RC setScanError(UInt            uiJobID,
  */
 static VSA_RC vsaSetScanConfig(VSA_SCANPARAM *,
                                VSA_OPTPARAMS *, 
-                               USRDATA *,
-                               struct cl_engine *engine
+                               USRDATA *
                                );
 
 static VSA_RC vsaSetInitConfig(VSA_INITPARAMS *,
@@ -233,6 +459,131 @@ static void freeVSA_CONFIG(VSA_CONFIG **);
 
 static VSA_RC getFileSize(Char *, size_t *);
 
+/*
+ *  Process global engine registry, see ENGINEENTRY
+ */
+static VSA_RC vsaCompileEngine(const char        *pszDbDir,
+                               const char        *pszTmpDir,
+                               const LOADPROFILE *pProfile,
+                               const ENGINELIMITS *pLimits,
+                               unsigned int      *puiSigs,
+                               struct cl_engine **ppEngine,
+                               PENGINETIMES       pTimes,
+                               Int               *piErrorRC,
+                               PPChar             ppszErrorText);
+static PENGINEENTRY vsaFindEngine(const char *pszDbDir,
+                                  const char *pszTmpDir,
+                                  const LOADPROFILE *pProfile);
+static PENGINEENTRY vsaLookupEngine(const char *pszDbDir,
+                                    const char *pszTmpDir,
+                                    const LOADPROFILE *pProfile);
+static VSA_RC vsaRegisterEngine(const char       *pszDbDir,
+                                const char       *pszTmpDir,
+                                const LOADPROFILE *pProfile,
+                                UInt              uiSigs,
+                                struct cl_engine *engine,
+                                const ENGINETIMES *pTimes,
+                                time_t            tReadyTimeout,
+                                PPENGINEENTRY     ppEntry);
+static void vsaReleaseEngine(PENGINEENTRY pEntry);
+static void freeENGINEENTRY(ENGINEENTRY **);
+
+/*
+ *  Hot reload of the signatures, see ENGINEGEN
+ */
+static PENGINEGEN vsaAcquireGeneration(PENGINEENTRY pEntry);
+static VSA_RC vsaSelectVariant(PENGINEENTRY        pEntry,
+                               PENGINEGEN          pGen,
+                               const ENGINELIMITS *pLimits,
+                               struct cl_engine  **ppEngine,
+                               PPChar              ppszReason);
+static VSA_THREAD_RC VSA_THREAD_API vsaVariantThread(void *pArg);
+static void vsaCompileVariants(PENGINEENTRY pEntry, PENGINEGEN pGen, PENGINEGEN pFrom);
+static void vsaReleaseGeneration(PENGINEGEN pGen);
+static void vsaCheckReload(PENGINEENTRY pEntry);
+static VSA_THREAD_RC VSA_THREAD_API vsaReloadThread(void *pArg);
+static VSA_RC vsaStartThread(VSA_THREAD_FUNC *pfnThread, void *pArg);
+static Bool vsaRefreshDriverInfo(PVSA_INIT p_init, PENGINEGEN pGen);
+
+/*
+ *  Asynchronous VsaInit, see ENGINE_READY_TIMEOUT
+ */
+static void vsaUnlinkEngine(PENGINEENTRY pEntry);
+static VSA_THREAD_RC VSA_THREAD_API vsaLoadThread(void *pArg);
+static void vsaWaitEngineReady(time_t tDeadline);
+static VSA_RC vsaWaitGeneration(PENGINEENTRY pEntry,
+                                PENGINEGEN  *ppGen,
+                                PPChar       ppszReason);
+static void vsaSetTimingText(PPChar ppszText,
+                             const char *pszProfile,
+                             UInt uiSigs,
+                             const ENGINETIMES *pTimes);
+static unsigned long vsaGetMillis(void);
+
+/*
+ *  Signature load profiles, see LOADPROFILE
+ */
+static VSA_RC vsaSetLoadProfile(const char *pszSpec, PLOADPROFILE pProfile);
+static Bool vsaEqualString(const char *pszA, const char *pszB);
+static unsigned long vsaGetResidentKB(void);
+static unsigned long vsaGetUniqueKB(void);
+
+/*
+ *  Engine preload before fork, see PRELOAD_ENV
+ */
+static void vsaPreloadEngine(const char *pszSpec);
+#ifndef _WIN32
+static void vsaForkPrepare(void);
+static void vsaForkParent(void);
+static void vsaForkChild(void);
+#endif
+static unsigned long vsaWarmupEngine(const struct cl_engine *engine);
+
+/*
+ *  Scan of a buffer with the memory map of libclamav
+ */
+static int vsaScanMemory(const struct cl_engine *engine,
+                         PChar              pszObjectName,
+                         PByte              pObject,
+                         size_t             lObjectSize,
+                         const char       **pVirname,
+                         unsigned long int *pScanned,
+                         USRDATA           *pUsrData);
+
+/*
+ *  Streaming scan of VSA_SP_CLIENTIO through a handle map of libclamav
+ */
+static VSA_RC vsaOpenClientIO(PCIOSTREAM     pStream,
+                              VSA_ENGINE     hEngine,
+                              USRDATA       *pUsrData,
+                              size_t         lLength);
+static off_t vsaReadClientIO(void *handle, void *buf, size_t count, off_t offset);
+static void vsaCloseClientIO(PCIOSTREAM pStream);
+static int vsaScanClientIO(const struct cl_engine *engine,
+                           PChar              pszObjectName,
+                           PCIOSTREAM         pStream,
+                           const char       **pVirname,
+                           unsigned long int *pScanned,
+                           USRDATA           *pUsrData);
+static void freeLOADPROFILE(LOADPROFILE *);
+
+/*
+ *  Upload streams of VSA_SP_STREAM_OPEN/WRITE/CLOSE, see STREAMSESSION
+ */
+static VSA_RC vsaStreamSession(PVSA_INIT        p_init,
+                               PVSA_SCANPARAM   p_scanparam,
+                               size_t           lLimit,
+                               PPSTREAMSESSION  ppSession);
+#ifdef VSI2_COMPATIBLE
+static VSA_RC vsaCheckStreamTail(PSTREAMSESSION  pSession,
+                                 size_t          lByte,
+                                 VS_OBJECTTYPE_T tObjectType,
+                                 Bool            bPdfAllowOpenAction);
+#endif
+static void vsaReleaseStream(PSTREAMSESSION pSession, Bool bClose);
+static void vsaReleaseStreams(PVSA_INIT p_init);
+static void freeSTREAMSESSION(STREAMSESSION **);
+
 
 #ifdef _WIN32
 #define CLAM_LOAD_ERROR_MESSAGE     "ClamAV engine (clamav.dll) could not be loaded"
@@ -282,10 +633,53 @@ DLL_EXPORT VsaStartup( void )
         * Initialize the table for CRC check
         */
         memset(pClamFPtr,0,sizeof(clamav_function_pointers));
+        VSA_MUTEX_INIT(&tEngineLock);
+        VSA_MUTEX_INIT(&tVariantLock);
+        VSA_MUTEX_INIT(&tStreamLock);
+        VSA_COND_INIT(&tEngineReady);
+        if(getenv("CLAMSAP_RELOAD_CHECK") != NULL)
+            tgReloadCheck = (time_t)atol(getenv("CLAMSAP_RELOAD_CHECK"));
+        if(getenv("CLAMSAP_ASYNC_INIT") != NULL && atoi(getenv("CLAMSAP_ASYNC_INIT")) != 0)
+            bgAsyncInit = TRUE;
+        if(getenv(WARMUP_ENV) != NULL && atoi(getenv(WARMUP_ENV)) != 0)
+            bgWarmup = TRUE;
+        if(getenv(CIO_WINDOW_ENV) != NULL && atol(getenv(CIO_WINDOW_ENV)) > 0) {
+            lgCioWindow = (size_t)atol(getenv(CIO_WINDOW_ENV));
+            if(lgCioWindow < CIO_WINDOW_MIN)
+                lgCioWindow = CIO_WINDOW_MIN;
+        }
+        if(getenv(STREAM_MAX_ENV) != NULL && atol(getenv(STREAM_MAX_ENV)) > 0)
+            lgStreamMax = (size_t)atol(getenv(STREAM_MAX_ENV));
+#ifdef VSI2_COMPATIBLE
+        if(getenv(SAR_ENTRY_MAX_ENV) != NULL && atol(getenv(SAR_ENTRY_MAX_ENV)) > 0)
+            lgSarEntryMax = (size_t)atol(getenv(SAR_ENTRY_MAX_ENV));
+        if(getenv(SAR_INFLATE_THREADS_ENV) != NULL && atoi(getenv(SAR_INFLATE_THREADS_ENV)) > 0)
+            SarSetInflateThreads((unsigned int)atoi(getenv(SAR_INFLATE_THREADS_ENV)));
+        if(getenv(SAR_INDEX_CACHE_ENV) != NULL && atoi(getenv(SAR_INDEX_CACHE_ENV)) > 0)
+            SarSetIndexCache((unsigned int)atoi(getenv(SAR_INDEX_CACHE_ENV)));
+        VSA_MUTEX_INIT(&tSarLock);
+        if(getenv(SAR_WORKERS_ENV) != NULL && atoi(getenv(SAR_WORKERS_ENV)) > 0)
+            uigSarWorkers = (UInt)atoi(getenv(SAR_WORKERS_ENV));
+        if(getenv(SAR_WORKERS_MAX_ENV) != NULL && atoi(getenv(SAR_WORKERS_MAX_ENV)) > 0)
+            uigSarWorkersMax = (UInt)atoi(getenv(SAR_WORKERS_MAX_ENV));
+        if(uigSarWorkersMax > SAR_WORKERS_LIMIT)
+            uigSarWorkersMax = SAR_WORKERS_LIMIT;
+#endif
+        vsaSetIoPolicy((PChar)getenv(IO_POLICY_ENV));
+        vsaSetIoMap((PChar)getenv(IO_MAP_ENV));
         /* load clamav library and initialize it */
+        ulgLoadLib = vsaGetMillis();
         vsaLoadEngine(&pLoadError,&tEngineDate);
+        ulgLoadLib = vsaGetMillis() - ulgLoadLib;
         if(pClamFPtr->bLoaded) pClamFPtr->fp_cl_init(CL_INIT_DEFAULT);
         /*if(rc) return VSA_E_LOAD_FAILED;*/
+#ifndef _WIN32
+        /* handlers stay registered after VsaCleanup, bgInit guards them */
+        if(bgAtFork == FALSE && pthread_atfork(vsaForkPrepare,vsaForkParent,vsaForkChild) == 0)
+            bgAtFork = TRUE;
+#endif
+        if(pClamFPtr->bLoaded && getenv(PRELOAD_ENV) != NULL)
+            vsaPreloadEngine(getenv(PRELOAD_ENV));
 #ifdef VSI2_COMPATIBLE
         InitializeTable();
         if(pLoadError) {
@@ -337,7 +731,9 @@ DLL_EXPORT VsaGetConfig(PPVSA_CONFIG pp_config)
         { VS_IP_INITDRIVERS            ,   VS_TYPE_CHAR   ,      0,     0}, 
         { VS_IP_INITDIRECTORY          ,   VS_TYPE_CHAR   ,      0,     0},
         { VS_IP_INITDRIVERDIRECTORY    ,   VS_TYPE_CHAR   ,      0,     0},
-        { VS_IP_INITTEMP_PATH          ,   VS_TYPE_CHAR   ,      0,     0}
+        { VS_IP_INITTEMP_PATH          ,   VS_TYPE_CHAR   ,      0,     0},
+        { VS_IP_INITTIMEOUT            ,   VS_TYPE_TIME_T ,      0,     (void*)ENGINE_READY_TIMEOUT},
+        { VS_IP_INITENGINES            ,   VS_TYPE_CHAR   ,      0,     0}
 
     };
 
@@ -476,6 +872,21 @@ DLL_EXPORT VsaGetConfig(PPVSA_CONFIG pp_config)
                                   );
            }
         break;
+        case VS_IP_INITENGINES:
+           {
+               PChar  _profile = (PChar)strdup(LOAD_PROFILE_DEFAULT);
+               if(_profile == NULL)
+                  CLEANUP(VSA_E_NO_SPACE);
+
+               VSAddINITParameter ( (*pp_config)->pInitParams->pInitParam,
+                                    (*pp_config)->pInitParams->usInitParams,
+                                    _initparams[x].tCode,
+                                    _initparams[x].tType,
+                                    strlen((const char*)_profile),
+                                    (char*)_profile
+                                  );
+           }
+        break;
         case VS_IP_INITTEMP_PATH:
            {
               PChar  _tmpPath = NULL; /* CCQ_OFF */
@@ -546,13 +957,14 @@ DLL_EXPORT VsaGetConfig(PPVSA_CONFIG pp_config)
     (*pp_config)->uiVsaActionFlags =     VSA_AP_SCAN;
 #endif
 
-    (*pp_config)->uiVsaScanFlags   =     VSA_SP_FILE;
+    (*pp_config)->uiVsaScanFlags   =     VSA_SP_FILE | VSA_SP_BYTES | VSA_SP_CLIENTIO |
+                                         VSA_SP_STREAM_OPEN | VSA_SP_STREAM_WRITE | VSA_SP_STREAM_CLOSE;
 
     (*pp_config)->uiVsaEvtMsgFlags =     uigVS_SAP_ALL;
-    /* No client I/O callback supported for this VSA version
-     * Otherwise you should set here the callback flags for CIO support.
+    /* Client I/O is read only. VS_IO_OPENREAD and VS_IO_CLOSEREAD are
+     * optional, without them the stream cannot be read a second time.
      */
-    (*pp_config)->uiVsaCIOMsgFlags =     0;
+    (*pp_config)->uiVsaCIOMsgFlags =     VS_IO_OPENREAD | VS_IO_READ | VS_IO_CLOSEREAD;
 
     /*--------------------------------------------------------------------*/
     /* set adapter info constants                                         */
@@ -615,15 +1027,25 @@ DLL_EXPORT VsaInit( const PVSA_CALLBACK p_callback,
     size_t                      len     =   0;
     PChar                      pDriverName;
     PChar                      szinitDrivers = NULL;
-    INITDATA                   initConfig = {NULL,NULL,NULL,NULL};
+    INITDATA                   initConfig = {NULL,NULL,NULL,NULL,NULL,NULL};
+    LOADPROFILE                tProfile;
+    ENGINETIMES                tTimes;
+    time_t                     tReadyTimeout = ENGINE_READY_TIMEOUT;
+    unsigned long              ulDrivers = 0;
 
     /*   ----- clam param ---- */
-    unsigned int dboptions = 0, sigs = 0;
+    unsigned int sigs = 0;
     int ret = 0;
     struct cl_engine *engine = NULL;
+    PENGINEENTRY      pEntry = NULL;
+    PENGINEGEN          pGen = NULL;
+    const char     *pszDbDir = NULL;
+    const char    *pszTmpDir = NULL;
 
     if(pp_init == NULL)
         return VSA_E_NULL_PARAM; /* no handle */
+    memset(&tTimes,0,sizeof(ENGINETIMES));
+    memset(&tProfile,0,sizeof(LOADPROFILE));
 
     /* Comment:
      * In the VsaInit function you should either connect/contact your
@@ -686,16 +1108,36 @@ DLL_EXPORT VsaInit( const PVSA_CALLBACK p_callback,
         CLEANUP(VSA_E_NO_SPACE);
 
     /* CCQ_OFF */
-    engine = pClamFPtr->fp_cl_engine_new( );
-    if (engine == NULL)
-    {
-        SETERRORTEXT((*pp_init)->pszErrorText, "ClamAV engine initialization failed");
-        (*pp_init)->iErrorRC = 7;
-        CLEANUP(VSA_E_LOAD_FAILED);
-    }
     if((const char*)initConfig.initdirectory) {
-        ret = pClamFPtr->fp_cl_load((const char*)initConfig.initdirectory->pvValue,engine,&sigs,dboptions);
-        if(ret)
+        pszDbDir = (const char*)initConfig.initdirectory->pvValue;
+    }
+    else {
+        pszDbDir = pClamFPtr->bLoaded == TRUE ? pClamFPtr->fp_cl_retdbdir() : DRIVER_DIRECTORY;
+    }
+    if((const char*)initConfig.tmpdir) {
+        pszTmpDir = (const char*)initConfig.tmpdir->pvValue;
+    }
+    if(initConfig.timeout && initConfig.timeout->pvValue) {
+        tReadyTimeout = (time_t)((size_t)initConfig.timeout->pvValue);
+    }
+    rc = vsaSetLoadProfile(initConfig.engines ? (const char*)initConfig.engines->pvValue : NULL,&tProfile);
+    if(rc) {
+        SETERRORTEXT((*pp_init)->pszErrorText, "Unknown signature load profile in VS_IP_INITENGINES");
+        (*pp_init)->iErrorRC = 8;
+        CLEANUP(rc);
+    }
+    tTimes.ulLoadLib = ulgLoadLib;
+    /* the signatures of one directory are loaded and compiled only once per process */
+    pEntry = vsaLookupEngine(pszDbDir,pszTmpDir,&tProfile);
+    if(pEntry == NULL && bgAsyncInit == TRUE)
+    {   /* a loader thread compiles the engine, VsaScan waits for it */
+        rc = vsaRegisterEngine(pszDbDir,pszTmpDir,&tProfile,0,NULL,NULL,tReadyTimeout,&pEntry);
+        if(rc) CLEANUP(rc);
+    }
+    if(pEntry == NULL)
+    {
+        rc = vsaCompileEngine(pszDbDir,pszTmpDir,&tProfile,NULL,&sigs,&engine,&tTimes,&(*pp_init)->iErrorRC,&(*pp_init)->pszErrorText);
+        if(rc == VSA_E_DRIVER_FAILED && (const char*)initConfig.initdirectory)
         {
             if((const char*)initConfig.initdirectory) {
                 if(pDbPath) free(pDbPath);
@@ -708,49 +1150,43 @@ DLL_EXPORT VsaInit( const PVSA_CALLBACK p_callback,
             vsaResetConfig(pLibPath,pDbPath);
             if(pClamFPtr == NULL || pClamFPtr->dll_hdl == NULL || pClamFPtr->bLoaded == FALSE)
             {
+                if((*pp_init)->pszErrorText) free((*pp_init)->pszErrorText);
+                (*pp_init)->pszErrorText = NULL;
                 if(pLoadError) { SETERRORTEXT((*pp_init)->pszErrorText,pLoadError); }
                 else           { SETERRORTEXT((*pp_init)->pszErrorText,CLAM_LOAD_ERROR_MESSAGE); }
                 (*pp_init)->iErrorRC = 7;
+                freeLOADPROFILE(&tProfile);
                 return VSA_E_LOAD_FAILED; /* no successful VsaStartup */
             }
-            ret = pClamFPtr->fp_cl_load(pClamFPtr->fp_cl_retdbdir(),engine,&sigs,dboptions);
+            /* retry with the DB directory of the reloaded configuration */
+            if((*pp_init)->pszErrorText) free((*pp_init)->pszErrorText);
+            (*pp_init)->pszErrorText = NULL;
+            (*pp_init)->iErrorRC = 0;
+            pszDbDir = pClamFPtr->fp_cl_retdbdir();
+            pEntry = vsaLookupEngine(pszDbDir,pszTmpDir,&tProfile);
+            if(pEntry == NULL)
+                rc = vsaCompileEngine(pszDbDir,pszTmpDir,&tProfile,NULL,&sigs,&engine,&tTimes,&(*pp_init)->iErrorRC,&(*pp_init)->pszErrorText);
+            else
+                rc = VSA_OK;
+        }
+        if(rc) CLEANUP(rc);
+        if(pEntry == NULL)
+        {
+            rc = vsaRegisterEngine(pszDbDir,pszTmpDir,&tProfile,sigs,engine,&tTimes,tReadyTimeout,&pEntry);
+            if(rc) {
+                pClamFPtr->fp_cl_engine_free(engine);
+                CLEANUP(rc);
+            }
         }
     }
-    else {
-        ret = pClamFPtr->fp_cl_load(pClamFPtr->bLoaded == TRUE ? pClamFPtr->fp_cl_retdbdir() : DRIVER_DIRECTORY,engine,&sigs,dboptions);
-    }
-    if(ret)
-    {
-        char _error[MAX_PATH_LN * 2];
-#ifdef _WIN32
-        _snprintf((char*)_error,MAX_PATH_LN * 2,"ClamAV engine could not load signature DB files. Use freshclam to ensure availability of main.cvd and daily.cvd in %s",pClamFPtr != 0? pClamFPtr->fp_cl_retdbdir(): DRIVER_DIRECTORY);
-#else
-        snprintf((char*)_error,MAX_PATH_LN * 2,"ClamAV engine could not load signature DB files. Use freshclam to ensure availability of main.cvd and daily.cvd in /var/lib/clamav.");
-#endif
-        SETERRORTEXT((*pp_init)->pszErrorText,_error);
-        (*pp_init)->iErrorRC = ret;
-        pClamFPtr->fp_cl_engine_free(engine);
-        CLEANUP(VSA_E_DRIVER_FAILED);
-    }
-#ifndef CL_SCAN_STDOPT
-    pClamFPtr->fp_cl_engine_set_num(engine, CL_ENGINE_PCRE_MATCH_LIMIT, (long long) 2000);
-    pClamFPtr->fp_cl_engine_set_num(engine, CL_ENGINE_PCRE_RECMATCH_LIMIT, (long long) 2000);
-#endif
-    /* CCQ_ON */
-    if((ret = pClamFPtr->fp_cl_engine_compile(engine)))
-    {  /* CCQ_OFF */
-       pClamFPtr->fp_cl_engine_free(engine);
-       (*pp_init)->iErrorRC   = ret;
-       SETERRORTEXT((*pp_init)->pszErrorText, "ClamAV engine could not compile signature DB files");
-       CLEANUP(VSA_E_LOAD_FAILED);
-    }
+    /* no generation yet, if the engine is still compiled in background */
+    pGen   = vsaAcquireGeneration(pEntry);
+    engine = pGen ? pGen->engine : NULL;
      /* convert date to calendar date *//*CCQ_CLIB_LOCTIME_OK*/
     (*pp_init)->utcDate     = tEngineDate;
-    if((const char*)initConfig.initdirectory) {
-        ret = pClamFPtr->fp_cl_engine_set_str(engine,CL_ENGINE_TMPDIR,(const char*)initConfig.tmpdir->pvValue);
-    }
-    (*pp_init)->hEngine     = (PVoid)engine;
-    (*pp_init)->uiViruses   = sigs;
+    (*pp_init)->hEngine     = (PVoid)pEntry;
+    (*pp_init)->uiViruses   = pGen ? pGen->uiSigs : 0;
+    (*pp_init)->uiIntRevNum = pGen ? pGen->uiGeneration : 0;
     /* CCQ_ON */
     /*
      * Comment: 
@@ -762,13 +1198,14 @@ DLL_EXPORT VsaInit( const PVSA_CALLBACK p_callback,
      * This information also helps any customer to see which version of pattern
      * files are loaded.
      */    
+    ulDrivers = vsaGetMillis();
     do {
        struct cl_cvd *p_driver;/* CCQ_OFF */
        if((const char*)initConfig.drivers) {
            szinitDrivers = (PChar)strdup((const char*)initConfig.drivers->pvValue);
        }
        else {
-           szinitDrivers = (PChar)strdup((const char*)CLAMAV_DRIVERS);
+           szinitDrivers = (PChar)strdup(pEntry->tProfile.pszDrivers);
        }
        pDriverName = (PChar)strtok((char*)szinitDrivers,",");/*CCQ_FUNCTION_WITH_MEMORY_OK*/
        while(pDriverName!=NULL)
@@ -814,7 +1251,7 @@ DLL_EXPORT VsaInit( const PVSA_CALLBACK p_callback,
           else
           {
               /* convert date to calendar date *//*CCQ_CLIB_LOCTIME_OK*/
-              (*pp_init)->pDriver[i].utcDate = (time_t)pClamFPtr->fp_cl_engine_get_num(engine,CL_ENGINE_DB_TIME,&ret);
+              (*pp_init)->pDriver[i].utcDate = engine ? (time_t)pClamFPtr->fp_cl_engine_get_num(engine,CL_ENGINE_DB_TIME,&ret) : 0;
               (*pp_init)->pDriver[i].uiViruses        = 0;
               (*pp_init)->pDriver[i].uiVariants       = 0;  
               (*pp_init)->pDriver[i].iDriverRC        = -1;
@@ -826,6 +1263,11 @@ DLL_EXPORT VsaInit( const PVSA_CALLBACK p_callback,
           pDriverName = (PChar)strtok(NULL,","); /*CCQ_FUNCTION_WITH_MEMORY_OK*/
        }       
     } while( pDriverName );/* CCQ_ON */
+    ulDrivers = vsaGetMillis() - ulDrivers;
+    VSA_LOCK(&tEngineLock);
+    pEntry->tTimes.ulDrivers = ulDrivers;
+    tTimes = pEntry->tTimes;
+    VSA_UNLOCK(&tEngineLock);
 
     /* check drivers */
     if( (*pp_init)->usDrivers < MIN_DRIVERS )
@@ -836,8 +1278,14 @@ DLL_EXPORT VsaInit( const PVSA_CALLBACK p_callback,
     }
 cleanup:
     if(szinitDrivers) free(szinitDrivers);
+    freeLOADPROFILE(&tProfile);
+    vsaReleaseGeneration(pGen);
     if (rc != VSA_OK)
     {
+        if(pp_init && (*pp_init) && (*pp_init)->hEngine) {
+            vsaReleaseEngine((PENGINEENTRY)(*pp_init)->hEngine);
+            (*pp_init)->hEngine = NULL;
+        }
         if((*pp_init)->pszErrorText==NULL) SETSTRING( (*pp_init)->pszErrorText, pClamFPtr->fp_cl_strerror(ret) );
         if (pp_init && (*pp_init) && (*pp_init)->iErrorRC == 0)
             freeVSA_INIT(pp_init);
@@ -845,7 +1293,12 @@ cleanup:
     else
     {   /* increase the ref. counter */
         lgRefCounter++;
-        SETSTRING( (*pp_init)->pszErrorText, "No error" );
+        if(pGen == NULL) {
+            SETSTRING( (*pp_init)->pszErrorText, "No error, ClamAV engine loads the signatures in background" );
+        }
+        else {
+            vsaSetTimingText(&(*pp_init)->pszErrorText,(const char*)pEntry->tProfile.pszName,pGen->uiSigs,&tTimes);
+        }
     }
     return (rc);
 } /* VsaInit */
@@ -909,7 +1362,17 @@ DLL_EXPORT VsaScan(
     PVSA_SCANERROR      p_scanerror     = NULL;
     PVSA_VIRUSINFO      p_virusinfo     = NULL;
     FILE                *_fp            = NULL;
+    struct stat         tStat;
+    PByte               pbMap           = NULL;
+    size_t              lMap            = 0;
+    struct cl_engine    *engine         = NULL;
+    PENGINEGEN          pGen            = NULL;
+    UInt                uiRevNum        = 0;
     USRDATA             usrdata;
+    CIOSTREAM           tCio;
+    PSTREAMSESSION      pSession        = NULL;
+    PByte               pbObject        = NULL;
+    size_t              lObject         = 0;
     Char                szErrorName[1024];
 #ifdef VSI2_COMPATIBLE
     PChar               pszObjName      = NULL;
@@ -925,6 +1388,7 @@ DLL_EXPORT VsaScan(
 #endif
 
     memset(&usrdata,0,sizeof(USRDATA)); 
+    memset(&tCio,0,sizeof(CIOSTREAM));
 
     if(bgInit == FALSE) {
         pszReason = (PChar)"Adapter is not initialized";
@@ -941,6 +1405,11 @@ DLL_EXPORT VsaScan(
         CLEANUP(VSA_E_NULL_PARAM);
     }
 
+    if(p_init->hEngine == NULL) {
+        pszReason = (PChar)"Adapter initialization handle without engine";
+        CLEANUP(VSA_E_INVALID_HANDLE);
+    }
+
     /*--------------------------------------------------------------------*/
     /* check structure size to protect yourself against different versions*/
     /*--------------------------------------------------------------------*/
@@ -961,6 +1430,19 @@ DLL_EXPORT VsaScan(
     cfunc     = usrdata.pvFncptr;
     usrdata.cl_scan_options.parse |= ~0; /* enable all parsers */
 
+    /*
+     * the scan keeps its engine generation, also if a reload swaps
+     * the engine of the handle in the meantime
+     */
+    rc = vsaWaitGeneration((PENGINEENTRY)p_init->hEngine,&pGen,&pszReason);
+    if(rc) CLEANUP(rc);
+    engine = pGen->engine;
+    uiRevNum = p_init->uiIntRevNum;
+    if(pGen->uiGeneration != uiRevNum && vsaRefreshDriverInfo(p_init,pGen) == TRUE && uiRevNum != 0)
+    {   /* information only, the reloaded engine is already active */
+        _vsa_rc = CB_FUNC( VS_M_EXPIRED, p_init );
+    }
+
     /*
      * allocate VSA_SCANINFO 
      */
@@ -1012,12 +1494,24 @@ DLL_EXPORT VsaScan(
     /* Comment:                                                           */
     /* Set scan parameter configuration                                   */ 
     /*--------------------------------------------------------------------*/
-    rc = vsaSetScanConfig(p_scanparam, p_optparams,&usrdata,(struct cl_engine*)p_init->hEngine);
+    rc = vsaSetScanConfig(p_scanparam, p_optparams,&usrdata);
     if (rc)
     {
         pszReason = (PChar)"At least one parameter is invalid!";
         CLEANUP(rc);
     }
+    /* the scan limits select an own engine, the shared engine is never changed */
+    rc = vsaSelectVariant((PENGINEENTRY)p_init->hEngine,pGen,&usrdata.tLimits,&engine,&pszReason);
+    if(rc == VSA_E_NOT_SCANNED) {
+        rc = addNotScanned(p_scanparam->uiJobID,
+            p_scanparam->pszObjectName,
+            p_scanparam->lLength,
+            pszReason,
+            pp_scinfo != NULL ? (*pp_scinfo) : NULL);
+        if(rc) CLEANUP(rc);
+        CLEANUP(VSA_E_ENTRY_NOT_SCANNED);
+    }
+    if(rc) CLEANUP(rc);
     /*--------------------------------------------------------------------*/
     /* example callbacks to query whether we should start                 */
     /*--------------------------------------------------------------------*/
@@ -1029,6 +1523,75 @@ DLL_EXPORT VsaScan(
     if (_vsa_rc == VS_CB_NEXT || _vsa_rc == VS_CB_TERMINATE)
         CLEANUP(VSA_E_CBC_TERMINATED);
 
+    if(p_scanparam->tScanCode == VSA_SP_CLIENTIO)
+    {
+        if(usrdata.pvCIOFncptr == NULL) {
+            pszReason = (PChar)"Client I/O callback with VS_IO_READ missing";
+            CLEANUP(VSA_E_INVALID_PARAM);
+        }
+        if(p_scanparam->lLength == 0) {
+            pszReason = (PChar)"Client I/O scan needs the object length";
+            CLEANUP(VSA_E_INVALID_SCANOBJECT);
+        }
+        usrdata.lObjectSize = p_scanparam->lLength;
+        rc = vsaOpenClientIO(&tCio,(VSA_ENGINE)p_init->hEngine,&usrdata,p_scanparam->lLength);
+        if(rc) {
+            pszReason = (PChar)"Client I/O stream could not be opened";
+            CLEANUP(rc);
+        }
+    }
+    if(p_scanparam->tScanCode == VSA_SP_STREAM_OPEN  ||
+       p_scanparam->tScanCode == VSA_SP_STREAM_WRITE ||
+       p_scanparam->tScanCode == VSA_SP_STREAM_CLOSE)
+    {
+        size_t lLimit = lgStreamMax;
+
+        if(usrdata.tLimits.llMaxScanSize > 0 && (size_t)usrdata.tLimits.llMaxScanSize < lLimit)
+            lLimit = (size_t)usrdata.tLimits.llMaxScanSize;
+        if(usrdata.tLimits.llMaxFileSize > 0 && (size_t)usrdata.tLimits.llMaxFileSize < lLimit)
+            lLimit = (size_t)usrdata.tLimits.llMaxFileSize;
+        rc = vsaStreamSession(p_init,p_scanparam,lLimit,&pSession);
+        if(rc) {
+            if(rc == VSA_E_NO_SPACE)
+                pszReason = (PChar)"Stream exceeds the available memory";
+            else if(rc == VSA_E_NOT_SCANNED)
+                pszReason = (PChar)"Not scanned: limit";
+            else
+                pszReason = (PChar)"Stream was not opened with VSA_SP_STREAM_OPEN";
+            CLEANUP(rc);
+        }
+        usrdata.lObjectSize = pSession->lFill;
+    }
+    if(p_scanparam->tScanCode == VSA_SP_FILE)
+    {
+        /* the file is opened once, the size, the content checks,
+         * libmagic and the scan work on this descriptor
+         */
+        _fp = fopen((const char*)p_scanparam->pszObjectName,"rb");
+        if(_fp == NULL || fstat(fileno(_fp),&tStat) != 0) {
+            pszReason = (PChar)"The file could not be opened!";
+            CLEANUP(VSA_E_SCAN_FAILED);
+        }
+        usrdata.lObjectSize = (size_t)tStat.st_size;
+        vsaIoAdviseOpen(fileno(_fp),usrdata.lObjectSize);
+#ifndef _WIN32
+        if(vsaIoMapFile() == TRUE && tStat.st_size > 0 && (off_t)(size_t)tStat.st_size == tStat.st_size)
+        {
+            /* the pre-check and the engine work on this mapping,
+             * so the pages are read only once. A file which can be
+             * truncated during the scan is read with stdio instead,
+             * see IO_MAP_ENV
+             */
+            pbMap = (PByte)mmap(NULL,(size_t)tStat.st_size,PROT_READ,MAP_PRIVATE,fileno(_fp),0);
+            if(pbMap == (PByte)MAP_FAILED)
+                pbMap = NULL; /* read with stdio as before */
+            else
+                lMap = (size_t)tStat.st_size;
+        }
+        vsaIoAdviseMap(pbMap,lMap);
+#endif
+    }
+
 #ifdef VSI2_COMPATIBLE
     /*--------------------------------------------------------------------*/
     /* example callbacks to query whether we should start                 */
@@ -1038,26 +1601,77 @@ DLL_EXPORT VsaScan(
         Byte bbyte[65536];
         PByte pBuff = bbyte;
         Bool text = TRUE;
+        Bool checkcontent = FALSE;
         int status = 1;
         VS_OBJECTTYPE_T a = VS_OT_UNKNOWN;
         VS_OBJECTTYPE_T b = VS_OT_UNKNOWN;
         size_t current_read = 0;
 
-        rc = getFileSize(p_scanparam->pszObjectName,&usrdata.lObjectSize);
-        if(rc) {
-            pszReason = (PChar)"The file could not be opened!";
-            CLEANUP(VSA_E_SCAN_FAILED);
+        if(p_scanparam->tScanCode == VSA_SP_BYTES) {
+            /* the checks run directly on the buffer of SAP */
+            usrdata.lObjectSize = p_scanparam->lLength;
+            checkcontent = TRUE;
         }
-        memset(bbyte,0,sizeof(bbyte));
-        _fp = fopen((const char*)p_scanparam->pszObjectName,"rb");
-        if(_fp) {
+        else if(p_scanparam->tScanCode == VSA_SP_CLIENTIO) {
+            /* the checks run on the head of the stream, which stays
+             * in the window for the scan afterwards
+             */
+            checkcontent = TRUE;
+        }
+        else if(pSession != NULL) {
+            /* the type detection continues on the new chunk with the
+             * state of the previous chunks, the active content check
+             * runs on each chunk, so a block ends the upload early
+             */
+            status = pSession->pType->iStatus;
+            text   = pSession->pType->bText;
+            a      = pSession->pType->tType;
+            b      = pSession->pType->tEnd;
+            usrdata.tObjectType = pSession->pType->tObjectType;
+            strcpy((char*)szExt,(const char*)pSession->pType->szExt);
+            strcpy((char*)szMimeType,(const char*)pSession->pType->szMimeType);
+            if((p_scanparam->pbByte != NULL && p_scanparam->lLength > 0) ||
+               p_scanparam->tScanCode == VSA_SP_STREAM_CLOSE)
+                checkcontent = TRUE;
+        }
+        else {
+            memset(bbyte,0,sizeof(bbyte));
+            checkcontent = TRUE;
+        }
+        if(checkcontent) {
             do {
-                current_read = fread(pBuff,1,sizeof(bbyte)-1,_fp);
-                if(current_read == 0) break;
-                rc = getByteType(pBuff,(current_read < sizeof(bbyte)-1)?current_read:sizeof(bbyte)-1,p_scanparam->pszObjectName,szExt2,szExt,szMimeType,0,&status,&text,&a,&b,&usrdata.tFileType,&usrdata.tObjectType);
+                if(p_scanparam->tScanCode == VSA_SP_BYTES || pSession != NULL) {
+                    pBuff = p_scanparam->pbByte;
+                    current_read = p_scanparam->lLength;
+                    if(pBuff != NULL && current_read > 0)
+                        rc = getByteType(pBuff,current_read,p_scanparam->pszObjectName,szExt2,szExt,szMimeType,0,&status,&text,&a,&b,&usrdata.tFileType,&usrdata.tObjectType);
+                }
+                else if(pbMap != NULL) {
+                    /* one pass over the whole mapped file */
+                    pBuff = pbMap;
+                    current_read = lMap;
+                    rc = getByteType(pBuff,current_read,p_scanparam->pszObjectName,szExt2,szExt,szMimeType,0,&status,&text,&a,&b,&usrdata.tFileType,&usrdata.tObjectType);
+                }
+                else if(p_scanparam->tScanCode == VSA_SP_CLIENTIO) {
+                    off_t lRead = vsaReadClientIO(&tCio,bbyte,sizeof(bbyte)-1,0);
+                    if(lRead <= 0) {
+                        pszReason = (PChar)"Client I/O read failed";
+                        CLEANUP(VSA_E_CIO_FAILED);
+                    }
+                    current_read = (size_t)lRead;
+                    rc = getByteType(pBuff,current_read,p_scanparam->pszObjectName,szExt2,szExt,szMimeType,0,&status,&text,&a,&b,&usrdata.tFileType,&usrdata.tObjectType);
+                }
+                else {
+                    current_read = fread(pBuff,1,sizeof(bbyte)-1,_fp);
+                    if(current_read == 0) break;
+                    rc = getByteType(pBuff,(current_read < sizeof(bbyte)-1)?current_read:sizeof(bbyte)-1,p_scanparam->pszObjectName,szExt2,szExt,szMimeType,0,&status,&text,&a,&b,&usrdata.tFileType,&usrdata.tObjectType);
+                }
                 if(usrdata.bActiveContent == TRUE)
                 {
-                    rc = check4ActiveContent(pBuff,sizeof(bbyte) - 1,usrdata.tObjectType, usrdata.bPdfAllowOpenAction);
+                    if(pSession == NULL)
+                        rc = check4ActiveContent(pBuff,(p_scanparam->tScanCode != VSA_SP_FILE || pbMap != NULL) ? current_read : sizeof(bbyte) - 1,usrdata.tObjectType, usrdata.bPdfAllowOpenAction);
+                    else
+                        rc = vsaCheckStreamTail(pSession,current_read,usrdata.tObjectType,usrdata.bPdfAllowOpenAction);
                     if(rc) {
                         if(pp_scinfo != NULL && (*pp_scinfo) != NULL) {
                             addVirusInfo(p_scanparam->uiJobID,
@@ -1111,17 +1725,34 @@ DLL_EXPORT VsaScan(
                         CLEANUP(rc);
                     }
                 }
+                /* no loop for byte, client I/O and mapped file scan */
+                if(p_scanparam->tScanCode != VSA_SP_FILE || pbMap != NULL) {
+                    current_read = 0;
+                }
             } while(current_read > 0 || rc != VSA_OK);
         }
-        FCLOSE_SAFE(_fp);
+        if(_fp != NULL)
+            rewind(_fp); /* descriptor is scanned afterwards */
         if(rc) CLEANUP(rc);
+        if(pSession != NULL)
+        {
+            pSession->pType->iStatus     = status;
+            pSession->pType->bText       = text;
+            pSession->pType->tType       = a;
+            pSession->pType->tEnd        = b;
+            pSession->pType->tObjectType = usrdata.tObjectType;
+            strcpy((char*)pSession->pType->szExt,(const char*)szExt);
+            strcpy((char*)pSession->pType->szMimeType,(const char*)szMimeType);
+            if(p_scanparam->tScanCode != VSA_SP_STREAM_CLOSE)
+                CLEANUP(VSA_OK); /* the type is final with the close */
+        }
         if(usrdata.tFileType != usrdata.tObjectType)
         {
             if(strlen((const char*)szExt2) == 0 || (usrdata.tFileType == VS_OT_UNKNOWN && usrdata.tObjectType == VS_OT_BINARY))
             {
                 /* Here we found an unknown binary object, use external MIME type detection
                 */
-                PChar pMType = vsaGetFileMimeType(p_scanparam->pszObjectName);
+                PChar pMType = vsaGetDescMimeType(p_scanparam->pszObjectName,_fp != NULL ? fileno(_fp) : -1);
                 if(pMType && (unsigned int)strlen((const char*)pMType) < (unsigned int)MIME_LN) {
                     sprintf((char*)szMimeType,"%s",pMType);
                 }
@@ -1132,7 +1763,6 @@ DLL_EXPORT VsaScan(
             }
             else
             {
-                rc = getFileSize(p_scanparam->pszObjectName,&usrdata.lObjectSize);
                 if(usrdata.bMimeCheck == TRUE)
                 {
                     sprintf((char*)szErrorName,"Extension (%.100s) is not compatible to MIME type (%.850s)",(const char*)szExt2,(const char*)szMimeType);
@@ -1175,11 +1805,13 @@ DLL_EXPORT VsaScan(
             sprintf((char*)szExt,"%s",szExt2);
         }
     }
+    if(pSession != NULL && p_scanparam->tScanCode != VSA_SP_STREAM_CLOSE)
+        CLEANUP(VSA_OK); /* content info and scan follow with the close */
     if(usrdata.tObjectType == VS_OT_UNKNOWN)
     {
         /* Here we found an unknown binary object, use external MIME type detection
         */
-        PChar pMType = vsaGetFileMimeType(p_scanparam->pszObjectName);
+        PChar pMType = vsaGetDescMimeType(p_scanparam->pszObjectName,_fp != NULL ? fileno(_fp) : -1);
         if(pMType && (unsigned int)strlen((const char*)pMType) < (unsigned int)MIME_LN) {
             sprintf((char*)szMimeType,"%s",pMType);
         }
@@ -1209,41 +1841,114 @@ DLL_EXPORT VsaScan(
     /* Start here to process the different action types.                  */
     /* First we perform some plausi checks                                */
     /*--------------------------------------------------------------------*/
+    if(pSession != NULL) {
+        pbObject = pSession->pbData;
+        lObject  = pSession->lFill;
+    }
+    else {
+        pbObject = p_scanparam->pbByte;
+        lObject  = p_scanparam->lLength;
+    }
     switch(p_scanparam->tScanCode)
     {
-    case VSA_SP_FILE:
+    case VSA_SP_STREAM_OPEN:
+    case VSA_SP_STREAM_WRITE:
+        CLEANUP(VSA_OK); /* collected until VSA_SP_STREAM_CLOSE */
+    case VSA_SP_STREAM_CLOSE:
+    case VSA_SP_BYTES:
+        usrdata.lObjectSize = lObject;
 #ifdef VSI2_COMPATIBLE
         if(pp_scinfo != NULL && (*pp_scinfo) != NULL)
         {
             usrdata.pScanInfo = (*pp_scinfo);
         }
-        rc = scanFile(
-            p_init->hEngine,
+        rc = scanBuffer(
+            engine,
             p_scanparam->uiJobID,
             p_scanparam->pszObjectName,
+            pbObject,
+            lObject,
             &usrdata,
             szErrorName);
         if(rc) SET_VSA_RC( rc );
 #else
-        rc = getFileSize(p_scanparam->pszObjectName,&usrdata.lObjectSize);
-        if(rc) {
-            pszReason = (PChar)"The file could not be opened!";
-            CLEANUP(VSA_E_SCAN_FAILED);
-        }           /* CCQ_OFF */
+        clam_rc = vsaScanMemory(
+            (const struct cl_engine *)engine,
+            p_scanparam->pszObjectName,
+            pbObject,
+            lObject,
+            (const char**)&virname,
+            &scanned,
+            &usrdata);
+        if(clam_rc != CL_CLEAN)
+        {
+            pszReason = (PChar)pClamFPtr->fp_cl_strerror(clam_rc);
+            switch(clam_rc)
+            {
+            case CL_VIRUS: rc = VSA_E_VIRUS_FOUND;
+                break;
+            default:       rc = VSA_E_SCAN_FAILED;
+                pszReason = (PChar)"ClamAV engine with internal,unknown error.";
+                break;
+            }
+        }
+        else
+        {
+            rc = VSA_OK;
+        }
+#endif
+        break;
+    case VSA_SP_FILE:
+#ifdef VSI2_COMPATIBLE
+        if(pp_scinfo != NULL && (*pp_scinfo) != NULL)
+        {
+            usrdata.pScanInfo = (*pp_scinfo);
+        }
+        if(pbMap != NULL)
+            rc = scanBuffer(
+                engine,
+                p_scanparam->uiJobID,
+                p_scanparam->pszObjectName,
+                pbMap,
+                lMap,
+                &usrdata,
+                szErrorName);
+        else
+            rc = scanFile(
+                engine,
+                p_scanparam->uiJobID,
+                p_scanparam->pszObjectName,
+                fileno(_fp),
+                &usrdata,
+                szErrorName);
+        if(rc) SET_VSA_RC( rc );
+#else
+        /* CCQ_OFF */
+        if(pbMap != NULL)
+            clam_rc = vsaScanMemory(
+                (const struct cl_engine *)engine,
+                p_scanparam->pszObjectName,
+                pbMap,
+                lMap,
+                (const char**)&virname,
+                &scanned,
+                &usrdata);
+        else
 #ifdef CL_SCAN_STDOPT
-        clam_rc = pClamFPtr->fp_cl_scanfile(
-            (const char*)p_scanparam->pszObjectName,
+        clam_rc = pClamFPtr->fp_cl_scandesc(
+            fileno(_fp),
             (const char**)&virname,
             &scanned,
-            (const struct cl_engine *)p_init->hEngine,
+            (const struct cl_engine *)engine,
             CL_SCAN_STDOPT);
 #else
 {
-        clam_rc = pClamFPtr->fp_cl_scanfile(
+        clam_rc = pClamFPtr->fp_cl_scandesc(
+            fileno(_fp),
             (const char*)p_scanparam->pszObjectName,
             (const char**)&virname,
             &scanned,
-            (const struct cl_engine *)p_init->hEngine,
+            (const struct cl_engine *)engine,
             &usrdata.cl_scan_options);
 }
 #endif
@@ -1266,35 +1971,78 @@ DLL_EXPORT VsaScan(
         }
 #endif
         break;
-    default:
-        pszReason = (PChar)"ClamAV engine supports only the scan of local files";
-        CLEANUP(VSA_E_INVALID_SCANOBJECT);
-    }
-
-#ifndef VSI2_COMPATIBLE
-    /*
-    * After the scan
-    */
-    if(clam_rc == CL_VIRUS)
-    {
-        /* found EICAR */
-        p_virusinfo = (PVSA_VIRUSINFO)calloc(1,sizeof(VSA_VIRUSINFO));
-
-        if(p_virusinfo == NULL)
-            CLEANUP(VSA_E_NO_SPACE);
-
-        p_virusinfo->struct_size = sizeof(VSA_VIRUSINFO);
-        p_virusinfo->bRepairable = FALSE;
-        p_virusinfo->lObjectSize = usrdata.lObjectSize;
-        SETSTRING(p_virusinfo->pszFreeTextInfo,"No info available");
-        SETSTRING(p_virusinfo->pszObjectName,p_scanparam->pszObjectName);
-        SETSTRING(p_virusinfo->pszVirusName,virname);
-        p_virusinfo->tActionType = VS_AT_NOACTION;
-        p_virusinfo->tDetectType = VS_DT_KNOWNVIRUS;
-        p_virusinfo->tVirusType = VS_VT_VIRUS;
-        p_virusinfo->uiVirusID = 0;
-        p_virusinfo->tObjectType = VS_OT_BINARY;
-
+    case VSA_SP_CLIENTIO:
+#ifdef VSI2_COMPATIBLE
+        if(pp_scinfo != NULL && (*pp_scinfo) != NULL)
+        {
+            usrdata.pScanInfo = (*pp_scinfo);
+        }
+        rc = scanClientIO(
+            engine,
+            p_scanparam->uiJobID,
+            p_scanparam->pszObjectName,
+            &tCio,
+            &usrdata,
+            szErrorName);
+        if(rc) SET_VSA_RC( rc );
+#else
+        clam_rc = vsaScanClientIO(
+            (const struct cl_engine *)engine,
+            p_scanparam->pszObjectName,
+            &tCio,
+            (const char**)&virname,
+            &scanned,
+            &usrdata);
+        if(clam_rc != CL_CLEAN)
+        {
+            pszReason = (PChar)pClamFPtr->fp_cl_strerror(clam_rc);
+            switch(clam_rc)
+            {
+            case CL_VIRUS: rc = VSA_E_VIRUS_FOUND;
+                break;
+            case CL_EREAD: rc = VSA_E_CIO_FAILED;
+                pszReason = (PChar)"Client I/O read failed";
+                break;
+            default:       rc = VSA_E_SCAN_FAILED;
+                pszReason = (PChar)"ClamAV engine with internal,unknown error.";
+                break;
+            }
+        }
+        else
+        {
+            rc = VSA_OK;
+        }
+#endif
+        break;
+    default:
+        pszReason = (PChar)"ClamAV engine supports only the scan of local files, byte buffers, streams and client I/O";
+        CLEANUP(VSA_E_INVALID_SCANOBJECT);
+    }
+
+#ifndef VSI2_COMPATIBLE
+    /*
+    * After the scan
+    */
+    if(clam_rc == CL_VIRUS)
+    {
+        /* found EICAR */
+        p_virusinfo = (PVSA_VIRUSINFO)calloc(1,sizeof(VSA_VIRUSINFO));
+
+        if(p_virusinfo == NULL)
+            CLEANUP(VSA_E_NO_SPACE);
+
+        p_virusinfo->struct_size = sizeof(VSA_VIRUSINFO);
+        p_virusinfo->bRepairable = FALSE;
+        p_virusinfo->lObjectSize = usrdata.lObjectSize;
+        SETSTRING(p_virusinfo->pszFreeTextInfo,"No info available");
+        SETSTRING(p_virusinfo->pszObjectName,p_scanparam->pszObjectName);
+        SETSTRING(p_virusinfo->pszVirusName,virname);
+        p_virusinfo->tActionType = VS_AT_NOACTION;
+        p_virusinfo->tDetectType = VS_DT_KNOWNVIRUS;
+        p_virusinfo->tVirusType = VS_VT_VIRUS;
+        p_virusinfo->uiVirusID = 0;
+        p_virusinfo->tObjectType = VS_OT_BINARY;
+
         SET_VSA_RC(VSA_E_VIRUS_FOUND);
         _vsa_rc = CB_FUNC(VS_M_VIRUS,p_virusinfo);
         if(_vsa_rc == VS_CB_NEXT || _vsa_rc == VS_CB_TERMINATE)
@@ -1338,7 +2086,17 @@ DLL_EXPORT VsaScan(
 #endif
     /* Exception handling */
 cleanup:
+#ifndef _WIN32
+    if(pbMap != NULL)
+        munmap(pbMap,lMap);
+#endif
+    if(_fp != NULL)
+        vsaIoAdviseDone(fileno(_fp),0); /* pages of the object are not reused */
     FCLOSE_SAFE(_fp);
+    vsaCloseClientIO(&tCio);
+    if(pSession != NULL) /* closed or blocked streams leave the list */
+        vsaReleaseStream(pSession,(rc != VSA_OK || p_scanparam->tScanCode == VSA_SP_STREAM_CLOSE));
+    vsaReleaseGeneration(pGen);
     switch(rc)
     {
     case VSA_E_NOT_SUPPORTED:
@@ -1381,11 +2139,25 @@ cleanup:
         if (_vsa_rc == VS_CB_NEXT || _vsa_rc == VS_CB_TERMINATE)
             SET_VSA_RC(VSA_E_CBC_TERMINATED);
     break;
+    case VSA_E_CIO_FAILED:
+        SET_VSA_RC( VSA_E_CIO_FAILED );
+        setScanError(p_scanparam->uiJobID,
+                     p_scanparam->pszObjectName,
+                     usrdata.lObjectSize,
+                     (Int)rc,
+                     pszReason,
+                     &p_scanerror
+                     );
+        _vsa_rc = CB_FUNC( VS_M_ERROR, pszReason );
+        if (_vsa_rc == VS_CB_NEXT || _vsa_rc == VS_CB_TERMINATE)
+            SET_VSA_RC(VSA_E_CBC_TERMINATED);
+    break;
     default:
     break;    
     }
     if( rc == VSA_E_NOT_SCANNED   ||
         rc == VSA_E_NOT_SUPPORTED ||
+        rc == VSA_E_CIO_FAILED    ||
         rc == VSA_E_SCAN_FAILED)
     {     
         if(pp_scinfo != NULL && (*pp_scinfo) != NULL)
@@ -1399,6 +2171,10 @@ cleanup:
             freescanerror(&p_scanerror);
         }
     }
+    if (rc == VSA_E_ENTRY_NOT_SCANNED)
+        rc = VSA_E_NOT_SCANNED; /* the entry is already in the scan errors */
+    if (usrdata.vsa_rc == VSA_E_ENTRY_NOT_SCANNED)
+        usrdata.vsa_rc = VSA_E_NOT_SCANNED;
     if (rc == 0)
         rc = usrdata.vsa_rc; /* set now the saved RC to return value */
     if (rc == 0)
@@ -1518,8 +2294,9 @@ DLL_EXPORT VsaEnd(PPVSA_INIT pp_init, PPVSA_CONFIG pp_config)
     /*--------------------------------------------------------------------*/
     if (pp_init != NULL && (*pp_init) != NULL)
     {
+        vsaReleaseStreams((*pp_init)); /* uploads without VSA_SP_STREAM_CLOSE */
         if((*pp_init)->hEngine && pClamFPtr && pClamFPtr->fp_cl_engine_free)  /* CCQ_OFF */
-           pClamFPtr->fp_cl_engine_free((struct cl_engine *)(*pp_init)->hEngine);
+           vsaReleaseEngine((PENGINEENTRY)(*pp_init)->hEngine);
         freeVSA_INIT(pp_init);   /* CCQ_ON */
     }   
         
@@ -1555,12 +2332,27 @@ DLL_EXPORT VsaCleanup( void )
     
     if(lgRefCounter != (size_t)0)
         return VSA_E_IN_PROGRESS;     /* any instance is still active */
+    if(pgPreload != NULL) {
+        vsaReleaseEngine(pgPreload);
+        pgPreload = NULL;
+    }
+    if(pEngineList != NULL)
+        return VSA_E_IN_PROGRESS;     /* any signature reload is still running */
     /*--------------------------------------------------------------------*/
     /* The cleanup will be called process global                          */
     /*--------------------------------------------------------------------*/
 #ifdef VSI2_COMPATIBLE
     vsaCloseMagicLibrary();
 #endif
+    vsaReleaseStreams(NULL);
+    VSA_MUTEX_FREE(&tEngineLock);
+    VSA_MUTEX_FREE(&tVariantLock);
+    VSA_MUTEX_FREE(&tStreamLock);
+#ifdef VSI2_COMPATIBLE
+    VSA_MUTEX_FREE(&tSarLock);
+    SarFreeIndexCache();
+#endif
+    VSA_COND_FREE(&tEngineReady);
     bgInit = FALSE;
     if(pLibPath) {
         free(pLibPath);
@@ -1643,7 +2435,9 @@ static VSA_RC vsaResetConfig(PChar confDir,PChar dataDir)
     memset(pClamFPtr,0,sizeof(clamav_function_pointers));
 #endif
     /* load clamav library and initialize it */
+    ulgLoadLib = vsaGetMillis();
     vsaLoadEngine(&pLoadError,&tEngineDate);
+    ulgLoadLib = vsaGetMillis() - ulgLoadLib;
 #ifdef _WIN32
     if(pClamFPtr->bLoaded) { pClamFPtr->fp_cl_init(CL_INIT_DEFAULT); }
 #endif
@@ -2028,7 +2822,7 @@ cleanup:
 } /* setScanError */
 
 
-static VSA_RC vsaSetScanConfig(VSA_SCANPARAM *p_scanparam,VSA_OPTPARAMS *p_optparams, USRDATA *usrdata, struct cl_engine *engine)
+static VSA_RC vsaSetScanConfig(VSA_SCANPARAM *p_scanparam,VSA_OPTPARAMS *p_optparams, USRDATA *usrdata)
 {
     VSA_RC     rc        = VSA_OK;
     Int        i         = 0,
@@ -2087,15 +2881,15 @@ static VSA_RC vsaSetScanConfig(VSA_SCANPARAM *p_scanparam,VSA_OPTPARAMS *p_optpa
             break;
         case VS_OP_SCANLIMIT:
              if ((p_optparams->pOptParam[i].pvValue)!=NULL)
-                 pClamFPtr->fp_cl_engine_set_num(engine, CL_ENGINE_MAX_SCANSIZE, (long long) ((size_t)p_optparams->pOptParam[i].pvValue));
+                 usrdata->tLimits.llMaxScanSize = (long long) ((size_t)p_optparams->pOptParam[i].pvValue);
         break;
         case VS_OP_SCANEXTRACT_SIZE:
              if ((p_optparams->pOptParam[i].pvValue)!=NULL)
-                 pClamFPtr->fp_cl_engine_set_num(engine, CL_ENGINE_MAX_FILESIZE, (long long) ((size_t)p_optparams->pOptParam[i].pvValue));
+                 usrdata->tLimits.llMaxFileSize = (long long) ((size_t)p_optparams->pOptParam[i].pvValue);
         break;
         case VS_OP_SCANEXTRACT_DEPTH:
              if ((p_optparams->pOptParam[i].pvValue)!=NULL)
-                pClamFPtr->fp_cl_engine_set_num(engine, CL_ENGINE_MAX_RECURSION, (long long) ((size_t)p_optparams->pOptParam[i].pvValue));
+                 usrdata->tLimits.llMaxRecursion = (long long) ((size_t)p_optparams->pOptParam[i].pvValue);
         break;
         case VS_OP_SCANHEURISTICLEVEL:
              if ((p_optparams->pOptParam[i].pvValue)!=NULL) {
@@ -2144,12 +2938,14 @@ static VSA_RC scanFile(
     void           *pEngine,
     UInt            uiJobID,
     PChar           pszObjectName,
+    int             iFd,
     USRDATA        *pUsrData,
     PChar           errorReason)
 {
     int         clam_rc  = 0;
     const char *virname  = NULL;
     VSA_RC           rc  = VSA_OK;
+    VS_CALLRC   _vsa_rc  = VS_CB_OK;
     unsigned long int scanned = 0;
     if(pUsrData == NULL)
         return VSA_E_NULL_PARAM;
@@ -2177,19 +2973,20 @@ static VSA_RC scanFile(
         * Normally you should compare the byte signatures!
         */
         /*
-        * Scan local file
+        * Scan local file, the descriptor of VsaScan is not opened again
         */
 #ifdef CL_SCAN_STDOPT
         /* CCQ_OFF */
-        clam_rc = pClamFPtr->fp_cl_scanfile(
-                (const char*)pszObjectName,
+        clam_rc = pClamFPtr->fp_cl_scandesc(
+                iFd,
                 (const char**)&virname,
                 &scanned,
                 (const struct cl_engine *)pEngine,
                 CL_SCAN_STDOPT);
 #else
             /* CCQ_OFF */
-        clam_rc = pClamFPtr->fp_cl_scanfile(
+        clam_rc = pClamFPtr->fp_cl_scandesc(
+                iFd,
                 (const char*)pszObjectName,
                 (const char**)&virname,
                 &scanned,
@@ -2236,8 +3033,8 @@ static VSA_RC scanFile(
                 pUsrData->pScanInfo->uiInfections++;
                 pUsrData->vsa_rc = VSA_E_VIRUS_FOUND;
                 if(pUsrData->pvFncptr)
-                    pUsrData->vsa_rc = (VSA_RC)pUsrData->pvFncptr((VSA_ENGINE)pEngine,(VS_MESSAGE_T)VS_M_VIRUS,pUsrData->pScanInfo->pVirusInfo,(VSA_USRDATA)pUsrData->pvUsrdata);
-                if(pUsrData->vsa_rc == VS_CB_NEXT || pUsrData->vsa_rc == VS_CB_TERMINATE)
+                    _vsa_rc = (VS_CALLRC)pUsrData->pvFncptr((VSA_ENGINE)pEngine,(VS_MESSAGE_T)VS_M_VIRUS,pUsrData->pScanInfo->pVirusInfo,(VSA_USRDATA)pUsrData->pvUsrdata);
+                if(_vsa_rc == VS_CB_NEXT || _vsa_rc == VS_CB_TERMINATE)
                     CLEANUP(VSA_E_CBC_TERMINATED);
             }
             CLEANUP(VSA_E_VIRUS_FOUND);
@@ -2255,16 +3052,15 @@ static VSA_RC scanCompressed(
     PChar           errorReason)
 {
     VSA_RC          rc = VSA_OK;
-    int             counter = 0;
-    size_t          lLength = 0;
+    VSA_RC          rcPool = VSA_OK;
+    size_t          lLimit = lgSarEntryMax;
+    Bool            bNotScanned = FALSE;
     PChar           pszFileName = NULL;
-    Char            szExt[EXT_LN] = ".*";
-    PByte           _decompr = NULL;
-    Char            szMimeType[MIME_LN] = "unknown/unknown";
-    struct SAREntry *_loc = NULL,
-        *sentry = ParseEntriesFromFile(pszObjectName);
+    PSARPOOL        pPool = NULL;
+    struct SARIterator *pSar = SarOpenFile(pszObjectName);
+    struct SAREntry *_loc = SarNextEntry(pSar);
 
-    if(sentry == NULL) {
+    if(_loc == NULL) {
         if(pUsrData->bMimeCheck == TRUE || pUsrData->bScanAllFiles == TRUE)
         {
             if(pUsrData != NULL && pUsrData->pScanInfo != NULL) {
@@ -2301,8 +3097,17 @@ static VSA_RC scanCompressed(
             CLEANUP(VSA_E_SCAN_FAILED);
         }
     }
-    _loc = sentry;
+    /* VS_OP_SCANEXTRACT_SIZE replaces the ceiling of CLAMSAP_SAR_ENTRY_MAX */
+    if(pUsrData->tLimits.llMaxFileSize > 0)
+        lLimit = (size_t)pUsrData->tLimits.llMaxFileSize;
+    /* with CLAMSAP_SAR_WORKERS the entries are scanned by the pool */
+    pPool = vsaOpenSarPool(pEngine,pszObjectName,NULL,0,pUsrData);
     while(_loc != NULL) {
+        if(pPool != NULL && _loc->type != FT_RG) {
+            /* the results of the queued entries come first */
+            rcPool = vsaMergeSarPool(pPool,0,pUsrData,errorReason,&rc);
+            if(rcPool) CLEANUP(rcPool);
+        }
         if(_loc->type != FT_RG) {
             if(_loc->type != FT_RG) {
                 addScanError(uiJobID,
@@ -2315,206 +3120,1084 @@ static VSA_RC scanCompressed(
                 CLEANUP(VSA_E_NOT_SCANNED);
             }
         }
-        if(_decompr == NULL) {
-            _decompr = (PByte)malloc(_loc->uncompressed_size);
-        }
-        else {
-            _decompr = (PByte)realloc(_decompr,_loc->uncompressed_size);
-        }
-        if(_decompr == NULL) {
-            sprintf((char*)errorReason,"The file buffer for %256s cannot be allocated",_loc->name);
-            CLEANUP(VSA_E_SCAN_FAILED);
-        }
-        lLength = _loc->uncompressed_size;
         pszFileName = (PChar)_loc->name;
-        _loc = _loc->next;
-        lLength = ExtractEntryFromFile(pszObjectName,counter++,_decompr,lLength);
-        if(lLength == 0)
+        if(_loc->uncompressed_size > lLimit)
         {
-            addScanError(uiJobID,
-                pszObjectName,
-                lLength,
-                13,
-                (PChar)"Not extracted",
-                pUsrData->pScanInfo->uiScanErrors,
-                &pUsrData->pScanInfo->pScanError);
-            pUsrData->pScanInfo->uiScanErrors++;
-            pUsrData->pScanInfo->uiNotScanned++;
-            CLEANUP(VSA_E_NOT_SCANNED);
+            /* the entries after it are still checked and scanned */
+            rcPool = addNotScanned(uiJobID,
+                pszFileName,
+                _loc->uncompressed_size,
+                (PChar)"Not scanned: limit",
+                pUsrData->pScanInfo);
+            if(rcPool) CLEANUP(rcPool);
+            bNotScanned = TRUE;
+            _loc = SarNextEntry(pSar);
+            continue;
         }
-        else
+        if(pPool != NULL)
         {
-            Bool text = TRUE;
-            int status = 1;
-            VS_OBJECTTYPE_T a = VS_OT_UNKNOWN;
-            VS_OBJECTTYPE_T b = VS_OT_UNKNOWN;
-            rc = getFileType(pszFileName,szExt,szMimeType,&a);
-            if(rc) CLEANUP(rc);
-            rc = getByteType(_decompr,lLength,NULL,NULL,szExt,szMimeType,0,&status,&text,&a,&b,&pUsrData->tFileType,&pUsrData->tObjectType);
-            if(rc) CLEANUP(rc);
-            rc = addContentInfo(uiJobID,
-                pszFileName!=NULL?pszFileName:sentry->name,
-                lLength,
-                pUsrData->tObjectType,
-                szExt,
-                szMimeType,
-                NULL,
-                pUsrData->pScanInfo->uiScanned++,
-                &pUsrData->pScanInfo->pContentInfo);
-            if(rc) CLEANUP(rc);
-            /*
-            * Comment:
-            * Perform the Active Content Check inside of archive
-            */
-            if(pUsrData->bActiveContent == TRUE && pUsrData->bScanAllFiles == TRUE && pUsrData->bScanCompressed == TRUE)
-            {
-                rc = check4ActiveContent(
-                    _decompr,
-                    lLength,
-                    pUsrData->tObjectType,
-                    pUsrData->bPdfAllowOpenAction);
-                if(rc) CLEANUP(rc);
-            }
-            /*
-            * Comment:
-            * Perform the MIME Check inside of archive
-            */
-            if(pUsrData->bMimeCheck == TRUE && pUsrData->bScanAllFiles == TRUE && pUsrData->bScanCompressed == TRUE)
-            {
-                Char szErrorName[1024];
-                Char szErrorFreeName[1024];
-                rc = checkContentType(
-                    szExt,
-                    szMimeType,
-                    pUsrData->pszScanMimeTypes,
-                    pUsrData->pszBlockMimeTypes,
-                    pUsrData->pszScanExtensions,
-                    pUsrData->pszBlockExtensions,
-                    pUsrData->bScanMimeTypesWildCard,
-                    pUsrData->bBlockMimeTypesWildCard,
-                    szErrorName,
-                    szErrorFreeName);
-                if(rc) CLEANUP(rc);
-            }
-            {
-                FILE *fpOut = NULL;
-                Char szFileName[1024];
-                Char szEntryName[512];
-                PChar  _tmpPath = NULL; /* CCQ_OFF */
-                if(getenv("TMPDIR") == NULL) {
-#ifdef _WIN32
-                    _tmpPath = (PChar)strdup(".");
-#else
-                    _tmpPath = (PChar)strdup("/tmp");
-#endif
-                } else {
-                    _tmpPath = (PChar)strdup(getenv("TMPDIR"));
-                }
-                sprintf((char*)szFileName,"%.500s%.10s%.510s",(char*)_tmpPath, DIR_SEP, (char*)getCleanFilePatch(sentry->name, 511, (PChar)&szEntryName));
-                if(_tmpPath) free(_tmpPath);
-
-                fpOut = fopen((const char*)szFileName,"wb");
-                if(fpOut != NULL) {
-                    fwrite(_decompr,1,lLength,fpOut);
-                    fclose(fpOut);
-                }
-                rc = scanFile(
-                    pEngine,
-                    pUsrData->uiJobID,
-                    szFileName,
-                    pUsrData,
-                    errorReason);
-                unlink((const char*)szFileName);
-                /* CCQ_ON */
-            }
+            rcPool = vsaQueueSarEntry(
+                pPool,
+                pSar,
+                uiJobID,
+                pszObjectName,
+                pszFileName,
+                _loc->uncompressed_size);
+            if(rcPool) CLEANUP(rcPool);
+            /* the finished entries are merged, the queue stays short */
+            rcPool = vsaMergeSarPool(pPool,2 * pPool->uiWorkers,pUsrData,errorReason,&rc);
+            if(rcPool) CLEANUP(rcPool);
+            _loc = SarNextEntry(pSar);
+            continue;
         }
+        rc = checkSarEntry(
+            uiJobID,
+            pszObjectName,
+            pszFileName,
+            pSar,
+            _loc->uncompressed_size,
+            pUsrData);
+        if(rc) CLEANUP(rc);
+        /* the entry is decompressed block by block while it is scanned */
+        rc = scanSarEntry(
+            pEngine,
+            pUsrData->uiJobID,
+            pszFileName,
+            pSar,
+            _loc->uncompressed_size,
+            pUsrData,
+            errorReason);
+        if(rc == VSA_E_ENTRY_NOT_SCANNED)
+            bNotScanned = TRUE;
+        _loc = SarNextEntry(pSar);
     }
-cleanup:
-    if(_decompr) {
-        free(_decompr);
-        _decompr = NULL;
+    if(pPool != NULL)
+    {
+        rcPool = vsaMergeSarPool(pPool,0,pUsrData,errorReason,&rc);
+        if(rcPool) CLEANUP(rcPool);
     }
-    FreeInfo(sentry);
+    if(bNotScanned == TRUE && rc == VSA_OK)
+        rc = VSA_E_ENTRY_NOT_SCANNED;
+cleanup:
+    vsaCloseSarPool(pPool);
+    SarClose(pSar);
     return rc;
 } /* scanCompressed */
 
-static VSA_RC vsaSetContentTypeParametes(VSA_OPTPARAM *param,
-    USRDATA *pUsrData
-    )
+static VSA_RC scanBuffer(
+    void           *pEngine,
+    UInt            uiJobID,
+    PChar           pszObjectName,
+    PByte           pObject,
+    size_t          lObjectSize,
+    USRDATA        *pUsrData,
+    PChar           errorReason)
 {
-    PChar dest = NULL;
-    Bool  mime = FALSE;
-    PChar in = (PChar)param->pvValue;
-    size_t inlen = 0;
-    UInt i = 0;
-
-    if(in == NULL) return VSA_OK;
-    inlen = strlen((const char*)in);
-    dest = (PChar)calloc(1,inlen * 2);
-    if(dest == NULL) return VSA_E_NO_SPACE;
+    int         clam_rc  = 0;
+    const char *virname  = NULL;
+    VSA_RC           rc  = VSA_OK;
+    VS_CALLRC   _vsa_rc  = VS_CB_OK;
+    unsigned long int scanned = 0;
+    if(pUsrData == NULL)
+        return VSA_E_NULL_PARAM;
 
-    switch(param->tCode)
+    if(pUsrData->tObjectType == VS_OT_SAR)
     {
-    case VS_OP_SCANMIMETYPES:
-        pUsrData->pszScanMimeTypes = dest;
-        mime = TRUE;
-        break;
-    case VS_OP_SCANEXTENSIONS:
-        pUsrData->pszScanExtensions = dest;
-        mime = FALSE;
-        break;
-    case VS_OP_BLOCKMIMETYPES:
-        pUsrData->pszBlockMimeTypes = dest;
-        mime = TRUE;
-        break;
-    case VS_OP_BLOCKEXTENSIONS:
-        pUsrData->pszBlockExtensions = dest;
-        mime = FALSE;
-        break;
-    default:
-        free(dest);
-        return VSA_OK;
+        if(pUsrData->bScanAllFiles == FALSE && pUsrData->bScanBestEffort == FALSE && pUsrData->bScanCompressed == FALSE)
+            CLEANUP(VSA_E_NOT_SCANNED);
+
+        rc = scanCompressedBuffer(
+            pEngine,
+            uiJobID,
+            pszObjectName,
+            pObject,
+            lObjectSize,
+            NULL,
+            pUsrData,
+            errorReason);
     }
-    for(i = 0; i < inlen; i++)
+    else
     {
-        if(i == 0 && mime == FALSE && in[i] != '.')
-        {
-            addScanError(0,(PChar)in,0,-1,(PChar)"Invalid extension",pUsrData->pScanInfo->uiScanErrors++,&pUsrData->pScanInfo->pScanError);
-            return VSA_E_INVALID_PARAM;
-        }
-        dest[i] = tolower((int)in[i]);
-        if (mime == TRUE && in[i] == '*')
+        /*
+        * Scan buffer, without a copy to a file
+        */
+        clam_rc = vsaScanMemory(
+                (const struct cl_engine *)pEngine,
+                pszObjectName,
+                pObject,
+                lObjectSize,
+                &virname,
+                &scanned,
+                pUsrData);
+        if(clam_rc != CL_CLEAN)
         {
-            if (param->tCode == VS_OP_SCANMIMETYPES)
+            sprintf((char*)errorReason,"%s",(PChar)pClamFPtr->fp_cl_strerror(clam_rc));
+            switch(clam_rc)
             {
-                pUsrData->bScanMimeTypesWildCard = TRUE;
+            case CL_VIRUS: rc = VSA_E_VIRUS_FOUND;
+                break;
+            default:       rc = VSA_E_SCAN_FAILED;
+                sprintf((char*)errorReason,"ClamAV engine with internal,unknown error.");
+                break;
             }
-            else if (param->tCode == VS_OP_BLOCKMIMETYPES)
-            {
-                pUsrData->bBlockMimeTypesWildCard = TRUE;
+        }
+        else
+        {
+            rc = VSA_OK;
+        }
+        /*
+        * After the scan
+        */
+        if(clam_rc == CL_VIRUS)
+        {
+            if(pUsrData != NULL && pUsrData->pScanInfo != NULL) {
+                rc = addVirusInfo(uiJobID,
+                    pszObjectName,
+                    pUsrData->lObjectSize,
+                    FALSE,
+                    VS_DT_KNOWNVIRUS,
+                    VS_VT_TEST,
+                    pUsrData->tObjectType,
+                    VS_AT_NOACTION,
+                    0,
+                    (PChar)virname,
+                    (PChar)"No info available",
+                    pUsrData->pScanInfo->uiInfections,
+                    &pUsrData->pScanInfo->pVirusInfo);
+                if(rc) CLEANUP(rc);
+                pUsrData->pScanInfo->uiInfections++;
+                pUsrData->vsa_rc = VSA_E_VIRUS_FOUND;
+                if(pUsrData->pvFncptr)
+                    _vsa_rc = (VS_CALLRC)pUsrData->pvFncptr((VSA_ENGINE)pEngine,(VS_MESSAGE_T)VS_M_VIRUS,pUsrData->pScanInfo->pVirusInfo,(VSA_USRDATA)pUsrData->pvUsrdata);
+                if(_vsa_rc == VS_CB_NEXT || _vsa_rc == VS_CB_TERMINATE)
+                    CLEANUP(VSA_E_CBC_TERMINATED);
             }
+            CLEANUP(VSA_E_VIRUS_FOUND);
         }
     }
-    if(i>0 && i < (inlen * 2) && dest[i] != ';')
-        dest[i] = ';';
-    return VSA_OK;
-} /* vsaSetContentTypeParametes */
-#endif
+cleanup:
+    return rc;
+} /* scanBuffer */
 
-static VSA_RC vsaSetInitConfig(VSA_INITPARAMS *p_intparams,
-                               INITDATA *usrdata
-                               )
+static VSA_RC scanCompressedBuffer(
+    void           *pEngine,
+    UInt            uiJobID,
+    PChar           pszObjectName,
+    PByte           pObject,
+    size_t          lObjectSize,
+    struct SARIterator *pOuter,
+    USRDATA        *pUsrData,
+    PChar           errorReason)
 {
-    VSA_RC     rc        = VSA_OK;
-    Int        i         = 0,
-               arraysize = (p_intparams?p_intparams->usInitParams:0);
-    /*
-     * set the initial setting
-     */
-    for (i=0; i<arraysize; i++)
-    {
-        switch (p_intparams->pInitParam[i].tCode)
-        {
+    VSA_RC          rc = VSA_OK;
+    VSA_RC          rcPool = VSA_OK;
+    size_t          lLimit = lgSarEntryMax;
+    Bool            bNotScanned = FALSE;
+    PChar           pszFileName = NULL;
+    PSARPOOL        pPool = NULL;
+    struct SARIterator *pSar = pOuter != NULL ? SarOpenEntry(pOuter) : SarOpenBuffer(pObject,lObjectSize);
+    struct SAREntry *_loc = SarNextEntry(pSar);
+
+    if(_loc == NULL) {
+        if(pUsrData->bMimeCheck == TRUE || pUsrData->bScanAllFiles == TRUE)
+        {
+            if(pUsrData != NULL && pUsrData->pScanInfo != NULL) {
+                rc = addVirusInfo(uiJobID,
+                    pszObjectName,
+                    pUsrData->lObjectSize,
+                    FALSE,
+                    VS_DT_MIMEVALIDATION,
+                    VS_VT_CORRUPTED,
+                    pUsrData->tObjectType,
+                    VS_AT_BLOCKED,
+                    0,
+                    (PChar)"Corrupted SAR",
+                    (PChar)"The archive structure is invalid",
+                    pUsrData->pScanInfo->uiInfections,
+                    &(pUsrData->pScanInfo->pVirusInfo));
+                if(rc) CLEANUP(rc);
+                pUsrData->pScanInfo->uiInfections++;
+                pUsrData->vsa_rc = VSA_E_BLOCKED_BY_POLICY;
+            }
+            CLEANUP(VSA_E_BLOCKED_BY_POLICY);
+        }
+        else
+        {
+            if(pUsrData != NULL && pUsrData->pScanInfo != NULL) {
+                addScanError(uiJobID,
+                    pszObjectName,
+                    pUsrData->lObjectSize,
+                    13,
+                    (PChar)"Corrupted SAR file",
+                    pUsrData->pScanInfo->uiScanErrors++,
+                    &pUsrData->pScanInfo->pScanError);
+            }
+            CLEANUP(VSA_E_SCAN_FAILED);
+        }
+    }
+    /* VS_OP_SCANEXTRACT_SIZE replaces the ceiling of CLAMSAP_SAR_ENTRY_MAX */
+    if(pUsrData->tLimits.llMaxFileSize > 0)
+        lLimit = (size_t)pUsrData->tLimits.llMaxFileSize;
+    /* with CLAMSAP_SAR_WORKERS the entries are scanned by the pool,
+     * an archive inside an entry is read only through the outer one
+     */
+    if(pOuter == NULL)
+        pPool = vsaOpenSarPool(pEngine,NULL,pObject,lObjectSize,pUsrData);
+    while(_loc != NULL) {
+        if(pPool != NULL && _loc->type != FT_RG) {
+            /* the results of the queued entries come first */
+            rcPool = vsaMergeSarPool(pPool,0,pUsrData,errorReason,&rc);
+            if(rcPool) CLEANUP(rcPool);
+        }
+        if(_loc->type != FT_RG) {
+            if(_loc->type != FT_RG) {
+                addScanError(uiJobID,
+                    (PChar)_loc->name,
+                    strlen((const char*)_loc->name),
+                    13,
+                    (PChar)"Not supported yet",
+                    pUsrData->pScanInfo->uiScanErrors,
+                    &pUsrData->pScanInfo->pScanError);
+                CLEANUP(VSA_E_NOT_SCANNED);
+            }
+        }
+        pszFileName = (PChar)_loc->name;
+        if(_loc->uncompressed_size > lLimit)
+        {
+            /* the entries after it are still checked and scanned */
+            rcPool = addNotScanned(uiJobID,
+                pszFileName,
+                _loc->uncompressed_size,
+                (PChar)"Not scanned: limit",
+                pUsrData->pScanInfo);
+            if(rcPool) CLEANUP(rcPool);
+            bNotScanned = TRUE;
+            _loc = SarNextEntry(pSar);
+            continue;
+        }
+        if(pPool != NULL)
+        {
+            rcPool = vsaQueueSarEntry(
+                pPool,
+                pSar,
+                uiJobID,
+                pszObjectName,
+                pszFileName,
+                _loc->uncompressed_size);
+            if(rcPool) CLEANUP(rcPool);
+            /* the finished entries are merged, the queue stays short */
+            rcPool = vsaMergeSarPool(pPool,2 * pPool->uiWorkers,pUsrData,errorReason,&rc);
+            if(rcPool) CLEANUP(rcPool);
+            _loc = SarNextEntry(pSar);
+            continue;
+        }
+        rc = checkSarEntry(
+            uiJobID,
+            pszObjectName,
+            pszFileName,
+            pSar,
+            _loc->uncompressed_size,
+            pUsrData);
+        if(rc) CLEANUP(rc);
+        /* the entry is decompressed block by block while it is scanned */
+        rc = scanSarEntry(
+            pEngine,
+            pUsrData->uiJobID,
+            pszFileName,
+            pSar,
+            _loc->uncompressed_size,
+            pUsrData,
+            errorReason);
+        if(rc == VSA_E_ENTRY_NOT_SCANNED)
+            bNotScanned = TRUE;
+        _loc = SarNextEntry(pSar);
+    }
+    if(pPool != NULL)
+    {
+        rcPool = vsaMergeSarPool(pPool,0,pUsrData,errorReason,&rc);
+        if(rcPool) CLEANUP(rcPool);
+    }
+    if(bNotScanned == TRUE && rc == VSA_OK)
+        rc = VSA_E_ENTRY_NOT_SCANNED;
+cleanup:
+    vsaCloseSarPool(pPool);
+    SarClose(pSar);
+    return rc;
+} /* scanCompressedBuffer */
+
+/**********************************************************************
+ *  checkSarEntry()
+ *
+ *  Description:
+ *     Runs the type detection, the active content and the MIME check
+ *     on the current entry of the SAR iterator. The entry is
+ *     decompressed block by block, only the active content check
+ *     needs all blocks. The iterator is positioned at the beginning
+ *     of the entry again for scanSarEntry.
+ *
+ **********************************************************************/
+static VSA_RC checkSarEntry(
+    UInt                uiJobID,
+    PChar               pszObjectName,
+    PChar               pszFileName,
+    struct SARIterator *pSar,
+    size_t              lLength,
+    USRDATA            *pUsrData)
+{
+    VSA_RC          rc = VSA_OK;
+    Char            szExt[EXT_LN] = ".*";
+    Char            szMimeType[MIME_LN] = "unknown/unknown";
+    Bool            text = TRUE;
+    int             status = 1;
+    VS_OBJECTTYPE_T a = VS_OT_UNKNOWN;
+    VS_OBJECTTYPE_T b = VS_OT_UNKNOWN;
+    Bool            bActive = FALSE;
+    int             iBlock = 0;
+    PByte           pbBlock = NULL;
+    size_t          lBlock = 0;
+    size_t          lRead = 0;
+
+    if(pUsrData->bActiveContent == TRUE && pUsrData->bScanAllFiles == TRUE && pUsrData->bScanCompressed == TRUE)
+        bActive = TRUE;
+    rc = getFileType(pszFileName,szExt,szMimeType,&a);
+    if(rc) CLEANUP(rc);
+    do {
+        iBlock = SarReadBlock(pSar,&pbBlock,&lBlock);
+        if(iBlock <= 0)
+            break;
+        lRead += lBlock;
+        rc = getByteType(pbBlock,lBlock,NULL,NULL,szExt,szMimeType,0,&status,&text,&a,&b,&pUsrData->tFileType,&pUsrData->tObjectType);
+        if(rc) CLEANUP(rc);
+        /*
+        * Comment:
+        * Perform the Active Content Check inside of archive
+        */
+        if(bActive == TRUE)
+        {
+            rc = check4ActiveContent(
+                pbBlock,
+                lBlock,
+                pUsrData->tObjectType,
+                pUsrData->bPdfAllowOpenAction);
+            if(rc) CLEANUP(rc);
+        }
+    } while(bActive == TRUE);
+    if(iBlock < 0 || lRead == 0 || SarRewindEntry(pSar) == FALSE)
+    {
+        rc = addNotScanned(uiJobID,
+            pszObjectName,
+            0,
+            (PChar)"Not extracted",
+            pUsrData->pScanInfo);
+        if(rc) CLEANUP(rc);
+        CLEANUP(VSA_E_ENTRY_NOT_SCANNED);
+    }
+    rc = addContentInfo(uiJobID,
+        pszFileName,
+        lLength,
+        pUsrData->tObjectType,
+        szExt,
+        szMimeType,
+        NULL,
+        pUsrData->pScanInfo->uiScanned++,
+        &pUsrData->pScanInfo->pContentInfo);
+    if(rc) CLEANUP(rc);
+    /*
+    * Comment:
+    * Perform the MIME Check inside of archive
+    */
+    if(pUsrData->bMimeCheck == TRUE && pUsrData->bScanAllFiles == TRUE && pUsrData->bScanCompressed == TRUE)
+    {
+        Char szErrorName[1024];
+        Char szErrorFreeName[1024];
+        rc = checkContentType(
+            szExt,
+            szMimeType,
+            pUsrData->pszScanMimeTypes,
+            pUsrData->pszBlockMimeTypes,
+            pUsrData->pszScanExtensions,
+            pUsrData->pszBlockExtensions,
+            pUsrData->bScanMimeTypesWildCard,
+            pUsrData->bBlockMimeTypesWildCard,
+            szErrorName,
+            szErrorFreeName);
+        if(rc) CLEANUP(rc);
+    }
+cleanup:
+    return rc;
+} /* checkSarEntry */
+
+/**********************************************************************
+ *  scanSarEntry()
+ *
+ *  Description:
+ *     Scans the current entry of the SAR iterator. libclamav pulls the
+ *     entry through a handle map, see vsaReadSarEntry, so that only
+ *     one decompressed block is held. An archive inside the archive
+ *     is read by scanCompressedBuffer through this entry, too.
+ *
+ **********************************************************************/
+static VSA_RC scanSarEntry(
+    void               *pEngine,
+    UInt                uiJobID,
+    PChar               pszFileName,
+    struct SARIterator *pSar,
+    size_t              lLength,
+    USRDATA            *pUsrData,
+    PChar               errorReason)
+{
+    int         clam_rc  = 0;
+    const char *virname  = NULL;
+    VSA_RC           rc  = VSA_OK;
+    VS_CALLRC   _vsa_rc  = VS_CB_OK;
+    unsigned long int scanned = 0;
+    SARSTREAM   tStream;
+
+    if(pUsrData->tObjectType == VS_OT_SAR)
+    {
+        if(pUsrData->bScanAllFiles == FALSE && pUsrData->bScanBestEffort == FALSE && pUsrData->bScanCompressed == FALSE)
+            CLEANUP(VSA_E_NOT_SCANNED);
+
+        rc = scanCompressedBuffer(
+            pEngine,
+            uiJobID,
+            pszFileName,
+            NULL,
+            lLength,
+            pSar,
+            pUsrData,
+            errorReason);
+        CLEANUP(rc);
+    }
+    memset(&tStream,0,sizeof(SARSTREAM));
+    tStream.pSar    = pSar;
+    tStream.lLength = lLength;
+    clam_rc = vsaScanSarEntry(
+            (const struct cl_engine *)pEngine,
+            pszFileName,
+            &tStream,
+            &virname,
+            &scanned,
+            pUsrData);
+    if(clam_rc != CL_CLEAN)
+    {
+        sprintf((char*)errorReason,"%s",(PChar)pClamFPtr->fp_cl_strerror(clam_rc));
+        switch(clam_rc)
+        {
+        case CL_VIRUS: rc = VSA_E_VIRUS_FOUND;
+            break;
+        default:       rc = VSA_E_SCAN_FAILED;
+            sprintf((char*)errorReason,"ClamAV engine with internal,unknown error.");
+            break;
+        }
+    }
+    else
+    {
+        rc = VSA_OK;
+    }
+    /*
+    * After the scan
+    */
+    if(clam_rc == CL_VIRUS)
+    {
+        if(pUsrData != NULL && pUsrData->pScanInfo != NULL) {
+            rc = addVirusInfo(uiJobID,
+                pszFileName,
+                pUsrData->lObjectSize,
+                FALSE,
+                VS_DT_KNOWNVIRUS,
+                VS_VT_TEST,
+                pUsrData->tObjectType,
+                VS_AT_NOACTION,
+                0,
+                (PChar)virname,
+                (PChar)"No info available",
+                pUsrData->pScanInfo->uiInfections,
+                &pUsrData->pScanInfo->pVirusInfo);
+            if(rc) CLEANUP(rc);
+            pUsrData->pScanInfo->uiInfections++;
+            pUsrData->vsa_rc = VSA_E_VIRUS_FOUND;
+            if(pUsrData->pvFncptr)
+                _vsa_rc = (VS_CALLRC)pUsrData->pvFncptr((VSA_ENGINE)pEngine,(VS_MESSAGE_T)VS_M_VIRUS,pUsrData->pScanInfo->pVirusInfo,(VSA_USRDATA)pUsrData->pvUsrdata);
+            if(_vsa_rc == VS_CB_NEXT || _vsa_rc == VS_CB_TERMINATE)
+                CLEANUP(VSA_E_CBC_TERMINATED);
+        }
+        CLEANUP(VSA_E_VIRUS_FOUND);
+    }
+cleanup:
+    return rc;
+} /* scanSarEntry */
+
+/**********************************************************************
+ *  vsaReadSarEntry()
+ *
+ *  Description:
+ *     Read callback of the handle map. Serves the request from the
+ *     current block and decompresses the next blocks of the entry
+ *     with SarReadBlock, a read before the block starts the entry
+ *     again. Returns the number of bytes copied, 0 at the end and -1
+ *     if the entry is invalid.
+ *
+ **********************************************************************/
+static off_t vsaReadSarEntry(void *handle, void *buf, size_t count, off_t offset)
+{
+    PSARSTREAM pStream = (PSARSTREAM)handle;
+    size_t     lOffset = (size_t)offset;
+    size_t     lCopied = 0;
+    size_t     lChunk  = 0;
+    int        iBlock  = 0;
+
+    if(pStream == NULL || offset < 0)
+        return -1;
+    if(lOffset >= pStream->lLength)
+        return 0;
+    if(lOffset < pStream->lStart)
+    {
+        /* the blocks are decompressed forward only, start again */
+        if(SarRewindEntry(pStream->pSar) == FALSE)
+            return -1;
+        pStream->lStart = 0;
+        pStream->lFill  = 0;
+        pStream->bEof   = FALSE;
+    }
+    while(lCopied < count && pStream->bEof == FALSE)
+    {
+        if(lOffset + lCopied >= pStream->lStart + pStream->lFill)
+        {
+            pStream->lStart += pStream->lFill;
+            pStream->lFill   = 0;
+            iBlock = SarReadBlock(pStream->pSar,&pStream->pbBlock,&pStream->lFill);
+            if(iBlock < 0)
+                return -1;
+            if(iBlock == 0)
+                pStream->bEof = TRUE;
+            continue;
+        }
+        lChunk = pStream->lStart + pStream->lFill - (lOffset + lCopied);
+        if(lChunk > count - lCopied)
+            lChunk = count - lCopied;
+        memcpy((PByte)buf + lCopied,pStream->pbBlock + (lOffset + lCopied - pStream->lStart),lChunk);
+        lCopied += lChunk;
+    }
+    return (off_t)lCopied;
+} /* vsaReadSarEntry */
+
+/**********************************************************************
+ *  vsaScanSarEntry()
+ *
+ *  Description:
+ *     Scans the SAR entry through a handle map of libclamav, which
+ *     pulls the data with vsaReadSarEntry. Returns the ClamAV return
+ *     code.
+ *
+ **********************************************************************/
+static int vsaScanSarEntry(const struct cl_engine *engine,
+                           PChar              pszObjectName,
+                           PSARSTREAM         pStream,
+                           const char       **pVirname,
+                           unsigned long int *pScanned,
+                           USRDATA           *pUsrData)
+{
+    int         clam_rc = CL_CLEAN;
+    cl_fmap_t  *map     = NULL;
+
+    if(pStream->lLength == 0)
+        return CL_CLEAN; /* nothing to map */
+    map = pClamFPtr->fp_cl_fmap_open_handle((void*)pStream,0,pStream->lLength,vsaReadSarEntry,1);
+    if(map == NULL)
+        return CL_EMAP;
+    /* CCQ_OFF */
+#ifdef CL_SCAN_STDOPT
+    clam_rc = pClamFPtr->fp_cl_scanmap_callback(map,pVirname,pScanned,engine,CL_SCAN_STDOPT,NULL);
+#else
+    clam_rc = pClamFPtr->fp_cl_scanmap_callback(map,(const char*)pszObjectName,pVirname,pScanned,engine,&pUsrData->cl_scan_options,NULL);
+#endif
+    /* CCQ_ON */
+    pClamFPtr->fp_cl_fmap_close(map);
+    return clam_rc;
+} /* vsaScanSarEntry */
+
+/**********************************************************************
+ *  vsaOpenSarPool()
+ *
+ *  Description:
+ *     Starts the workers for the entries of a SAR archive, either of
+ *     the file pszArchive or of the buffer pObject. Returns NULL if
+ *     the entries are scanned by the caller: CLAMSAP_SAR_WORKERS is
+ *     not set, all workers of the process are in use or the scan
+ *     returns no VSA_SCANINFO.
+ *
+ **********************************************************************/
+static PSARPOOL vsaOpenSarPool(void          *pEngine,
+                               PChar          pszArchive,
+                               PByte          pObject,
+                               size_t         lObjectSize,
+                               USRDATA       *pUsrData)
+{
+    PSARPOOL pPool     = NULL;
+    UInt     uiWorkers = 0;
+
+    if(uigSarWorkers == 0 || pUsrData->pScanInfo == NULL)
+        return NULL;
+    VSA_LOCK(&tSarLock);
+    if(uigSarWorkersUsed < uigSarWorkersMax)
+        uiWorkers = uigSarWorkersMax - uigSarWorkersUsed;
+    if(uiWorkers > uigSarWorkers)
+        uiWorkers = uigSarWorkers;
+    uigSarWorkersUsed += uiWorkers;
+    VSA_UNLOCK(&tSarLock);
+    if(uiWorkers == 0)
+        return NULL;
+    pPool = (PSARPOOL)calloc(1,sizeof(SARPOOL));
+    if(pPool == NULL) {
+        VSA_LOCK(&tSarLock);
+        uigSarWorkersUsed -= uiWorkers;
+        VSA_UNLOCK(&tSarLock);
+        return NULL;
+    }
+    VSA_MUTEX_INIT(&pPool->tLock);
+    VSA_COND_INIT(&pPool->tCond);
+    pPool->pEngine     = pEngine;
+    pPool->pszArchive  = pszArchive;
+    pPool->pObject     = pObject;
+    pPool->lObjectSize = lObjectSize;
+    /* all entries start with the settings of the archive */
+    pPool->tUsrData    = (*pUsrData);
+    pPool->tUsrData.pScanInfo = NULL;
+    pPool->tUsrData.pvFncptr  = NULL; /* the callback follows the merge */
+    pPool->tUsrData.vsa_rc    = VSA_OK;
+    VSA_LOCK(&pPool->tLock);
+    while(pPool->uiWorkers < uiWorkers)
+    {
+        if(vsaStartThread(vsaSarWorker,pPool) != VSA_OK)
+            break;
+        pPool->uiWorkers++;
+        pPool->uiRunning++;
+    }
+    VSA_UNLOCK(&pPool->tLock);
+    VSA_LOCK(&tSarLock);
+    uigSarWorkersUsed -= uiWorkers - pPool->uiWorkers;
+    VSA_UNLOCK(&tSarLock);
+    if(pPool->uiWorkers == 0) {
+        vsaCloseSarPool(pPool);
+        return NULL;
+    }
+    return pPool;
+} /* vsaOpenSarPool */
+
+/**********************************************************************
+ *  vsaQueueSarEntry()
+ *
+ *  Description:
+ *     Queues the current entry of the iterator for the workers.
+ *
+ **********************************************************************/
+static VSA_RC vsaQueueSarEntry(PSARPOOL            pPool,
+                               struct SARIterator *pSar,
+                               UInt                uiJobID,
+                               PChar               pszObjectName,
+                               PChar               pszFileName,
+                               size_t              lLength)
+{
+    PSARJOB  pJob   = NULL;
+    PSARJOB *ppJobs = NULL;
+    UInt     uiAlloc = 0;
+
+    pJob = (PSARJOB)calloc(1,sizeof(SARJOB));
+    if(pJob == NULL)
+        return VSA_E_NO_SPACE;
+    pJob->pszFileName = (PChar)strdup((const char*)pszFileName);
+    if(pJob->pszFileName == NULL) {
+        free(pJob);
+        return VSA_E_NO_SPACE;
+    }
+    SarMarkEntry(pSar,&pJob->tMark);
+    pJob->uiJobID       = uiJobID;
+    pJob->pszObjectName = pszObjectName;
+    pJob->lLength       = lLength;
+    pJob->tUsrData      = pPool->tUsrData;
+    pJob->tUsrData.pScanInfo = &pJob->tScanInfo;
+    pJob->tScanInfo.struct_size = sizeof(VSA_SCANINFO);
+    pJob->tScanInfo.uiJobID     = uiJobID;
+    VSA_LOCK(&pPool->tLock);
+    if(pPool->uiJobs == pPool->uiAlloc)
+    {
+        uiAlloc = pPool->uiAlloc > 0 ? pPool->uiAlloc * 2 : 64;
+        ppJobs  = (PSARJOB*)realloc(pPool->ppJobs,uiAlloc * sizeof(PSARJOB));
+        if(ppJobs == NULL) {
+            VSA_UNLOCK(&pPool->tLock);
+            freeSARJOB(&pJob);
+            return VSA_E_NO_SPACE;
+        }
+        pPool->ppJobs  = ppJobs;
+        pPool->uiAlloc = uiAlloc;
+    }
+    pPool->ppJobs[pPool->uiJobs++] = pJob;
+    VSA_COND_SIGNAL(&pPool->tCond);
+    VSA_UNLOCK(&pPool->tLock);
+    return VSA_OK;
+} /* vsaQueueSarEntry */
+
+/**********************************************************************
+ *  vsaMergeSarPool()
+ *
+ *  Description:
+ *     Merges the results of the finished entries in archive order into
+ *     the scan and calls the virus callback for them. It waits until
+ *     at most uiQueued entries are left, 0 waits for all.
+ *     *pRc receives the return code of the last merged entry, as the
+ *     sequential scan. A failed check of an entry stops the archive,
+ *     then its return code is returned.
+ *
+ **********************************************************************/
+static VSA_RC vsaMergeSarPool(PSARPOOL       pPool,
+                              UInt           uiQueued,
+                              USRDATA       *pUsrData,
+                              PChar          errorReason,
+                              VSA_RC        *pRc)
+{
+    PSARJOB   pJob    = NULL;
+    VSA_RC    rc      = VSA_OK;
+    VS_CALLRC _vsa_rc = VS_CB_OK;
+
+    for(;;)
+    {
+        pJob = NULL;
+        VSA_LOCK(&pPool->tLock);
+        while(pPool->uiMerged < pPool->uiJobs &&
+              pPool->ppJobs[pPool->uiMerged]->bDone == FALSE &&
+              pPool->uiJobs - pPool->uiMerged > uiQueued)
+            VSA_COND_WAIT(&pPool->tCond,&pPool->tLock);
+        if(pPool->uiMerged < pPool->uiJobs && pPool->ppJobs[pPool->uiMerged]->bDone == TRUE)
+            pJob = pPool->ppJobs[pPool->uiMerged];
+        VSA_UNLOCK(&pPool->tLock);
+        if(pJob == NULL)
+            break;
+        rc = mergeScanInfo(pUsrData->pScanInfo,&pJob->tScanInfo);
+        if(rc == VSA_OK)
+            rc = pJob->rcCheck;
+        pUsrData->tFileType   = pJob->tUsrData.tFileType;
+        pUsrData->tObjectType = pJob->tUsrData.tObjectType;
+        if(pJob->szReason[0] != 0)
+            strcpy((char*)errorReason,(const char*)pJob->szReason);
+        if(rc == VSA_OK)
+        {
+            (*pRc) = pJob->rc;
+            if(pJob->tUsrData.vsa_rc == VSA_E_VIRUS_FOUND)
+            {
+                pUsrData->vsa_rc = VSA_E_VIRUS_FOUND;
+                if(pUsrData->pvFncptr)
+                    _vsa_rc = (VS_CALLRC)pUsrData->pvFncptr((VSA_ENGINE)pPool->pEngine,(VS_MESSAGE_T)VS_M_VIRUS,pUsrData->pScanInfo->pVirusInfo,(VSA_USRDATA)pUsrData->pvUsrdata);
+                if(_vsa_rc == VS_CB_NEXT || _vsa_rc == VS_CB_TERMINATE)
+                    (*pRc) = VSA_E_CBC_TERMINATED;
+            }
+        }
+        freeSARJOB(&pPool->ppJobs[pPool->uiMerged]);
+        pPool->uiMerged++;
+        if(rc) break;
+    }
+    return rc;
+} /* vsaMergeSarPool */
+
+/**********************************************************************
+ *  vsaCloseSarPool()
+ *
+ *  Description:
+ *     Stops the workers after their current entry and releases the
+ *     pool with the entries, which are not merged.
+ *
+ **********************************************************************/
+static void vsaCloseSarPool(PSARPOOL pPool)
+{
+    UInt i = 0;
+
+    if(pPool == NULL)
+        return;
+    VSA_LOCK(&pPool->tLock);
+    pPool->bClosed = TRUE;
+    pPool->uiNext  = pPool->uiJobs; /* queued entries are not started */
+    VSA_COND_SIGNAL(&pPool->tCond);
+    while(pPool->uiRunning > 0)
+        VSA_COND_WAIT(&pPool->tCond,&pPool->tLock);
+    VSA_UNLOCK(&pPool->tLock);
+    for(i = pPool->uiMerged; i < pPool->uiJobs; i++)
+        freeSARJOB(&pPool->ppJobs[i]);
+    if(pPool->ppJobs) free(pPool->ppJobs);
+    VSA_LOCK(&tSarLock);
+    uigSarWorkersUsed -= pPool->uiWorkers;
+    VSA_UNLOCK(&tSarLock);
+    VSA_COND_FREE(&pPool->tCond);
+    VSA_MUTEX_FREE(&pPool->tLock);
+    free(pPool);
+} /* vsaCloseSarPool */
+
+/**********************************************************************
+ *  vsaSarWorker()
+ *
+ *  Description:
+ *     Worker of the pool. Opens an own iterator on the archive and
+ *     checks and scans the queued entries until the pool is closed.
+ *
+ **********************************************************************/
+static VSA_THREAD_RC VSA_THREAD_API vsaSarWorker(void *pArg)
+{
+    PSARPOOL            pPool = (PSARPOOL)pArg;
+    PSARJOB             pJob  = NULL;
+    struct SARIterator *pSar  = NULL;
+
+    if(pPool->pObject != NULL)
+        pSar = SarOpenBuffer(pPool->pObject,pPool->lObjectSize);
+    else
+        pSar = SarOpenFile(pPool->pszArchive);
+    VSA_LOCK(&pPool->tLock);
+    for(;;)
+    {
+        while(pPool->uiNext == pPool->uiJobs && pPool->bClosed == FALSE)
+            VSA_COND_WAIT(&pPool->tCond,&pPool->tLock);
+        if(pPool->uiNext == pPool->uiJobs)
+            break;
+        pJob = pPool->ppJobs[pPool->uiNext++];
+        VSA_UNLOCK(&pPool->tLock);
+        /* an entry, which cannot be positioned, is not extracted */
+        SarSeekEntry(pSar,&pJob->tMark);
+        pJob->rcCheck = checkSarEntry(
+            pJob->uiJobID,
+            pJob->pszObjectName,
+            pJob->pszFileName,
+            pSar,
+            pJob->lLength,
+            &pJob->tUsrData);
+        if(pJob->rcCheck == VSA_OK)
+            pJob->rc = scanSarEntry(
+                pPool->pEngine,
+                pJob->tUsrData.uiJobID,
+                pJob->pszFileName,
+                pSar,
+                pJob->lLength,
+                &pJob->tUsrData,
+                pJob->szReason);
+        VSA_LOCK(&pPool->tLock);
+        pJob->bDone = TRUE;
+        VSA_COND_SIGNAL(&pPool->tCond);
+    }
+    pPool->uiRunning--;
+    VSA_COND_SIGNAL(&pPool->tCond);
+    VSA_UNLOCK(&pPool->tLock);
+    SarClose(pSar);
+    return (VSA_THREAD_RC)0;
+} /* vsaSarWorker */
+
+static VSA_RC scanClientIO(
+    void           *pEngine,
+    UInt            uiJobID,
+    PChar           pszObjectName,
+    PCIOSTREAM      pStream,
+    USRDATA        *pUsrData,
+    PChar           errorReason)
+{
+    int         clam_rc  = 0;
+    const char *virname  = NULL;
+    VSA_RC           rc  = VSA_OK;
+    VS_CALLRC   _vsa_rc  = VS_CB_OK;
+    unsigned long int scanned = 0;
+    PByte       pObject  = NULL;
+    size_t      lRead    = 0;
+    size_t      lLimit   = lgStreamMax;
+    off_t       lChunk   = 0;
+    if(pUsrData == NULL || pStream == NULL)
+        return VSA_E_NULL_PARAM;
+
+    if(pUsrData->tObjectType == VS_OT_SAR)
+    {
+        if(pUsrData->bScanAllFiles == FALSE && pUsrData->bScanBestEffort == FALSE && pUsrData->bScanCompressed == FALSE)
+            CLEANUP(VSA_E_NOT_SCANNED);
+        /*
+        * the SAR directory needs random access to the entries,
+        * therefore the archive is read once completely, within the
+        * same limits as an upload stream
+        */
+        if(pUsrData->tLimits.llMaxScanSize > 0 && (size_t)pUsrData->tLimits.llMaxScanSize < lLimit)
+            lLimit = (size_t)pUsrData->tLimits.llMaxScanSize;
+        if(pUsrData->tLimits.llMaxFileSize > 0 && (size_t)pUsrData->tLimits.llMaxFileSize < lLimit)
+            lLimit = (size_t)pUsrData->tLimits.llMaxFileSize;
+        if(pStream->lLength > lLimit)
+        {
+            sprintf((char*)errorReason,"Not scanned: limit");
+            rc = addNotScanned(uiJobID,
+                pszObjectName,
+                pStream->lLength,
+                (PChar)"Not scanned: limit",
+                pUsrData->pScanInfo);
+            if(rc) CLEANUP(rc);
+            CLEANUP(VSA_E_NOT_SCANNED);
+        }
+        pObject = (PByte)malloc(pStream->lLength);
+        if(pObject == NULL)
+            CLEANUP(VSA_E_NO_SPACE);
+        while(lRead < pStream->lLength)
+        {
+            lChunk = vsaReadClientIO(pStream,pObject + lRead,pStream->lLength - lRead,(off_t)lRead);
+            if(lChunk <= 0)
+                break;
+            lRead += (size_t)lChunk;
+        }
+        if(lRead != pStream->lLength) {
+            sprintf((char*)errorReason,"Client I/O read failed");
+            CLEANUP(VSA_E_CIO_FAILED);
+        }
+        rc = scanCompressedBuffer(
+            pEngine,
+            uiJobID,
+            pszObjectName,
+            pObject,
+            lRead,
+            NULL,
+            pUsrData,
+            errorReason);
+    }
+    else
+    {
+        /*
+        * Scan the stream, libclamav pulls the data through the window
+        */
+        clam_rc = vsaScanClientIO(
+                (const struct cl_engine *)pEngine,
+                pszObjectName,
+                pStream,
+                &virname,
+                &scanned,
+                pUsrData);
+        if(clam_rc != CL_CLEAN)
+        {
+            sprintf((char*)errorReason,"%s",(PChar)pClamFPtr->fp_cl_strerror(clam_rc));
+            switch(clam_rc)
+            {
+            case CL_VIRUS: rc = VSA_E_VIRUS_FOUND;
+                break;
+            case CL_EREAD: rc = VSA_E_CIO_FAILED;
+                sprintf((char*)errorReason,"Client I/O read failed");
+                break;
+            default:       rc = VSA_E_SCAN_FAILED;
+                sprintf((char*)errorReason,"ClamAV engine with internal,unknown error.");
+                break;
+            }
+        }
+        else
+        {
+            rc = VSA_OK;
+        }
+        /*
+        * After the scan
+        */
+        if(clam_rc == CL_VIRUS)
+        {
+            if(pUsrData != NULL && pUsrData->pScanInfo != NULL) {
+                rc = addVirusInfo(uiJobID,
+                    pszObjectName,
+                    pUsrData->lObjectSize,
+                    FALSE,
+                    VS_DT_KNOWNVIRUS,
+                    VS_VT_TEST,
+                    pUsrData->tObjectType,
+                    VS_AT_NOACTION,
+                    0,
+                    (PChar)virname,
+                    (PChar)"No info available",
+                    pUsrData->pScanInfo->uiInfections,
+                    &pUsrData->pScanInfo->pVirusInfo);
+                if(rc) CLEANUP(rc);
+                pUsrData->pScanInfo->uiInfections++;
+                pUsrData->vsa_rc = VSA_E_VIRUS_FOUND;
+                if(pUsrData->pvFncptr)
+                    _vsa_rc = (VS_CALLRC)pUsrData->pvFncptr((VSA_ENGINE)pEngine,(VS_MESSAGE_T)VS_M_VIRUS,pUsrData->pScanInfo->pVirusInfo,(VSA_USRDATA)pUsrData->pvUsrdata);
+                if(_vsa_rc == VS_CB_NEXT || _vsa_rc == VS_CB_TERMINATE)
+                    CLEANUP(VSA_E_CBC_TERMINATED);
+            }
+            CLEANUP(VSA_E_VIRUS_FOUND);
+        }
+    }
+cleanup:
+    if(pObject) free(pObject);
+    return rc;
+} /* scanClientIO */
+
+static VSA_RC vsaSetContentTypeParametes(VSA_OPTPARAM *param,
+    USRDATA *pUsrData
+    )
+{
+    PChar dest = NULL;
+    Bool  mime = FALSE;
+    PChar in = (PChar)param->pvValue;
+    size_t inlen = 0;
+    UInt i = 0;
+
+    if(in == NULL) return VSA_OK;
+    inlen = strlen((const char*)in);
+    dest = (PChar)calloc(1,inlen * 2);
+    if(dest == NULL) return VSA_E_NO_SPACE;
+
+    switch(param->tCode)
+    {
+    case VS_OP_SCANMIMETYPES:
+        pUsrData->pszScanMimeTypes = dest;
+        mime = TRUE;
+        break;
+    case VS_OP_SCANEXTENSIONS:
+        pUsrData->pszScanExtensions = dest;
+        mime = FALSE;
+        break;
+    case VS_OP_BLOCKMIMETYPES:
+        pUsrData->pszBlockMimeTypes = dest;
+        mime = TRUE;
+        break;
+    case VS_OP_BLOCKEXTENSIONS:
+        pUsrData->pszBlockExtensions = dest;
+        mime = FALSE;
+        break;
+    default:
+        free(dest);
+        return VSA_OK;
+    }
+    for(i = 0; i < inlen; i++)
+    {
+        if(i == 0 && mime == FALSE && in[i] != '.')
+        {
+            addScanError(0,(PChar)in,0,-1,(PChar)"Invalid extension",pUsrData->pScanInfo->uiScanErrors++,&pUsrData->pScanInfo->pScanError);
+            return VSA_E_INVALID_PARAM;
+        }
+        dest[i] = tolower((int)in[i]);
+        if (mime == TRUE && in[i] == '*')
+        {
+            if (param->tCode == VS_OP_SCANMIMETYPES)
+            {
+                pUsrData->bScanMimeTypesWildCard = TRUE;
+            }
+            else if (param->tCode == VS_OP_BLOCKMIMETYPES)
+            {
+                pUsrData->bBlockMimeTypesWildCard = TRUE;
+            }
+        }
+    }
+    if(i>0 && i < (inlen * 2) && dest[i] != ';')
+        dest[i] = ';';
+    return VSA_OK;
+} /* vsaSetContentTypeParametes */
+#endif
+
+static VSA_RC vsaSetInitConfig(VSA_INITPARAMS *p_intparams,
+                               INITDATA *usrdata
+                               )
+{
+    VSA_RC     rc        = VSA_OK;
+    Int        i         = 0,
+               arraysize = (p_intparams?p_intparams->usInitParams:0);
+    /*
+     * set the initial setting
+     */
+    for (i=0; i<arraysize; i++)
+    {
+        switch (p_intparams->pInitParam[i].tCode)
+        {
         case VS_IP_INITDRIVERDIRECTORY:
            usrdata->initdirectory = &p_intparams->pInitParam[i];
         break;
@@ -2527,29 +4210,1739 @@ static VSA_RC vsaSetInitConfig(VSA_INITPARAMS *p_intparams,
         case VS_IP_INITTEMP_PATH:
            usrdata->tmpdir = &p_intparams->pInitParam[i];
         break;
+        case VS_IP_INITTIMEOUT:
+           usrdata->timeout = &p_intparams->pInitParam[i];
+        break;
+        case VS_IP_INITENGINES:
+           usrdata->engines = &p_intparams->pInitParam[i];
+        break;
         default:
         break;
         }
     }
-    return rc;
-}
+    return rc;
+}
+
+static VSA_RC getFileSize(Char *pszfilename, size_t *size)
+{
+      VSA_RC rc = VSA_OK;
+
+      struct stat     buf;
+        if (pszfilename == NULL)
+            return VSA_E_NULL_PARAM;
+        
+        if (0!=(stat((const char*)pszfilename,&buf)))
+            return VSA_E_SCAN_FAILED;
+      
+        if(size!=NULL)
+        (*size)  = buf.st_size;
+
+        return rc;
+}
+
+/**********************************************************************
+ *  vsaCompileEngine()
+ *
+ *  Description:
+ *     Creates a new cl_engine, loads the signatures of pszDbDir with
+ *     the DB options of the load profile and compiles it with the
+ *     optional scan limits and warms it up, see WARMUP_ENV. The duration
+ *     of load, compile and warm-up and the resident memory growth are
+ *     returned in the optional pTimes. On error the
+ *     engine is freed, piErrorRC and ppszErrorText are set for VSA_INIT.
+ *
+ *  Returncodes:
+ *  VSA_OK                   |      Success
+ *  VSA_E_LOAD_FAILED        |      Engine could not be created or compiled
+ *  VSA_E_DRIVER_FAILED      |      Signature DB files could not be loaded
+ *  VSA_E_NO_SPACE           |      Any resource allocation failed
+ *
+ **********************************************************************/
+static VSA_RC vsaCompileEngine(const char        *pszDbDir,
+                               const char        *pszTmpDir,
+                               const LOADPROFILE *pProfile,
+                               const ENGINELIMITS *pLimits,
+                               unsigned int      *puiSigs,
+                               struct cl_engine **ppEngine,
+                               PENGINETIMES       pTimes,
+                               Int               *piErrorRC,
+                               PPChar             ppszErrorText)
+{
+    VSA_RC            rc     = VSA_OK;
+    size_t            len    = 0;
+    int               ret    = 0;
+    struct cl_engine *engine = NULL;
+    unsigned long     ulStart= 0;
+    unsigned long     ulResidentKB = vsaGetResidentKB();
+
+    /* CCQ_OFF */
+    engine = pClamFPtr->fp_cl_engine_new( );
+    if (engine == NULL)
+    {
+        (*piErrorRC) = 7;
+        SETERRORTEXT((*ppszErrorText), "ClamAV engine initialization failed");
+        CLEANUP(VSA_E_LOAD_FAILED);
+    }
+    if(pProfile->pszPuaCategories) {
+        pClamFPtr->fp_cl_engine_set_str(engine,CL_ENGINE_PUA_CATEGORIES,(const char*)pProfile->pszPuaCategories);
+    }
+    ulStart = vsaGetMillis();
+    ret = pClamFPtr->fp_cl_load(pszDbDir,engine,puiSigs,pProfile->uiDbOptions);
+    if(pTimes) pTimes->ulLoadDb = vsaGetMillis() - ulStart;
+    if(ret)
+    {
+        char _error[MAX_PATH_LN * 2];
+#ifdef _WIN32
+        _snprintf((char*)_error,MAX_PATH_LN * 2,"ClamAV engine could not load signature DB files. Use freshclam to ensure availability of main.cvd and daily.cvd in %s",pszDbDir);
+#else
+        snprintf((char*)_error,MAX_PATH_LN * 2,"ClamAV engine could not load signature DB files. Use freshclam to ensure availability of main.cvd and daily.cvd in /var/lib/clamav.");
+#endif
+        (*piErrorRC) = ret;
+        SETERRORTEXT((*ppszErrorText),_error);
+        CLEANUP(VSA_E_DRIVER_FAILED);
+    }
+#ifndef CL_SCAN_STDOPT
+    pClamFPtr->fp_cl_engine_set_num(engine, CL_ENGINE_PCRE_MATCH_LIMIT, (long long) 2000);
+    pClamFPtr->fp_cl_engine_set_num(engine, CL_ENGINE_PCRE_RECMATCH_LIMIT, (long long) 2000);
+#endif
+    if(pLimits) {
+        if(pLimits->llMaxScanSize)
+            pClamFPtr->fp_cl_engine_set_num(engine, CL_ENGINE_MAX_SCANSIZE, pLimits->llMaxScanSize);
+        if(pLimits->llMaxFileSize)
+            pClamFPtr->fp_cl_engine_set_num(engine, CL_ENGINE_MAX_FILESIZE, pLimits->llMaxFileSize);
+        if(pLimits->llMaxRecursion)
+            pClamFPtr->fp_cl_engine_set_num(engine, CL_ENGINE_MAX_RECURSION, pLimits->llMaxRecursion);
+    }
+    ulStart = vsaGetMillis();
+    ret = pClamFPtr->fp_cl_engine_compile(engine);
+    if(pTimes) {
+        pTimes->ulCompile    = vsaGetMillis() - ulStart;
+        pTimes->ulResidentKB = vsaGetResidentKB();
+        pTimes->ulResidentKB = pTimes->ulResidentKB > ulResidentKB ? pTimes->ulResidentKB - ulResidentKB : 0;
+    }
+    if(ret)
+    {
+        (*piErrorRC) = ret;
+        SETERRORTEXT((*ppszErrorText), "ClamAV engine could not compile signature DB files");
+        CLEANUP(VSA_E_LOAD_FAILED);
+    }
+    if(pszTmpDir) {
+        pClamFPtr->fp_cl_engine_set_str(engine,CL_ENGINE_TMPDIR,pszTmpDir);
+    }
+    if(bgWarmup == TRUE) {
+        ulStart = vsaWarmupEngine(engine);
+        if(pTimes) pTimes->ulWarmup = ulStart;
+    }
+    /* CCQ_ON */
+cleanup:
+    if(rc != VSA_OK && engine != NULL) {
+        pClamFPtr->fp_cl_engine_free(engine);
+        engine = NULL;
+    }
+    (*ppEngine) = engine;
+    return rc;
+} /* vsaCompileEngine */
+
+/**********************************************************************
+ *  vsaFindEngine()
+ *
+ *  Description:
+ *     Searches the engine registry for the key. The caller must hold
+ *     tEngineLock.
+ *
+ **********************************************************************/
+static PENGINEENTRY vsaFindEngine(const char *pszDbDir,
+                                  const char *pszTmpDir,
+                                  const LOADPROFILE *pProfile)
+{
+    PENGINEENTRY pEntry = NULL;
+
+    for(pEntry = pEngineList; pEntry != NULL; pEntry = pEntry->pNext)
+    {
+        if(pEntry->tProfile.uiDbOptions == pProfile->uiDbOptions                          &&
+           vsaEqualString((const char*)pEntry->pszDbDir,pszDbDir)                         &&
+           vsaEqualString((const char*)pEntry->pszTmpDir,pszTmpDir)                       &&
+           vsaEqualString((const char*)pEntry->tProfile.pszPuaCategories,
+                          (const char*)pProfile->pszPuaCategories))
+            break;
+    }
+    return pEntry;
+} /* vsaFindEngine */
+
+/**********************************************************************
+ *  vsaLookupEngine()
+ *
+ *  Description:
+ *     Returns an already compiled engine for the key and increases
+ *     its reference counter, or NULL if there is none yet.
+ *
+ **********************************************************************/
+static PENGINEENTRY vsaLookupEngine(const char *pszDbDir,
+                                    const char *pszTmpDir,
+                                    const LOADPROFILE *pProfile)
+{
+    PENGINEENTRY pEntry = NULL;
+
+    VSA_LOCK(&tEngineLock);
+    pEntry = vsaFindEngine(pszDbDir,pszTmpDir,pProfile);
+    if(pEntry != NULL)
+        pEntry->lRefCounter++;
+    VSA_UNLOCK(&tEngineLock);
+    return pEntry;
+} /* vsaLookupEngine */
+
+/**********************************************************************
+ *  vsaRegisterEngine()
+ *
+ *  Description:
+ *     Adds a compiled engine to the registry with one reference.
+ *     If a parallel VsaInit registered the same key in the meantime,
+ *     the given engine is freed and the registered one is returned.
+ *     Without engine the entry is registered as loading and
+ *     vsaLoadThread compiles it.
+ *
+ *  Returncodes:
+ *  VSA_OK                   |      Success
+ *  VSA_E_NO_SPACE           |      Any resource allocation failed
+ *
+ **********************************************************************/
+static VSA_RC vsaRegisterEngine(const char       *pszDbDir,
+                                const char       *pszTmpDir,
+                                const LOADPROFILE *pProfile,
+                                UInt              uiSigs,
+                                struct cl_engine *engine,
+                                const ENGINETIMES *pTimes,
+                                time_t            tReadyTimeout,
+                                PPENGINEENTRY     ppEntry)
+{
+    VSA_RC        rc     = VSA_OK;
+    PENGINEENTRY  pEntry = NULL,
+                  pFound = NULL;
+
+    (*ppEntry) = NULL;
+    pEntry = (PENGINEENTRY)calloc(1,sizeof(ENGINEENTRY));
+    if(pEntry == NULL)
+        CLEANUP(VSA_E_NO_SPACE);
+    if(engine != NULL) {
+        pEntry->pCurrent = (PENGINEGEN)calloc(1,sizeof(ENGINEGEN));
+        if(pEntry->pCurrent == NULL)
+            CLEANUP(VSA_E_NO_SPACE);
+    }
+    pEntry->pszDbDir = (PChar)strdup(pszDbDir);
+    if(pEntry->pszDbDir == NULL)
+        CLEANUP(VSA_E_NO_SPACE);
+    if(pszTmpDir) {
+        pEntry->pszTmpDir = (PChar)strdup(pszTmpDir);
+        if(pEntry->pszTmpDir == NULL)
+            CLEANUP(VSA_E_NO_SPACE);
+    }
+    pEntry->tProfile.uiDbOptions = pProfile->uiDbOptions;
+    pEntry->tProfile.pszDrivers  = pProfile->pszDrivers;
+    pEntry->tProfile.pszName     = (PChar)strdup((const char*)pProfile->pszName);
+    if(pEntry->tProfile.pszName == NULL)
+        CLEANUP(VSA_E_NO_SPACE);
+    if(pProfile->pszPuaCategories) {
+        pEntry->tProfile.pszPuaCategories = (PChar)strdup((const char*)pProfile->pszPuaCategories);
+        if(pEntry->tProfile.pszPuaCategories == NULL)
+            CLEANUP(VSA_E_NO_SPACE);
+    }
+    pEntry->lRefCounter   = 1;
+    pEntry->tReadyTimeout = tReadyTimeout;
+    if(pTimes)
+        pEntry->tTimes    = (*pTimes);
+    if(engine != NULL) {
+        pEntry->pCurrent->uiSigs       = uiSigs;
+        pEntry->pCurrent->uiGeneration = 1;
+        pEntry->pCurrent->lRefCounter  = 1;
+        /* baseline for the hot reload */
+        if(pClamFPtr->fp_cl_statinidir(pszDbDir,&pEntry->tDbStat) == 0)
+            pEntry->bDbStat = TRUE;
+        pEntry->tLastCheck = time(NULL);
+    }
+    else {
+        pEntry->bLoading = TRUE;
+    }
+
+    VSA_LOCK(&tEngineLock);
+    pFound = vsaFindEngine(pszDbDir,pszTmpDir,pProfile);
+    if(pFound != NULL) {
+        pFound->lRefCounter++;
+    }
+    else {
+        if(engine != NULL)
+            pEntry->pCurrent->engine = engine;
+        else
+            pEntry->lRefCounter++;   /* reference of vsaLoadThread */
+        pEntry->pNext  = pEngineList;
+        pEngineList    = pEntry;
+    }
+    VSA_UNLOCK(&tEngineLock);
+
+    if(pFound != NULL) {
+        if(engine != NULL)
+            pClamFPtr->fp_cl_engine_free(engine);
+        freeENGINEENTRY(&pEntry);
+        pEntry = pFound;
+    }
+    else if(engine == NULL) {
+        /* without thread the load runs here */
+        if(vsaStartThread(vsaLoadThread,pEntry) != VSA_OK)
+            vsaLoadThread(pEntry);
+    }
+    (*ppEntry) = pEntry;
+
+cleanup:
+    if(rc != VSA_OK)
+        freeENGINEENTRY(&pEntry);
+    return rc;
+} /* vsaRegisterEngine */
+
+/**********************************************************************
+ *  vsaReleaseEngine()
+ *
+ *  Description:
+ *     Decreases the reference counter of the entry. The last reference
+ *     removes the entry from the registry and frees the cl_engine.
+ *
+ **********************************************************************/
+static void vsaReleaseEngine(PENGINEENTRY pEntry)
+{
+    if(pEntry == NULL)
+        return;
+    VSA_LOCK(&tEngineLock);
+    if(pEntry->lRefCounter > (size_t)0)
+        pEntry->lRefCounter--;
+    if(pEntry->lRefCounter == (size_t)0)
+        vsaUnlinkEngine(pEntry);
+    else
+        pEntry = NULL;
+    VSA_UNLOCK(&tEngineLock);
+
+    if(pEntry != NULL) {
+        vsaReleaseGeneration(pEntry->pCurrent);
+        pEntry->pCurrent = NULL;
+        freeENGINEENTRY(&pEntry);
+    }
+} /* vsaReleaseEngine */
+
+/**********************************************************************
+ *  vsaAcquireGeneration()
+ *
+ *  Description:
+ *     Returns the current engine generation of the entry with one
+ *     reference for the caller, NULL if it is still loading. Checks
+ *     from time to time whether the signature DB files have changed
+ *     and starts the reload.
+ *
+ **********************************************************************/
+static PENGINEGEN vsaAcquireGeneration(PENGINEENTRY pEntry)
+{
+    PENGINEGEN  pGen    = NULL;
+    Bool        bCheck  = FALSE;
+    time_t      tNow    = time(NULL);
+
+    VSA_LOCK(&tEngineLock);
+    if(tgReloadCheck > 0            &&
+       pEntry->bDbStat == TRUE      &&
+       pEntry->bReloading == FALSE  &&
+       tNow - pEntry->tLastCheck >= tgReloadCheck)
+    {
+        pEntry->bReloading = TRUE;
+        pEntry->tLastCheck = tNow;
+        bCheck = TRUE;
+    }
+    pGen = pEntry->pCurrent;
+    if(pGen != NULL)
+        pGen->lRefCounter++;
+    VSA_UNLOCK(&tEngineLock);
+
+    if(bCheck == TRUE)
+        vsaCheckReload(pEntry);
+    return pGen;
+} /* vsaAcquireGeneration */
+
+/**********************************************************************
+ *  vsaSelectVariant()
+ *
+ *  Description:
+ *     Returns the engine of the generation which was compiled with the
+ *     scan limits. The published variants are looked up without lock.
+ *     A new limit combination is compiled once by vsaVariantThread,
+ *     the scans with these limits wait for it up to the
+ *     VS_IP_INITTIMEOUT of the VsaInit. A scan is never run with other
+ *     limits than requested.
+ *
+ *  Returncodes:
+ *  VSA_OK                   |      Success
+ *  VSA_E_NOT_SCANNED        |      No engine with these limits, see reason
+ *
+ **********************************************************************/
+static VSA_RC vsaSelectVariant(PENGINEENTRY        pEntry,
+                               PENGINEGEN          pGen,
+                               const ENGINELIMITS *pLimits,
+                               struct cl_engine  **ppEngine,
+                               PPChar              ppszReason)
+{
+    PENGINEVARIANT    pVariant  = NULL;
+    PVARIANTJOB       pJob      = NULL;
+    UInt              i         = 0;
+    time_t            tDeadline = 0;
+
+    (*ppEngine) = pGen->engine;
+    if(pLimits->llMaxScanSize  == 0 &&
+       pLimits->llMaxFileSize  == 0 &&
+       pLimits->llMaxRecursion == 0)
+        return VSA_OK;
+
+    for(i=0; i<MAX_ENGINE_VARIANTS; i++) {
+        pVariant = (PENGINEVARIANT)VSA_LOAD_PTR(&pGen->pVariant[i]);
+        if(pVariant != NULL && memcmp(&pVariant->tLimits,pLimits,sizeof(ENGINELIMITS)) == 0) {
+            (*ppEngine) = pVariant->engine;
+            return VSA_OK;
+        }
+    }
+
+    /* not published yet, the first scan with these limits starts the compile */
+    VSA_LOCK(&tVariantLock);
+    for(i=0; i<pGen->uiVariants; i++) {
+        if(memcmp(&pGen->tPending[i],pLimits,sizeof(ENGINELIMITS)) == 0)
+            break;
+    }
+    if(i == pGen->uiVariants && i < MAX_ENGINE_VARIANTS) {
+        pJob = (PVARIANTJOB)calloc(1,sizeof(VARIANTJOB));
+        if(pJob == NULL) {
+            VSA_UNLOCK(&tVariantLock);
+            return VSA_E_NO_SPACE;
+        }
+        pGen->tPending[i] = (*pLimits);
+        pGen->uiVariants++;
+        pJob->pEntry = pEntry;
+        pJob->pGen   = pGen;
+        pJob->uiSlot = i;
+    }
+    VSA_UNLOCK(&tVariantLock);
+    if(i == MAX_ENGINE_VARIANTS) {
+        (*ppszReason) = (PChar)"Not scanned: no engine for more scan limit combinations";
+        return VSA_E_NOT_SCANNED;
+    }
+
+    if(pJob != NULL) {
+        /* the thread holds its own references to the entry and the generation */
+        VSA_LOCK(&tEngineLock);
+        pEntry->lRefCounter++;
+        pGen->lRefCounter++;
+        VSA_UNLOCK(&tEngineLock);
+        if(vsaStartThread(vsaVariantThread,pJob) != VSA_OK) {
+            VSA_LOCK(&tEngineLock);
+            pGen->bVariantFailed[i] = TRUE;
+            VSA_UNLOCK(&tEngineLock);
+            vsaReleaseGeneration(pGen);
+            vsaReleaseEngine(pEntry);
+            free(pJob);
+        }
+    }
+
+    VSA_LOCK(&tEngineLock);
+    tDeadline = time(NULL) + pEntry->tReadyTimeout;
+    while(VSA_LOAD_PTR(&pGen->pVariant[i]) == NULL &&
+          pGen->bVariantFailed[i] == FALSE &&
+          time(NULL) < tDeadline)
+        vsaWaitEngineReady(tDeadline);
+    pVariant = (PENGINEVARIANT)VSA_LOAD_PTR(&pGen->pVariant[i]);
+    if(pVariant != NULL)
+        (*ppEngine) = pVariant->engine;
+    else if(pGen->bVariantFailed[i] == TRUE)
+        (*ppszReason) = (PChar)"Not scanned: the engine with the scan limits could not be compiled";
+    else
+        (*ppszReason) = (PChar)"Not scanned: the engine with the scan limits is still compiling";
+    VSA_UNLOCK(&tEngineLock);
+    return pVariant != NULL ? VSA_OK : VSA_E_NOT_SCANNED;
+} /* vsaSelectVariant */
+
+/**********************************************************************
+ *  vsaVariantThread()
+ *
+ *  Description:
+ *     Compiles the engine with the limits of the slot given by
+ *     vsaSelectVariant and publishes it in the generation. If the
+ *     compile fails, the slot is marked as failed and the scans with
+ *     these limits are not scanned.
+ *
+ **********************************************************************/
+static VSA_THREAD_RC VSA_THREAD_API vsaVariantThread(void *pArg)
+{
+    PVARIANTJOB       pJob         = (PVARIANTJOB)pArg;
+    PENGINEVARIANT    pVariant     = NULL;
+    struct cl_engine *engine       = NULL;
+    unsigned int      sigs         = 0;
+    Int               iErrorRC     = 0;
+    PChar             pszErrorText = NULL;
+
+    pVariant = (PENGINEVARIANT)calloc(1,sizeof(ENGINEVARIANT));
+    if(pVariant != NULL) {
+        /* the limits of the slot were set before the thread was started */
+        pVariant->tLimits = pJob->pGen->tPending[pJob->uiSlot];
+        if(vsaCompileEngine((const char*)pJob->pEntry->pszDbDir,
+                            (const char*)pJob->pEntry->pszTmpDir,
+                            &pJob->pEntry->tProfile,
+                            &pVariant->tLimits,
+                            &sigs,
+                            &engine,
+                            NULL,
+                            &iErrorRC,
+                            &pszErrorText) == VSA_OK)
+        {
+            pVariant->engine = engine;
+            VSA_STORE_PTR(&pJob->pGen->pVariant[pJob->uiSlot],pVariant);
+            pVariant = NULL;
+        }
+        if(pszErrorText) free(pszErrorText);
+    }
+    /* wake the scans waiting for the slot */
+    VSA_LOCK(&tEngineLock);
+    if(pVariant != NULL || VSA_LOAD_PTR(&pJob->pGen->pVariant[pJob->uiSlot]) == NULL)
+        pJob->pGen->bVariantFailed[pJob->uiSlot] = TRUE;
+    VSA_COND_SIGNAL(&tEngineReady);
+    VSA_UNLOCK(&tEngineLock);
+    if(pVariant) free(pVariant);
+    vsaReleaseGeneration(pJob->pGen);
+    vsaReleaseEngine(pJob->pEntry);
+    free(pJob);
+    return (VSA_THREAD_RC)0;
+} /* vsaVariantThread */
+
+/**********************************************************************
+ *  vsaCompileVariants()
+ *
+ *  Description:
+ *     Compiles the variants, which are published in the generation
+ *     pFrom, for the new generation pGen of a reload, so that the
+ *     scans with these limits need no compile after the swap. pGen is
+ *     not yet visible to the scans.
+ *
+ **********************************************************************/
+static void vsaCompileVariants(PENGINEENTRY pEntry, PENGINEGEN pGen, PENGINEGEN pFrom)
+{
+    PENGINEVARIANT    pOld         = NULL;
+    PENGINEVARIANT    pVariant     = NULL;
+    struct cl_engine *engine       = NULL;
+    unsigned int      sigs         = 0;
+    Int               iErrorRC     = 0;
+    PChar             pszErrorText = NULL;
+    UInt              i            = 0;
+
+    for(i=0; pFrom != NULL && i<MAX_ENGINE_VARIANTS; i++) {
+        pOld = (PENGINEVARIANT)VSA_LOAD_PTR(&pFrom->pVariant[i]);
+        if(pOld == NULL)
+            continue;
+        pVariant = (PENGINEVARIANT)calloc(1,sizeof(ENGINEVARIANT));
+        if(pVariant == NULL)
+            break;
+        pVariant->tLimits = pOld->tLimits;
+        engine = NULL;
+        if(vsaCompileEngine((const char*)pEntry->pszDbDir,
+                            (const char*)pEntry->pszTmpDir,
+                            &pEntry->tProfile,
+                            &pVariant->tLimits,
+                            &sigs,
+                            &engine,
+                            NULL,
+                            &iErrorRC,
+                            &pszErrorText) == VSA_OK)
+        {
+            pVariant->engine = engine;
+            pGen->tPending[pGen->uiVariants] = pVariant->tLimits;
+            pGen->pVariant[pGen->uiVariants] = pVariant;
+            pGen->uiVariants++;
+            pVariant = NULL;
+        }
+        if(pszErrorText) {
+            free(pszErrorText);
+            pszErrorText = NULL;
+        }
+        if(pVariant) free(pVariant);
+    }
+} /* vsaCompileVariants */
+
+/**********************************************************************
+ *  vsaReleaseGeneration()
+ *
+ *  Description:
+ *     Decreases the reference counter of the generation. The cl_engine
+ *     is freed with the last reference, that is after a reload when
+ *     the last scan on the old engine has finished.
+ *
+ **********************************************************************/
+static void vsaReleaseGeneration(PENGINEGEN pGen)
+{
+    if(pGen == NULL)
+        return;
+    VSA_LOCK(&tEngineLock);
+    if(pGen->lRefCounter > (size_t)0)
+        pGen->lRefCounter--;
+    if(pGen->lRefCounter != (size_t)0)
+        pGen = NULL;
+    VSA_UNLOCK(&tEngineLock);
+
+    if(pGen != NULL) {
+        UInt i = 0;
+        for(i=0; i<MAX_ENGINE_VARIANTS; i++) {
+            if(pGen->pVariant[i] == NULL)
+                continue;
+            if(pGen->pVariant[i]->engine && pClamFPtr && pClamFPtr->fp_cl_engine_free)
+                pClamFPtr->fp_cl_engine_free(pGen->pVariant[i]->engine);
+            free(pGen->pVariant[i]);
+        }
+        if(pGen->engine && pClamFPtr && pClamFPtr->fp_cl_engine_free)
+            pClamFPtr->fp_cl_engine_free(pGen->engine);
+        free(pGen);
+    }
+} /* vsaReleaseGeneration */
+
+/**********************************************************************
+ *  vsaCheckReload()
+ *
+ *  Description:
+ *     Called with bReloading set. If a file in the DB directory has
+ *     changed, a background thread compiles the new engine, otherwise
+ *     bReloading is reset.
+ *
+ **********************************************************************/
+static void vsaCheckReload(PENGINEENTRY pEntry)
+{
+    if(pClamFPtr->fp_cl_statchkdir(&pEntry->tDbStat) == 1)
+    {
+        /* the reload thread holds its own reference to the entry */
+        VSA_LOCK(&tEngineLock);
+        pEntry->lRefCounter++;
+        VSA_UNLOCK(&tEngineLock);
+        if(vsaStartThread(vsaReloadThread,pEntry) == VSA_OK)
+            return;
+        vsaReleaseEngine(pEntry);
+    }
+    VSA_LOCK(&tEngineLock);
+    pEntry->bReloading = FALSE;
+    VSA_UNLOCK(&tEngineLock);
+} /* vsaCheckReload */
+
+/**********************************************************************
+ *  vsaReloadThread()
+ *
+ *  Description:
+ *     Loads and compiles the changed signatures into a new engine and
+ *     swaps it with the current generation of the entry. Running scans
+ *     finish on the old engine. If the new engine cannot be compiled,
+ *     the old one stays active until the next change of the DB files.
+ *
+ **********************************************************************/
+static VSA_THREAD_RC VSA_THREAD_API vsaReloadThread(void *pArg)
+{
+    VSA_RC            rc           = VSA_OK;
+    PENGINEENTRY      pEntry       = (PENGINEENTRY)pArg;
+    PENGINEGEN        pGen         = NULL,
+                      pOld         = NULL;
+    struct cl_engine *engine       = NULL;
+    unsigned int      sigs         = 0;
+    Int               iErrorRC     = 0;
+    PChar             pszErrorText = NULL;
+    struct cl_stat    tDbStat,
+                      tOldStat;
+    Bool              bDbStat      = FALSE;
+
+    memset(&tDbStat,0,sizeof(struct cl_stat));
+    memset(&tOldStat,0,sizeof(struct cl_stat));
+    /* new baseline before the load, so that a change during the load triggers the next reload */
+    if(pClamFPtr->fp_cl_statinidir((const char*)pEntry->pszDbDir,&tDbStat) == 0)
+        bDbStat = TRUE;
+
+    rc = vsaCompileEngine((const char*)pEntry->pszDbDir,
+                          (const char*)pEntry->pszTmpDir,
+                          &pEntry->tProfile,
+                          NULL,
+                          &sigs,
+                          &engine,
+                          NULL,
+                          &iErrorRC,
+                          &pszErrorText);
+    if(pszErrorText) free(pszErrorText);
+    if(rc == VSA_OK) {
+        pGen = (PENGINEGEN)calloc(1,sizeof(ENGINEGEN));
+        if(pGen == NULL) {
+            pClamFPtr->fp_cl_engine_free(engine);
+        }
+        else {
+            pGen->engine       = engine;
+            pGen->uiSigs       = sigs;
+            pGen->lRefCounter  = 1;
+        }
+    }
+    if(pGen != NULL) {
+        /* the limit combinations in use are compiled before the swap */
+        VSA_LOCK(&tEngineLock);
+        pOld = pEntry->pCurrent;
+        if(pOld != NULL)
+            pOld->lRefCounter++;
+        VSA_UNLOCK(&tEngineLock);
+        vsaCompileVariants(pEntry,pGen,pOld);
+        vsaReleaseGeneration(pOld);
+        pOld = NULL;
+    }
+
+    VSA_LOCK(&tEngineLock);
+    if(pGen != NULL) {
+        pGen->uiGeneration = pEntry->pCurrent->uiGeneration + 1;
+        pOld               = pEntry->pCurrent;
+        pEntry->pCurrent   = pGen;
+    }
+    if(bDbStat == TRUE) {
+        tOldStat        = pEntry->tDbStat;
+        pEntry->tDbStat = tDbStat;
+    }
+    pEntry->bReloading = FALSE;
+    VSA_UNLOCK(&tEngineLock);
+
+    if(bDbStat == TRUE)
+        pClamFPtr->fp_cl_statfree(&tOldStat);
+    vsaReleaseGeneration(pOld);
+    vsaReleaseEngine(pEntry);
+    return (VSA_THREAD_RC)0;
+} /* vsaReloadThread */
+
+/**********************************************************************
+ *  vsaStartThread()
+ *
+ *  Description:
+ *     Starts a detached background thread.
+ *
+ *  Returncodes:
+ *  VSA_OK                   |      Success
+ *  VSA_E_NO_SPACE           |      Thread could not be created
+ *
+ **********************************************************************/
+static VSA_RC vsaStartThread(VSA_THREAD_FUNC *pfnThread, void *pArg)
+{
+#ifdef _WIN32
+    HANDLE          hThread = NULL;
+
+    hThread = CreateThread(NULL,0,pfnThread,pArg,0,NULL);
+    if(hThread == NULL)
+        return VSA_E_NO_SPACE;
+    CloseHandle(hThread);
+#else
+    pthread_t       tThread;
+    pthread_attr_t  tAttr;
+    int             ret = 0;
+
+    pthread_attr_init(&tAttr);
+    pthread_attr_setdetachstate(&tAttr,PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&tThread,&tAttr,pfnThread,pArg);
+    pthread_attr_destroy(&tAttr);
+    if(ret != 0)
+        return VSA_E_NO_SPACE;
+#endif
+    return VSA_OK;
+} /* vsaStartThread */
+
+/**********************************************************************
+ *  vsaRefreshDriverInfo()
+ *
+ *  Description:
+ *     Updates the VSA_DRIVERINFO of the handle after a hot reload.
+ *     Returns TRUE for the one caller who did the update.
+ *
+ **********************************************************************/
+static Bool vsaRefreshDriverInfo(PVSA_INIT p_init, PENGINEGEN pGen)
+{
+    Bool            bRefreshed = FALSE;
+    struct cl_cvd  *p_driver   = NULL;
+    PChar           pszName    = NULL;
+    size_t          len        = 0;
+    int             i          = 0;
+
+    VSA_LOCK(&tEngineLock);
+    if(p_init->uiIntRevNum != pGen->uiGeneration)
+    {
+        for(i=0; p_init->pDriver != NULL && i<MAX_DRIVERS; i++)
+        {
+            pszName = p_init->pDriver[i].pszName;
+            if(pszName == NULL)
+                continue;
+            len = strlen((const char*)pszName);
+            if(len > 2 && getFileSize(pszName,NULL))
+            {   /* freshclam replaces *.cvd by *.cld and vice versa */
+                pszName[len-2] = (Char)(pszName[len-2] == 'v' ? 'l' : 'v');
+            }
+            p_driver = pClamFPtr->fp_cl_cvdhead((const char*)pszName);
+            if(p_driver)
+            {
+                p_init->pDriver[i].uiViruses       = p_driver->sigs;
+                p_init->pDriver[i].iDriverRC       = 0;
+                p_init->pDriver[i].utcDate         = p_driver->stime;
+                p_init->pDriver[i].usDrvMinVersion = p_driver->version;
+                pClamFPtr->fp_cl_cvdfree(p_driver);
+            }
+        }
+        /* first generation of an asynchronous VsaInit */
+        if(p_init->uiIntRevNum == 0)
+            vsaSetTimingText(&p_init->pszErrorText,
+                             (const char*)((PENGINEENTRY)p_init->hEngine)->tProfile.pszName,
+                             pGen->uiSigs,
+                             &((PENGINEENTRY)p_init->hEngine)->tTimes);
+        p_init->uiViruses   = pGen->uiSigs;
+        p_init->uiIntRevNum = pGen->uiGeneration;
+        bRefreshed = TRUE;
+    }
+    VSA_UNLOCK(&tEngineLock);
+    return bRefreshed;
+} /* vsaRefreshDriverInfo */
+
+/**********************************************************************
+ *  vsaUnlinkEngine()
+ *
+ *  Description:
+ *     Removes the entry from the registry, so that the next VsaInit
+ *     with the same key does not find it. The caller must hold
+ *     tEngineLock.
+ *
+ **********************************************************************/
+static void vsaUnlinkEngine(PENGINEENTRY pEntry)
+{
+    PPENGINEENTRY ppNext = NULL;
+
+    for(ppNext = &pEngineList; (*ppNext) != NULL; ppNext = &(*ppNext)->pNext)
+    {
+        if((*ppNext) == pEntry) {
+            (*ppNext) = pEntry->pNext;
+            pEntry->pNext = NULL;
+            break;
+        }
+    }
+} /* vsaUnlinkEngine */
+
+/**********************************************************************
+ *  vsaLoadThread()
+ *
+ *  Description:
+ *     Loads and compiles the first engine generation of an entry
+ *     registered by an asynchronous VsaInit and wakes up the waiting
+ *     scans. If the load fails, the error is kept for the scans of the
+ *     existing handles and the entry is removed from the registry, so
+ *     that the next VsaInit tries it again.
+ *
+ **********************************************************************/
+static VSA_THREAD_RC VSA_THREAD_API vsaLoadThread(void *pArg)
+{
+    VSA_RC            rc           = VSA_OK;
+    PENGINEENTRY      pEntry       = (PENGINEENTRY)pArg;
+    PENGINEGEN        pGen         = NULL;
+    struct cl_engine *engine       = NULL;
+    unsigned int      sigs         = 0;
+    Int               iErrorRC     = 0;
+    PChar             pszErrorText = NULL;
+    ENGINETIMES       tTimes;
+    struct cl_stat    tDbStat;
+    Bool              bDbStat      = FALSE;
+
+    memset(&tTimes,0,sizeof(ENGINETIMES));
+    memset(&tDbStat,0,sizeof(struct cl_stat));
+    tTimes.ulLoadLib = ulgLoadLib;
+    if(pClamFPtr->fp_cl_statinidir((const char*)pEntry->pszDbDir,&tDbStat) == 0)
+        bDbStat = TRUE;
+
+    rc = vsaCompileEngine((const char*)pEntry->pszDbDir,
+                          (const char*)pEntry->pszTmpDir,
+                          &pEntry->tProfile,
+                          NULL,
+                          &sigs,
+                          &engine,
+                          &tTimes,
+                          &iErrorRC,
+                          &pszErrorText);
+    if(rc == VSA_OK) {
+        pGen = (PENGINEGEN)calloc(1,sizeof(ENGINEGEN));
+        if(pGen == NULL) {
+            pClamFPtr->fp_cl_engine_free(engine);
+            rc = VSA_E_NO_SPACE;
+        }
+        else {
+            pGen->engine       = engine;
+            pGen->uiSigs       = sigs;
+            pGen->uiGeneration = 1;
+            pGen->lRefCounter  = 1;
+        }
+    }
+
+    VSA_LOCK(&tEngineLock);
+    if(pGen != NULL) {
+        pEntry->pCurrent   = pGen;
+        pEntry->tTimes     = tTimes;
+        pEntry->tLastCheck = time(NULL);
+        if(bDbStat == TRUE) {
+            pEntry->tDbStat = tDbStat;
+            pEntry->bDbStat = TRUE;
+            bDbStat         = FALSE;
+        }
+    }
+    else {
+        pEntry->tLoadRC      = rc;
+        pEntry->pszLoadError = pszErrorText;
+        pszErrorText         = NULL;
+        vsaUnlinkEngine(pEntry);
+    }
+    pEntry->bLoading = FALSE;
+    VSA_COND_SIGNAL(&tEngineReady);
+    VSA_UNLOCK(&tEngineLock);
+
+    if(bDbStat == TRUE)
+        pClamFPtr->fp_cl_statfree(&tDbStat);
+    if(pszErrorText) free(pszErrorText);
+    vsaReleaseEngine(pEntry);
+    return (VSA_THREAD_RC)0;
+} /* vsaLoadThread */
+
+/**********************************************************************
+ *  vsaWaitEngineReady()
+ *
+ *  Description:
+ *     Waits for tEngineReady until tDeadline at the latest, tEngineLock
+ *     must be held.
+ *
+ **********************************************************************/
+static void vsaWaitEngineReady(time_t tDeadline)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(&tEngineReady,&tEngineLock,(DWORD)((tDeadline - time(NULL)) * 1000));
+#else
+    struct timespec tAbsTime;
+    tAbsTime.tv_sec  = tDeadline;
+    tAbsTime.tv_nsec = 0;
+    pthread_cond_timedwait(&tEngineReady,&tEngineLock,&tAbsTime);
+#endif
+} /* vsaWaitEngineReady */
+
+/**********************************************************************
+ *  vsaWaitGeneration()
+ *
+ *  Description:
+ *     Returns the current engine generation like vsaAcquireGeneration.
+ *     While the entry is loading, the caller waits up to the
+ *     VS_IP_INITTIMEOUT of the VsaInit.
+ *
+ *  Returncodes:
+ *  VSA_OK                   |      Success
+ *  VSA_E_IN_PROGRESS        |      Engine is still loading
+ *  VSA_E_LOAD_FAILED        |      Engine could not be loaded, see reason
+ *
+ **********************************************************************/
+static VSA_RC vsaWaitGeneration(PENGINEENTRY pEntry,
+                                PENGINEGEN  *ppGen,
+                                PPChar       ppszReason)
+{
+    VSA_RC      rc        = VSA_OK;
+    time_t      tDeadline = 0;
+
+    (*ppGen) = vsaAcquireGeneration(pEntry);
+    if((*ppGen) != NULL)
+        return VSA_OK;
+
+    VSA_LOCK(&tEngineLock);
+    tDeadline = time(NULL) + pEntry->tReadyTimeout;
+    while(pEntry->bLoading == TRUE && time(NULL) < tDeadline)
+        vsaWaitEngineReady(tDeadline);
+    if(pEntry->bLoading == TRUE) {
+        (*ppszReason) = (PChar)"ClamAV engine is still loading the signature DB files";
+        rc = VSA_E_IN_PROGRESS;
+    }
+    else if(pEntry->pCurrent == NULL) {
+        (*ppszReason) = pEntry->pszLoadError ? pEntry->pszLoadError : (PChar)CLAM_LOAD_ERROR_MESSAGE;
+        rc = pEntry->tLoadRC ? pEntry->tLoadRC : VSA_E_LOAD_FAILED;
+    }
+    VSA_UNLOCK(&tEngineLock);
+
+    if(rc == VSA_OK)
+        (*ppGen) = vsaAcquireGeneration(pEntry);
+    return rc;
+} /* vsaWaitGeneration */
+
+/**********************************************************************
+ *  vsaSetTimingText()
+ *
+ *  Description:
+ *     Replaces the VSA_INIT error text by the load profile, its number
+ *     of signatures, memory and startup phase timings, so that a slow
+ *     or large startup can be seen in the SAP VSCAN monitor. The unique
+ *     memory of the process shows whether a preloaded engine is shared.
+ *
+ **********************************************************************/
+static void vsaSetTimingText(PPChar ppszText,
+                             const char *pszProfile,
+                             UInt uiSigs,
+                             const ENGINETIMES *pTimes)
+{
+    char    _text[LOAD_PROFILE_LN + 256];
+    PChar   pszText = NULL;
+
+    sprintf(_text,"No error (profile %.*s: %u signatures, %lu KB resident, %lu KB unique in process, load library %lu ms, load signatures %lu ms, compile %lu ms, warm-up %lu ms, drivers %lu ms)",
+            LOAD_PROFILE_LN,
+            pszProfile ? pszProfile : LOAD_PROFILE_DEFAULT,
+            uiSigs,
+            pTimes->ulResidentKB,
+            vsaGetUniqueKB(),
+            pTimes->ulLoadLib,
+            pTimes->ulLoadDb,
+            pTimes->ulCompile,
+            pTimes->ulWarmup,
+            pTimes->ulDrivers);
+    pszText = (PChar)strdup(_text);
+    if(pszText == NULL)
+        return;
+    if((*ppszText) != NULL)
+        free((*ppszText));
+    (*ppszText) = pszText;
+} /* vsaSetTimingText */
+
+/**********************************************************************
+ *  vsaGetMillis()
+ *
+ *  Description:
+ *     Clock in milliseconds for the phase timings.
+ *
+ **********************************************************************/
+static unsigned long vsaGetMillis(void)
+{
+#ifdef _WIN32
+    return (unsigned long)GetTickCount();
+#else
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (unsigned long)tv.tv_sec * 1000UL + (unsigned long)(tv.tv_usec / 1000);
+#endif
+} /* vsaGetMillis */
+
+/**********************************************************************
+ *  vsaSetLoadProfile()
+ *
+ *  Description:
+ *     Parses the load profile "name[,option...]" of VS_IP_INITENGINES.
+ *     Options change the DB options of the named profile:
+ *       bytecode, nobytecode   bytecode signatures
+ *       phishing, nophishing   phishing signatures and URLs
+ *       official, unofficial   only signatures signed by ClamAV
+ *       pua, nopua             potentially unwanted applications
+ *       pua=<category>         only this PUA category, can be repeated
+ *
+ *  Returncodes:
+ *  VSA_OK                   |      Success
+ *  VSA_E_INVALID_PARAM      |      Unknown profile name or option
+ *  VSA_E_NO_SPACE           |      Any resource allocation failed
+ *
+ **********************************************************************/
+static VSA_RC vsaSetLoadProfile(const char *pszSpec, PLOADPROFILE pProfile)
+{
+    VSA_RC      rc          = VSA_OK;
+    char        _spec[LOAD_PROFILE_LN + 1];
+    char        _cats[LOAD_PROFILE_LN + 2];
+    char       *pszToken    = NULL;
+    int         i           = 0;
+
+    memset(pProfile,0,sizeof(LOADPROFILE));
+    if(pszSpec == NULL || *pszSpec == 0)
+        pszSpec = LOAD_PROFILE_DEFAULT;
+    if(strlen(pszSpec) > LOAD_PROFILE_LN)
+        return VSA_E_INVALID_PARAM;
+    strcpy(_spec,pszSpec);
+    _cats[0] = 0;
+
+    pszToken = strtok(_spec,",");/*CCQ_FUNCTION_WITH_MEMORY_OK*/
+    for(i=0; pszToken != NULL && tLoadProfiles[i].pszName != NULL; i++)
+    {
+        if(strcmp(pszToken,(const char*)tLoadProfiles[i].pszName) == 0)
+            break;
+    }
+    if(pszToken == NULL || tLoadProfiles[i].pszName == NULL)
+        return VSA_E_INVALID_PARAM;
+    pProfile->uiDbOptions = tLoadProfiles[i].uiDbOptions;
+    pProfile->pszDrivers  = tLoadProfiles[i].pszDrivers;
+
+    while((pszToken = strtok(NULL,",")) != NULL)/*CCQ_FUNCTION_WITH_MEMORY_OK*/
+    {
+        if(strcmp(pszToken,"bytecode") == 0)
+            pProfile->uiDbOptions |= CL_DB_BYTECODE;
+        else if(strcmp(pszToken,"nobytecode") == 0)
+            pProfile->uiDbOptions &= ~CL_DB_BYTECODE;
+        else if(strcmp(pszToken,"phishing") == 0)
+            pProfile->uiDbOptions |= CL_DB_PHISHING | CL_DB_PHISHING_URLS;
+        else if(strcmp(pszToken,"nophishing") == 0)
+            pProfile->uiDbOptions &= ~(CL_DB_PHISHING | CL_DB_PHISHING_URLS);
+        else if(strcmp(pszToken,"official") == 0)
+            pProfile->uiDbOptions |= CL_DB_OFFICIAL_ONLY;
+        else if(strcmp(pszToken,"unofficial") == 0)
+            pProfile->uiDbOptions &= ~CL_DB_OFFICIAL_ONLY;
+        else if(strcmp(pszToken,"pua") == 0)
+            pProfile->uiDbOptions |= CL_DB_PUA;
+        else if(strcmp(pszToken,"nopua") == 0)
+            pProfile->uiDbOptions &= ~(CL_DB_PUA | CL_DB_PUA_MODE | CL_DB_PUA_INCLUDE);
+        else if(strncmp(pszToken,"pua=",4) == 0 && pszToken[4] != 0)
+        {   /* libclamav expects ".cat1.cat2." */
+            pProfile->uiDbOptions |= CL_DB_PUA | CL_DB_PUA_MODE | CL_DB_PUA_INCLUDE;
+            if(_cats[0] == 0)
+                strcpy(_cats,".");
+            strcat(_cats,pszToken + 4);
+            strcat(_cats,".");
+        }
+        else
+            return VSA_E_INVALID_PARAM;
+    }
+
+    pProfile->pszName = (PChar)strdup(pszSpec);
+    if(pProfile->pszName == NULL)
+        CLEANUP(VSA_E_NO_SPACE);
+    if(_cats[0] != 0) {
+        pProfile->pszPuaCategories = (PChar)strdup(_cats);
+        if(pProfile->pszPuaCategories == NULL)
+            CLEANUP(VSA_E_NO_SPACE);
+    }
+
+cleanup:
+    if(rc != VSA_OK)
+        freeLOADPROFILE(pProfile);
+    return rc;
+} /* vsaSetLoadProfile */
+
+/**********************************************************************
+ *  vsaEqualString()
+ *
+ *  Description:
+ *     Compares two strings, each of them may be NULL.
+ *
+ **********************************************************************/
+static Bool vsaEqualString(const char *pszA, const char *pszB)
+{
+    if(pszA == NULL || pszB == NULL)
+        return (pszA == NULL && pszB == NULL) ? TRUE : FALSE;
+    return strcmp(pszA,pszB) == 0 ? TRUE : FALSE;
+} /* vsaEqualString */
+
+/**********************************************************************
+ *  vsaGetResidentKB()
+ *
+ *  Description:
+ *     Resident memory of the process in KB, 0 if not available.
+ *
+ **********************************************************************/
+static unsigned long vsaGetResidentKB(void)
+{
+    unsigned long   ulResident = 0;
+#if defined(__linux)
+    unsigned long   ulSize     = 0;
+    FILE           *fp         = fopen("/proc/self/statm","r");
+    if(fp != NULL) {
+        if(fscanf(fp,"%lu %lu",&ulSize,&ulResident) != 2)
+            ulResident = 0;
+        fclose(fp);
+    }
+    ulResident *= (unsigned long)(sysconf(_SC_PAGESIZE) / 1024);
+#endif
+    return ulResident;
+} /* vsaGetResidentKB */
+
+/**********************************************************************
+ *  vsaGetUniqueKB()
+ *
+ *  Description:
+ *     Memory only mapped by this process (private clean and dirty
+ *     pages) in KB, 0 if not available. Pages of an engine shared
+ *     copy-on-write with the parent process are not counted.
+ *
+ **********************************************************************/
+static unsigned long vsaGetUniqueKB(void)
+{
+    unsigned long   ulUnique   = 0;
+#if defined(__linux)
+    unsigned long   ulValue    = 0;
+    char            _line[256];
+    FILE           *fp         = fopen("/proc/self/smaps_rollup","r");
+    if(fp != NULL) {
+        while(fgets(_line,sizeof(_line),fp) != NULL) {
+            if(sscanf(_line,"Private_Clean: %lu",&ulValue) == 1 ||
+               sscanf(_line,"Private_Dirty: %lu",&ulValue) == 1)
+                ulUnique += ulValue;
+        }
+        fclose(fp);
+    }
+#endif
+    return ulUnique;
+} /* vsaGetUniqueKB */
 
-static VSA_RC getFileSize(Char *pszfilename, size_t *size)
+/**********************************************************************
+ *  vsaPreloadEngine()
+ *
+ *  Description:
+ *     Compiles the engine of the load profile pszSpec with the default
+ *     DB and TMP directory of VsaGetConfig in VsaStartup. SAP work
+ *     processes forked afterwards find it in the registry and share
+ *     the compiled engine copy-on-write instead of building their own.
+ *     The engine is kept until VsaCleanup. Errors are ignored, VsaInit
+ *     then compiles a private engine.
+ *
+ **********************************************************************/
+static void vsaPreloadEngine(const char *pszSpec)
 {
-      VSA_RC rc = VSA_OK;
+    VSA_RC            rc      = VSA_OK;
+    LOADPROFILE       tProfile;
+    ENGINETIMES       tTimes;
+    unsigned int      sigs    = 0;
+    Int               iErrorRC = 0;
+    PChar             pszErrorText = NULL;
+    struct cl_engine *engine  = NULL;
+    const char       *pszTmpDir = getenv("TMPDIR");
 
-      struct stat     buf;
-        if (pszfilename == NULL)
-            return VSA_E_NULL_PARAM;
-        
-        if (0!=(stat((const char*)pszfilename,&buf)))
-            return VSA_E_SCAN_FAILED;
-      
-        if(size!=NULL)
-        (*size)  = buf.st_size;
+    memset(&tTimes,0,sizeof(ENGINETIMES));
+    if(pszTmpDir == NULL)
+#ifdef _WIN32
+        pszTmpDir = ".";
+#else
+        pszTmpDir = "/tmp";
+#endif
+    if(vsaSetLoadProfile(pszSpec,&tProfile) != VSA_OK)
+        return;
+    tTimes.ulLoadLib = ulgLoadLib;
+    rc = vsaCompileEngine(pClamFPtr->fp_cl_retdbdir(),pszTmpDir,&tProfile,NULL,
+                          &sigs,&engine,&tTimes,&iErrorRC,&pszErrorText);
+    if(rc == VSA_OK) {
+        rc = vsaRegisterEngine(pClamFPtr->fp_cl_retdbdir(),pszTmpDir,&tProfile,sigs,engine,
+                               &tTimes,ENGINE_READY_TIMEOUT,&pgPreload);
+        if(rc)
+            pClamFPtr->fp_cl_engine_free(engine);
+    }
+    if(pszErrorText) free(pszErrorText);
+    freeLOADPROFILE(&tProfile);
+} /* vsaPreloadEngine */
 
-        return rc;
-}
+#ifndef _WIN32
+/**********************************************************************
+ *  vsaForkPrepare()
+ *
+ *  Description:
+ *     pthread_atfork handler, takes the global locks before fork, so
+ *     the child gets them in a consistent state. The locks are never
+ *     nested, the order is the same in all handlers.
+ *
+ **********************************************************************/
+static void vsaForkPrepare(void)
+{
+    if(bgInit == FALSE)
+        return;
+    VSA_LOCK(&tEngineLock);
+    VSA_LOCK(&tVariantLock);
+    VSA_LOCK(&tStreamLock);
+#ifdef VSI2_COMPATIBLE
+    VSA_LOCK(&tSarLock);
+#endif
+    bgForkLocked = TRUE;
+} /* vsaForkPrepare */
+
+/**********************************************************************
+ *  vsaForkParent()
+ *
+ *  Description:
+ *     pthread_atfork handler, releases the locks in the parent.
+ *
+ **********************************************************************/
+static void vsaForkParent(void)
+{
+    if(bgForkLocked == FALSE)
+        return;
+    bgForkLocked = FALSE;
+#ifdef VSI2_COMPATIBLE
+    VSA_UNLOCK(&tSarLock);
+#endif
+    VSA_UNLOCK(&tStreamLock);
+    VSA_UNLOCK(&tVariantLock);
+    VSA_UNLOCK(&tEngineLock);
+} /* vsaForkParent */
+
+/**********************************************************************
+ *  vsaForkChild()
+ *
+ *  Description:
+ *     pthread_atfork handler, resets the state of the background
+ *     threads of the parent, which do not exist in the child, and
+ *     releases the locks. Engines, which were loaded or reloaded by
+ *     such a thread, are removed from the registry of the child.
+ *     VsaInit then compiles a private engine for them. All other
+ *     engines are shared with the parent until their next signature
+ *     reload.
+ *
+ **********************************************************************/
+static void vsaForkChild(void)
+{
+    PPENGINEENTRY  ppEntry = NULL;
+    PENGINEENTRY   pEntry  = NULL;
+
+    if(bgForkLocked == FALSE)
+        return;
+    bgForkLocked = FALSE;
+    ppEntry = &pEngineList;
+    while((*ppEntry) != NULL)
+    {
+        pEntry = (*ppEntry);
+        if(pEntry->bLoading || pEntry->bReloading) {
+            /* leave the pages to the parent, do not free them here */
+            (*ppEntry)    = pEntry->pNext;
+            pEntry->pNext = NULL;
+            if(pEntry == pgPreload)
+                pgPreload = NULL;
+            continue;
+        }
+        ppEntry = &pEntry->pNext;
+    }
+    /* no thread of the child waits for an engine yet */
+    VSA_COND_INIT(&tEngineReady);
+#ifdef VSI2_COMPATIBLE
+    uigSarWorkersUsed = 0; /* the workers of the parent are not forked */
+    VSA_UNLOCK(&tSarLock);
+#endif
+    VSA_UNLOCK(&tStreamLock);
+    VSA_UNLOCK(&tVariantLock);
+    VSA_UNLOCK(&tEngineLock);
+} /* vsaForkChild */
+#endif
+
+/**********************************************************************
+ *  vsaWarmupEngine()
+ *
+ *  Description:
+ *     Scans the synthetic objects of tWarmupSamples with all parsers,
+ *     so that the first scans of SAP do not pay for the page faults
+ *     of cold engine structures and code paths. The results are
+ *     ignored. Returns the duration in milliseconds.
+ *
+ **********************************************************************/
+static unsigned long vsaWarmupEngine(const struct cl_engine *engine)
+{
+    unsigned long     ulStart  = vsaGetMillis();
+    unsigned long int scanned  = 0;
+    const char       *virname  = NULL;
+    USRDATA           usrdata;
+    int               i        = 0;
+
+    memset(&usrdata,0,sizeof(USRDATA));
+    usrdata.cl_scan_options.parse |= ~0; /* enable all parsers */
+
+    for(i=0; tWarmupSamples[i].pszName != NULL; i++)
+    {
+#ifdef VSI2_COMPATIBLE
+        {
+            Char            szExt[EXT_LN]       = ".*";
+            Char            szMimeType[MIME_LN] = "unknown/unknown";
+            Bool            text   = TRUE;
+            int             status = 1;
+            VS_OBJECTTYPE_T a = VS_OT_UNKNOWN,
+                            b = VS_OT_UNKNOWN,
+                            c = VS_OT_UNKNOWN,
+                            d = VS_OT_UNKNOWN;
+            getByteType((PByte)tWarmupSamples[i].pbData,tWarmupSamples[i].lLength,NULL,NULL,
+                        szExt,szMimeType,0,&status,&text,&a,&b,&c,&d);
+        }
+#endif
+        vsaScanMemory(engine,
+                      (PChar)tWarmupSamples[i].pszName,
+                      (PByte)tWarmupSamples[i].pbData,
+                      tWarmupSamples[i].lLength,
+                      &virname,
+                      &scanned,
+                      &usrdata);
+    }
+    return vsaGetMillis() - ulStart;
+} /* vsaWarmupEngine */
+
+/**********************************************************************
+ *  vsaScanMemory()
+ *
+ *  Description:
+ *     Scans the buffer through a memory map of libclamav, so that it
+ *     needs no copy to a temporary file. Returns the ClamAV return code.
+ *
+ **********************************************************************/
+static int vsaScanMemory(const struct cl_engine *engine,
+                         PChar              pszObjectName,
+                         PByte              pObject,
+                         size_t             lObjectSize,
+                         const char       **pVirname,
+                         unsigned long int *pScanned,
+                         USRDATA           *pUsrData)
+{
+    int         clam_rc = CL_CLEAN;
+    cl_fmap_t  *map     = NULL;
+
+    if(lObjectSize == 0)
+        return CL_CLEAN; /* nothing to map */
+    map = pClamFPtr->fp_cl_fmap_open_memory((const void*)pObject,lObjectSize);
+    if(map == NULL)
+        return CL_EMAP;
+    /* CCQ_OFF */
+#ifdef CL_SCAN_STDOPT
+    clam_rc = pClamFPtr->fp_cl_scanmap_callback(map,pVirname,pScanned,engine,CL_SCAN_STDOPT,NULL);
+#else
+    clam_rc = pClamFPtr->fp_cl_scanmap_callback(map,(const char*)pszObjectName,pVirname,pScanned,engine,&pUsrData->cl_scan_options,NULL);
+#endif
+    /* CCQ_ON */
+    pClamFPtr->fp_cl_fmap_close(map);
+    return clam_rc;
+} /* vsaScanMemory */
+
+/**********************************************************************
+ *  vsaOpenClientIO()
+ *
+ *  Description:
+ *     Opens the client I/O stream of VSA_SP_CLIENTIO with VS_IO_OPENREAD,
+ *     if the client supports it, and allocates the window of at most
+ *     lgCioWindow bytes, see CIO_WINDOW_ENV.
+ *
+ **********************************************************************/
+static VSA_RC vsaOpenClientIO(PCIOSTREAM     pStream,
+                              VSA_ENGINE     hEngine,
+                              USRDATA       *pUsrData,
+                              size_t         lLength)
+{
+    size_t lCopied = 0;
+
+    memset(pStream,0,sizeof(CIOSTREAM));
+    pStream->pfnClientIO   = pUsrData->pvCIOFncptr;
+    pStream->uiCIOMsgFlags = pUsrData->uiCIOMsgFlags;
+    pStream->hEngine       = hEngine;
+    pStream->lLength       = lLength;
+    pStream->lWindowSize   = lLength < lgCioWindow ? lLength : lgCioWindow;
+    pStream->pbWindow      = (PByte)malloc(pStream->lWindowSize);
+    if(pStream->pbWindow == NULL)
+        return VSA_E_NO_SPACE;
+    if(pStream->uiCIOMsgFlags & VS_IO_OPENREAD)
+    {
+        if(pStream->pfnClientIO(hEngine,VS_IO_OPENREAD,NULL,0,&lCopied) != VS_CB_OK)
+        {
+            vsaCloseClientIO(pStream);
+            return VSA_E_CIO_FAILED;
+        }
+    }
+    pStream->bOpen = TRUE;
+    return VSA_OK;
+} /* vsaOpenClientIO */
+
+/**********************************************************************
+ *  vsaReadClientIO()
+ *
+ *  Description:
+ *     Read callback of the handle map. Serves the request from the
+ *     window and pulls the stream forward with VS_IO_READ. Bytes before
+ *     the requested offset are dropped when the window is full, a read
+ *     before the window starts the stream again. Returns the number of
+ *     bytes copied, 0 at the end and -1 on a client I/O error.
+ *
+ **********************************************************************/
+static off_t vsaReadClientIO(void *handle, void *buf, size_t count, off_t offset)
+{
+    PCIOSTREAM pStream = (PCIOSTREAM)handle;
+    size_t     lOffset = (size_t)offset;
+    size_t     lCopied = 0;
+    size_t     lDrop   = 0;
+    VS_CALLRC  cbrc    = VS_CB_OK;
+
+    if(pStream == NULL || pStream->bOpen == FALSE || offset < 0)
+        return -1;
+    if(lOffset >= pStream->lLength)
+        return 0;
+    if(lOffset < pStream->lStart)
+    {
+        /* the stream is forward-only, start it again */
+        if((pStream->uiCIOMsgFlags & (VS_IO_OPENREAD|VS_IO_CLOSEREAD)) != (VS_IO_OPENREAD|VS_IO_CLOSEREAD))
+            return -1;
+        pStream->pfnClientIO(pStream->hEngine,VS_IO_CLOSEREAD,NULL,0,&lCopied);
+        if(pStream->pfnClientIO(pStream->hEngine,VS_IO_OPENREAD,NULL,0,&lCopied) != VS_CB_OK)
+        {
+            pStream->bOpen = FALSE;
+            return -1;
+        }
+        pStream->lStart = 0;
+        pStream->lFill  = 0;
+        pStream->bEof   = FALSE;
+    }
+    while(lOffset + count > pStream->lStart + pStream->lFill && pStream->bEof == FALSE)
+    {
+        if(pStream->lFill == pStream->lWindowSize || lOffset >= pStream->lStart + pStream->lFill)
+        {
+            /* make room, the bytes before the requested offset go */
+            lDrop = lOffset - pStream->lStart;
+            if(lDrop > pStream->lFill)
+                lDrop = pStream->lFill;
+            if(lDrop == 0)
+                break; /* request larger than the window */
+            memmove(pStream->pbWindow,pStream->pbWindow + lDrop,pStream->lFill - lDrop);
+            pStream->lStart += lDrop;
+            pStream->lFill  -= lDrop;
+        }
+        lCopied = 0;
+        cbrc = pStream->pfnClientIO(pStream->hEngine,
+                                    VS_IO_READ,
+                                    pStream->pbWindow + pStream->lFill,
+                                    pStream->lWindowSize - pStream->lFill,
+                                    &lCopied);
+        if(cbrc == VS_CB_EOF || (cbrc == VS_CB_OK && lCopied == 0))
+        {
+            pStream->bEof = TRUE;
+            break;
+        }
+        if(cbrc != VS_CB_OK || lCopied > pStream->lWindowSize - pStream->lFill)
+            return -1;
+        pStream->lFill += lCopied;
+    }
+    if(lOffset >= pStream->lStart + pStream->lFill)
+        return 0;
+    lCopied = pStream->lStart + pStream->lFill - lOffset;
+    if(lCopied > count)
+        lCopied = count;
+    memcpy(buf,pStream->pbWindow + (lOffset - pStream->lStart),lCopied);
+    return (off_t)lCopied;
+} /* vsaReadClientIO */
+
+/**********************************************************************
+ *  vsaCloseClientIO()
+ *
+ *  Description:
+ *     Closes the client I/O stream and releases the window.
+ *
+ **********************************************************************/
+static void vsaCloseClientIO(PCIOSTREAM pStream)
+{
+    size_t lCopied = 0;
+
+    if(pStream == NULL)
+        return;
+    if(pStream->bOpen == TRUE && (pStream->uiCIOMsgFlags & VS_IO_CLOSEREAD))
+        pStream->pfnClientIO(pStream->hEngine,VS_IO_CLOSEREAD,NULL,0,&lCopied);
+    pStream->bOpen = FALSE;
+    if(pStream->pbWindow) free(pStream->pbWindow);
+    pStream->pbWindow = NULL;
+} /* vsaCloseClientIO */
+
+/**********************************************************************
+ *  vsaScanClientIO()
+ *
+ *  Description:
+ *     Scans the client I/O stream through a handle map of libclamav,
+ *     which pulls the data with vsaReadClientIO. Returns the ClamAV
+ *     return code.
+ *
+ **********************************************************************/
+static int vsaScanClientIO(const struct cl_engine *engine,
+                           PChar              pszObjectName,
+                           PCIOSTREAM         pStream,
+                           const char       **pVirname,
+                           unsigned long int *pScanned,
+                           USRDATA           *pUsrData)
+{
+    int         clam_rc = CL_CLEAN;
+    cl_fmap_t  *map     = NULL;
+
+    map = pClamFPtr->fp_cl_fmap_open_handle((void*)pStream,0,pStream->lLength,vsaReadClientIO,1);
+    if(map == NULL)
+        return CL_EMAP;
+    /* CCQ_OFF */
+#ifdef CL_SCAN_STDOPT
+    clam_rc = pClamFPtr->fp_cl_scanmap_callback(map,pVirname,pScanned,engine,CL_SCAN_STDOPT,NULL);
+#else
+    clam_rc = pClamFPtr->fp_cl_scanmap_callback(map,(const char*)pszObjectName,pVirname,pScanned,engine,&pUsrData->cl_scan_options,NULL);
+#endif
+    /* CCQ_ON */
+    pClamFPtr->fp_cl_fmap_close(map);
+    return clam_rc;
+} /* vsaScanClientIO */
+
+/**********************************************************************
+ *  vsaStreamSession()
+ *
+ *  Description:
+ *     Returns the upload stream of the VSA_INIT handle and job ID,
+ *     VSA_SP_STREAM_OPEN creates it and drops an abandoned one with the
+ *     same key. The bytes of the call are appended to the stream, a
+ *     stream above lLimit is not scanned. The caller holds a reference
+ *     on the stream until vsaReleaseStream.
+ *
+ **********************************************************************/
+static VSA_RC vsaStreamSession(PVSA_INIT        p_init,
+                               PVSA_SCANPARAM   p_scanparam,
+                               size_t           lLimit,
+                               PPSTREAMSESSION  ppSession)
+{
+    PPSTREAMSESSION ppEntry  = NULL;
+    PSTREAMSESSION  pSession = NULL;
+    PSTREAMSESSION  pOld     = NULL;
+    PByte           pbData   = NULL;
+    size_t          lAlloc   = 0;
+
+    (*ppSession) = NULL;
+    if(p_scanparam->tScanCode == VSA_SP_STREAM_OPEN)
+    {
+        pSession = (PSTREAMSESSION)calloc(1,sizeof(STREAMSESSION));
+        if(pSession == NULL)
+            return VSA_E_NO_SPACE;
+        pSession->pInit   = p_init;
+        pSession->uiJobID = p_scanparam->uiJobID;
+        pSession->uiRefs  = 1; /* reference of the list */
+#ifdef VSI2_COMPATIBLE
+        pSession->pType   = (PTYPESTATE)calloc(1,sizeof(TYPESTATE));
+        if(pSession->pType == NULL) {
+            freeSTREAMSESSION(&pSession);
+            return VSA_E_NO_SPACE;
+        }
+        pSession->pType->iStatus = 1;
+        pSession->pType->bText   = TRUE;
+        strcpy((char*)pSession->pType->szExt,".*");
+        strcpy((char*)pSession->pType->szMimeType,"unknown/unknown");
+#endif
+    }
+    VSA_LOCK(&tStreamLock);
+    for(ppEntry = &pStreamList; (*ppEntry) != NULL; ppEntry = &(*ppEntry)->pNext)
+    {
+        if((*ppEntry)->pInit == p_init && (*ppEntry)->uiJobID == p_scanparam->uiJobID)
+            break;
+    }
+    if(pSession != NULL)
+    {
+        if((*ppEntry) != NULL) {
+            pOld        = (*ppEntry);
+            (*ppEntry)  = pOld->pNext;
+            if(--pOld->uiRefs > 0)
+                pOld = NULL; /* still in use, freed by the last release */
+        }
+        pSession->pNext = pStreamList;
+        pStreamList     = pSession;
+    }
+    else
+    {
+        pSession = (*ppEntry);
+    }
+    if(pSession != NULL)
+        pSession->uiRefs++;
+    VSA_UNLOCK(&tStreamLock);
+    freeSTREAMSESSION(&pOld);
+    if(pSession == NULL)
+        return VSA_E_INVALID_PARAM;
+
+    (*ppSession) = pSession;
+    if(p_scanparam->pbByte != NULL && p_scanparam->lLength > 0)
+    {
+        if(p_scanparam->lLength > lLimit || pSession->lFill > lLimit - p_scanparam->lLength)
+            return VSA_E_NOT_SCANNED;
+        if(pSession->lFill + p_scanparam->lLength > pSession->lAlloc)
+        {
+            lAlloc = pSession->lAlloc > 0 ? pSession->lAlloc : STREAM_ALLOC_MIN;
+            while(lAlloc < pSession->lFill + p_scanparam->lLength)
+                lAlloc *= 2;
+            pbData = (PByte)realloc(pSession->pbData,lAlloc);
+            if(pbData == NULL)
+                return VSA_E_NO_SPACE;
+            pSession->pbData = pbData;
+            pSession->lAlloc = lAlloc;
+        }
+        memcpy(pSession->pbData + pSession->lFill,p_scanparam->pbByte,p_scanparam->lLength);
+        pSession->lFill += p_scanparam->lLength;
+    }
+    return VSA_OK;
+} /* vsaStreamSession */
+
+#ifdef VSI2_COMPATIBLE
+/**********************************************************************
+ *  vsaCheckStreamTail()
+ *
+ *  Description:
+ *     Checks the chunk of lByte bytes, which vsaStreamSession appended
+ *     last, for active content. The check starts STREAM_TAIL_LN bytes
+ *     before the chunk, so a marker spanning two chunks is found.
+ *
+ **********************************************************************/
+static VSA_RC vsaCheckStreamTail(PSTREAMSESSION  pSession,
+                                 size_t          lByte,
+                                 VS_OBJECTTYPE_T tObjectType,
+                                 Bool            bPdfAllowOpenAction)
+{
+    size_t lPrev = 0;
+    size_t lTail = 0;
+
+    if(lByte == 0 || lByte > pSession->lFill)
+        return VSA_OK;
+    lPrev = pSession->lFill - lByte;
+    lTail = lPrev < STREAM_TAIL_LN ? lPrev : STREAM_TAIL_LN;
+    return check4ActiveContent(pSession->pbData + lPrev - lTail,lTail + lByte,tObjectType,bPdfAllowOpenAction);
+} /* vsaCheckStreamTail */
+#endif
+
+/**********************************************************************
+ *  vsaReleaseStream()
+ *
+ *  Description:
+ *     Drops the reference of the caller on the upload stream, bClose
+ *     also removes the stream from the list. The last reference
+ *     frees it.
+ *
+ **********************************************************************/
+static void vsaReleaseStream(PSTREAMSESSION pSession, Bool bClose)
+{
+    PPSTREAMSESSION ppEntry = NULL;
+
+    VSA_LOCK(&tStreamLock);
+    for(ppEntry = &pStreamList; bClose == TRUE && (*ppEntry) != NULL; ppEntry = &(*ppEntry)->pNext)
+    {
+        if((*ppEntry) == pSession) {
+            (*ppEntry) = pSession->pNext;
+            pSession->uiRefs--;
+            break;
+        }
+    }
+    if(--pSession->uiRefs > 0)
+        pSession = NULL;
+    VSA_UNLOCK(&tStreamLock);
+    freeSTREAMSESSION(&pSession);
+} /* vsaReleaseStream */
+
+/**********************************************************************
+ *  vsaReleaseStreams()
+ *
+ *  Description:
+ *     Frees the upload streams of a VSA_INIT handle, which were never
+ *     closed. NULL frees all of them.
+ *
+ **********************************************************************/
+static void vsaReleaseStreams(PVSA_INIT p_init)
+{
+    PPSTREAMSESSION ppEntry  = NULL;
+    PSTREAMSESSION  pSession = NULL;
+    PSTREAMSESSION  pFree    = NULL;
+
+    VSA_LOCK(&tStreamLock);
+    ppEntry = &pStreamList;
+    while((*ppEntry) != NULL)
+    {
+        pSession = (*ppEntry);
+        if(p_init == NULL || pSession->pInit == p_init) {
+            (*ppEntry)      = pSession->pNext;
+            if(--pSession->uiRefs == 0) { /* else freed by the last scan */
+                pSession->pNext = pFree;
+                pFree           = pSession;
+            }
+        }
+        else {
+            ppEntry = &pSession->pNext;
+        }
+    }
+    VSA_UNLOCK(&tStreamLock);
+    while(pFree != NULL)
+    {
+        pSession = pFree;
+        pFree    = pFree->pNext;
+        freeSTREAMSESSION(&pSession);
+    }
+} /* vsaReleaseStreams */
 
 static VSA_RC registerCallback(VSA_CALLBACK *p_callback, USRDATA *usrdata)
 {
@@ -2581,6 +5974,11 @@ static VSA_RC registerCallback(VSA_CALLBACK *p_callback, USRDATA *usrdata)
             usrdata->pvFncptr   = p_callback->pEventCBFP;
             usrdata->pvUsrdata  = p_callback->pvUsrData;
         }
+        if (p_callback->pClientIOCBFP != NULL && (p_callback->uiCIOMsgFlags & VS_IO_READ))
+        {
+            usrdata->pvCIOFncptr   = (VSA_CIOCBFP)p_callback->pClientIOCBFP;
+            usrdata->uiCIOMsgFlags = p_callback->uiCIOMsgFlags;
+        }
         if ( p_callback->pEventCBFP       == NULL ||  
              p_callback->uiEventMsgFlags == 0
             )           
@@ -2634,6 +6032,79 @@ static void freeVSA_INIT(VSA_INIT **pp_init)
   }
 }
 
+static void freeENGINEENTRY(ENGINEENTRY **pp_entry)
+{
+  if(pp_entry != NULL && (*pp_entry) != NULL)
+  {
+    if ((*pp_entry)->bDbStat == TRUE && pClamFPtr && pClamFPtr->fp_cl_statfree)
+        pClamFPtr->fp_cl_statfree(&(*pp_entry)->tDbStat);
+    if ((*pp_entry)->pCurrent != NULL)
+        free((*pp_entry)->pCurrent);
+    if ((*pp_entry)->pszDbDir != NULL)
+        free((*pp_entry)->pszDbDir);
+    if ((*pp_entry)->pszTmpDir != NULL)
+        free((*pp_entry)->pszTmpDir);
+    if ((*pp_entry)->pszLoadError != NULL)
+        free((*pp_entry)->pszLoadError);
+    freeLOADPROFILE(&(*pp_entry)->tProfile);
+    free((*pp_entry));
+    (*pp_entry) = NULL;
+  }
+}
+
+static void freeSTREAMSESSION(STREAMSESSION **pp_session)
+{
+  if(pp_session != NULL && (*pp_session) != NULL)
+  {
+    if ((*pp_session)->pbData != NULL)
+        free((*pp_session)->pbData);
+    if ((*pp_session)->pType != NULL)
+        free((*pp_session)->pType);
+    free((*pp_session));
+    (*pp_session) = NULL;
+  }
+}
+
+#ifdef VSI2_COMPATIBLE
+static void freeSARJOB(SARJOB **pp_job)
+{
+  UInt i = 0;
+
+  if(pp_job != NULL && (*pp_job) != NULL)
+  {
+    for(i = 0; i < (*pp_job)->tScanInfo.uiInfections; i++)
+        freevirusinfo2(&((*pp_job)->tScanInfo.pVirusInfo[i]));
+    for(i = 0; i < (*pp_job)->tScanInfo.uiScanErrors; i++)
+        freescanerror2(&((*pp_job)->tScanInfo.pScanError[i]));
+    for(i = 0; i < (*pp_job)->tScanInfo.uiScanned; i++)
+        freecontentinfo2(&((*pp_job)->tScanInfo.pContentInfo[i]));
+    if ((*pp_job)->tScanInfo.pVirusInfo != NULL)
+        free((*pp_job)->tScanInfo.pVirusInfo);
+    if ((*pp_job)->tScanInfo.pScanError != NULL)
+        free((*pp_job)->tScanInfo.pScanError);
+    if ((*pp_job)->tScanInfo.pContentInfo != NULL)
+        free((*pp_job)->tScanInfo.pContentInfo);
+    if ((*pp_job)->pszFileName != NULL)
+        free((*pp_job)->pszFileName);
+    free((*pp_job));
+    (*pp_job) = NULL;
+  }
+}
+#endif
+
+static void freeLOADPROFILE(LOADPROFILE *pProfile)
+{
+  if(pProfile != NULL)
+  {
+    if (pProfile->pszName != NULL)
+        free(pProfile->pszName);
+    if (pProfile->pszPuaCategories != NULL)
+        free(pProfile->pszPuaCategories);
+    pProfile->pszName          = NULL;
+    pProfile->pszPuaCategories = NULL;
+  }
+}
+
 static void freeVSA_CONFIG(VSA_CONFIG **pp_config)
 {
   if(pp_config != NULL && (*pp_config) != NULL)
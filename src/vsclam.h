@@ -80,6 +80,61 @@ extern "C"
 
 #define CLAMAV_DRIVERS_LN   (sizeof(CLAMAV_DRIVERS)-1)
 
+/* seconds between two checks of the DB directory for changed files,
+ * can be set with the environment CLAMSAP_RELOAD_CHECK, 0 disables the
+ * hot reload of the signatures
+ */
+#define ENGINE_RELOAD_CHECK 60
+
+/* number of engines with own scan limits per signature generation.
+ * Each one is a complete compiled engine and needs as much memory as
+ * the engine with the default limits, so a generation holds up to
+ * 1 + MAX_ENGINE_VARIANTS engines, and twice as many while a reload
+ * compiles the next generation. A new limit combination is compiled in
+ * the background and the scans with these limits wait for it; scans
+ * with further combinations are not scanned.
+ */
+#define MAX_ENGINE_VARIANTS 4
+
+/* with the environment CLAMSAP_ASYNC_INIT=1 VsaInit returns before the
+ * engine is compiled and VsaScan waits for it up to VS_IP_INITTIMEOUT
+ * seconds, default ENGINE_READY_TIMEOUT
+ */
+#define ENGINE_READY_TIMEOUT 300
+
+/* signature load profile of VS_IP_INITENGINES, such as "lean" or
+ * "standard,nobytecode,pua=Win.Tool". See tLoadProfiles for the names.
+ */
+#define LOAD_PROFILE_DEFAULT "default"
+#define LOAD_PROFILE_LN      255
+
+/* with the environment CLAMSAP_PRELOAD=<load profile> VsaStartup compiles
+ * the engine before the SAP work processes are forked, so that they share
+ * its pages copy-on-write
+ */
+#define PRELOAD_ENV          "CLAMSAP_PRELOAD"
+
+/* with the environment CLAMSAP_WARMUP=1 each compiled engine scans the
+ * synthetic objects of tWarmupSamples once, before it is used by VsaScan
+ */
+#define WARMUP_ENV           "CLAMSAP_WARMUP"
+
+/* VSA_SP_CLIENTIO reads the object through the client I/O callback and
+ * keeps at most a window of CLAMSAP_CIO_WINDOW bytes of it in memory
+ */
+#define CIO_WINDOW_ENV       "CLAMSAP_CIO_WINDOW"
+#define CIO_WINDOW_DEFAULT   (1024*1024)
+#define CIO_WINDOW_MIN       65536
+
+/* with the environment CLAMSAP_SAR_WORKERS=<n> the entries of a SAR
+ * archive are checked and scanned by up to n threads per scan, all scans
+ * of the process share at most CLAMSAP_SAR_WORKERS_MAX threads
+ */
+#define SAR_WORKERS_ENV      "CLAMSAP_SAR_WORKERS"
+#define SAR_WORKERS_MAX_ENV  "CLAMSAP_SAR_WORKERS_MAX"
+#define SAR_WORKERS_MAX      16
+#define SAR_WORKERS_LIMIT    256
+
 #define ENGINE_DATA(x,y,z) \
     _utc_date.tm_mon = y-1;  \
     _utc_date.tm_mday= x;    \
@@ -121,6 +176,16 @@ struct cl_scan_options {
 #endif
 typedef struct cl_scan_options CLAM_SCAN_OPT;
 
+/* scan limits of VS_OP_SCANLIMIT, VS_OP_SCANEXTRACT_SIZE and
+ * VS_OP_SCANEXTRACT_DEPTH, 0 means the libclamav default
+ */
+struct enginelimits {
+    long long       llMaxScanSize;
+    long long       llMaxFileSize;
+    long long       llMaxRecursion;
+};
+typedef struct enginelimits ENGINELIMITS, *PENGINELIMITS;
+
 /* structure for transporting our usrdata + our 
  * function pointer + virus_info 
  */
@@ -131,6 +196,8 @@ struct usrdata {
     size_t          lObjectSize;
     VSA_EVENTCBFP   pvFncptr;
     void           *pvUsrdata;
+    VSA_CIOCBFP     pvCIOFncptr;
+    UInt            uiCIOMsgFlags;
     Bool            bScanBestEffort;
     Bool            bScanAllFiles;
     Bool            bScanCompressed;
@@ -149,17 +216,213 @@ struct usrdata {
     PVSA_SCANINFO   pScanInfo;
     VS_MESSAGE_T    tMsg_rc;
     CLAM_SCAN_OPT   cl_scan_options;
+    ENGINELIMITS    tLimits;
 };
 typedef struct usrdata USRDATA, *PUSRDATA, **PPUSRDATA;
 
+/* forward-only stream of the client I/O callback. The window holds the
+ * bytes [lStart, lStart+lFill) of the object, a read before lStart
+ * re-opens the stream.
+ */
+struct ciostream {
+    VSA_CIOCBFP     pfnClientIO;
+    VSA_ENGINE      hEngine;
+    UInt            uiCIOMsgFlags;
+    PByte           pbWindow;
+    size_t          lWindowSize;
+    size_t          lStart;
+    size_t          lFill;
+    size_t          lLength;
+    Bool            bOpen;
+    Bool            bEof;
+};
+typedef struct ciostream CIOSTREAM, *PCIOSTREAM;
+
+#ifdef VSI2_COMPATIBLE
+/* SAR entry, which is decompressed block by block for the handle map.
+ * The block holds the bytes [lStart, lStart+lFill) of the entry, a
+ * read before lStart starts the entry again, see SarRewindEntry.
+ */
+struct sarstream {
+    struct SARIterator *pSar;
+    PByte           pbBlock;
+    size_t          lStart;
+    size_t          lFill;
+    size_t          lLength;
+    Bool            bEof;
+};
+typedef struct sarstream SARSTREAM, *PSARSTREAM;
+#endif
+
+/* upload stream of VSA_SP_STREAM_OPEN/WRITE/CLOSE. The chunks of one
+ * VSA_INIT handle and job ID are collected until the close, the type
+ * detection runs on each chunk, see TYPESTATE in vsmime.h, the active
+ * content check once on the whole stream at the close. The list and
+ * each VsaScan call on the stream hold a reference in uiRefs.
+ */
+struct streamsession {
+    PVSA_INIT               pInit;
+    UInt                    uiJobID;
+    UInt                    uiRefs;
+    PByte                   pbData;
+    size_t                  lFill;
+    size_t                  lAlloc;
+    struct typestate       *pType;
+    struct streamsession   *pNext;
+};
+typedef struct streamsession STREAMSESSION, *PSTREAMSESSION, **PPSTREAMSESSION;
+#define STREAM_ALLOC_MIN     65536
+#define STREAM_TAIL_LN       32   /* > longest marker of check4ActiveContent */
+/* size limit of an upload stream and of a SAR archive read through
+ * client I/O, unless the scan or file size limit of VSA_OPTPARAM is
+ * lower. CLAMSAP_STREAM_MAX overrides the default
+ */
+#define STREAM_MAX_ENV       "CLAMSAP_STREAM_MAX"
+#define STREAM_MAX_DEFAULT   ((size_t)1024*1024*1024)
+
 struct initdata {
    PVSA_INITPARAM   enginedirectory;
    PVSA_INITPARAM   initdirectory;
    PVSA_INITPARAM   drivers;
    PVSA_INITPARAM   tmpdir;
+   PVSA_INITPARAM   timeout;
+   PVSA_INITPARAM   engines;
 };
 typedef struct initdata INITDATA, *PINITDATA;
 
+/* one compiled cl_engine. The registry entry holds a reference to the
+ * current generation and each running scan holds its own, so a
+ * replaced engine is freed when the last scan on it has finished.
+ */
+/* phase timings of the engine startup in milliseconds and the
+ * resident memory the engine needs in KB
+ */
+struct enginetimes {
+    unsigned long       ulLoadLib;
+    unsigned long       ulLoadDb;
+    unsigned long       ulCompile;
+    unsigned long       ulWarmup;
+    unsigned long       ulDrivers;
+    unsigned long       ulResidentKB;
+};
+typedef struct enginetimes ENGINETIMES, *PENGINETIMES;
+
+/* signature load profile, maps to the cl_load DB options */
+struct loadprofile {
+    PChar               pszName;
+    UInt                uiDbOptions;
+    PChar               pszPuaCategories;
+    const char         *pszDrivers;
+};
+typedef struct loadprofile LOADPROFILE, *PLOADPROFILE;
+
+struct enginevariant {
+    ENGINELIMITS        tLimits;
+    struct cl_engine   *engine;
+};
+typedef struct enginevariant ENGINEVARIANT, *PENGINEVARIANT;
+
+struct enginegen {
+    struct cl_engine   *engine;
+    UInt                uiSigs;
+    UInt                uiGeneration;
+    size_t              lRefCounter;
+    /* engines compiled with other scan limits. A slot is published once
+     * with VSA_STORE_PTR and never changed, the scans read it without lock
+     */
+    PENGINEVARIANT      pVariant[MAX_ENGINE_VARIANTS];
+    /* limits of the slots given to a compile, under tVariantLock */
+    UInt                uiVariants;
+    ENGINELIMITS        tPending[MAX_ENGINE_VARIANTS];
+    /* slots whose compile failed, under tEngineLock */
+    Bool                bVariantFailed[MAX_ENGINE_VARIANTS];
+};
+typedef struct enginegen ENGINEGEN, *PENGINEGEN;
+
+/* synthetic object of the engine warm-up, see WARMUP_ENV */
+typedef struct {
+    const char          *pszName;
+    const unsigned char *pbData;
+    size_t               lLength;
+} WARMUPSAMPLE;
+
+/* process global registry of compiled engines, one entry per
+ * signature directory, temp directory and load options. The entry is
+ * the VSA_INIT hEngine, so all handles with the same key share one
+ * compiled cl_engine.
+ */
+struct engineentry {
+    struct engineentry *pNext;
+    PChar               pszDbDir;
+    PChar               pszTmpDir;
+    LOADPROFILE         tProfile;
+    size_t              lRefCounter;
+    PENGINEGEN          pCurrent;
+    ENGINETIMES         tTimes;
+    /* asynchronous load, pCurrent is NULL until it is done */
+    Bool                bLoading;
+    time_t              tReadyTimeout;
+    VSA_RC              tLoadRC;
+    PChar               pszLoadError;
+    /* hot reload of changed signature DB files */
+    Bool                bReloading;
+    Bool                bDbStat;
+    time_t              tLastCheck;
+    struct cl_stat      tDbStat;
+};
+typedef struct engineentry ENGINEENTRY, *PENGINEENTRY, **PPENGINEENTRY;
+
+/* compile of an engine variant in the background, see vsaVariantThread */
+struct variantjob {
+    PENGINEENTRY        pEntry;
+    PENGINEGEN          pGen;
+    UInt                uiSlot;
+};
+typedef struct variantjob VARIANTJOB, *PVARIANTJOB;
+
+#ifdef VSI2_COMPATIBLE
+/* entry of a SAR archive for the worker pool. The results of the entry
+ * are collected in tScanInfo and merged in archive order by the scan.
+ */
+struct sarjob {
+    struct SARMark  tMark;
+    UInt            uiJobID;
+    PChar           pszObjectName;
+    PChar           pszFileName;
+    size_t          lLength;
+    USRDATA         tUsrData;
+    VSA_SCANINFO    tScanInfo;
+    VSA_RC          rcCheck;
+    VSA_RC          rc;
+    Bool            bDone;
+    Char            szReason[1024];
+};
+typedef struct sarjob SARJOB, *PSARJOB;
+
+/* worker pool of one SAR scan. The scan queues the entries, each worker
+ * checks and scans them with an own iterator on the archive. The number
+ * of workers is limited per scan and per process, see SAR_WORKERS_ENV.
+ */
+struct sarpool {
+    VSA_MUTEX       tLock;
+    VSA_COND        tCond;
+    void           *pEngine;
+    PChar           pszArchive;
+    PByte           pObject;
+    size_t          lObjectSize;
+    USRDATA         tUsrData;
+    PSARJOB        *ppJobs;
+    UInt            uiJobs;
+    UInt            uiAlloc;
+    UInt            uiNext;
+    UInt            uiMerged;
+    UInt            uiWorkers;
+    UInt            uiRunning;
+    Bool            bClosed;
+};
+typedef struct sarpool SARPOOL, *PSARPOOL;
+#endif
+
 /* helper macros */
 #define VSAddINITParameter(pl, i, c, a, b, s) \
 {       pl[i].struct_size    = sizeof(VSA_INITPARAM); \
@@ -222,12 +485,22 @@ typedef long long (FN_CL_ENGINE_GET_NUM)(const struct cl_engine *, enum cl_engin
 typedef int (FN_CL_ENGINE_SET_NUM)(struct cl_engine *, enum cl_engine_field f, long long);
 typedef int (FN_CL_ENGINE_COMPILE)(struct cl_engine *);
 typedef int (FN_CL_LOAD)(const char *, struct cl_engine *, unsigned int *, unsigned int);
+typedef int (FN_CL_STATINIDIR)(const char *, struct cl_stat *);
+typedef int (FN_CL_STATCHKDIR)(const struct cl_stat *);
+typedef int (FN_CL_STATFREE)(struct cl_stat *);
 typedef unsigned int (FN_CL_RETFLEVEL)(void);
 #ifdef CL_SCAN_STDOPT
 typedef int (FN_CL_SCANFILE)(const char *, const char **, unsigned long int *, const struct cl_engine *, unsigned int);
+typedef int (FN_CL_SCANDESC)(int, const char **, unsigned long int *, const struct cl_engine *, unsigned int);
+typedef int (FN_CL_SCANMAP_CALLBACK)(cl_fmap_t *, const char **, unsigned long int *, const struct cl_engine *, unsigned int, void *);
 #else
 typedef int (FN_CL_SCANFILE)(const char *, const char **, unsigned long int *, const struct cl_engine *, struct cl_scan_options *);
+typedef int (FN_CL_SCANDESC)(int, const char *, const char **, unsigned long int *, const struct cl_engine *, struct cl_scan_options *);
+typedef int (FN_CL_SCANMAP_CALLBACK)(cl_fmap_t *, const char *, const char **, unsigned long int *, const struct cl_engine *, struct cl_scan_options *, void *);
 #endif
+typedef cl_fmap_t * (FN_CL_FMAP_OPEN_MEMORY)(const void *, size_t);
+typedef cl_fmap_t * (FN_CL_FMAP_OPEN_HANDLE)(void *, size_t, size_t, clcb_pread, int);
+typedef void (FN_CL_FMAP_CLOSE)(cl_fmap_t *);
 typedef void     *DLL_HDL;
 typedef struct {
     /* function pointers for clamav functions in libclamav library */
@@ -245,6 +518,14 @@ typedef struct {
     FN_CL_ENGINE_SET_NUM    *fp_cl_engine_set_num;
     FN_CL_RETFLEVEL         *fp_cl_retflevel;
     FN_CL_SCANFILE          *fp_cl_scanfile;
+    FN_CL_SCANDESC          *fp_cl_scandesc;
+    FN_CL_STATINIDIR        *fp_cl_statinidir;
+    FN_CL_STATCHKDIR        *fp_cl_statchkdir;
+    FN_CL_STATFREE          *fp_cl_statfree;
+    FN_CL_FMAP_OPEN_MEMORY  *fp_cl_fmap_open_memory;
+    FN_CL_FMAP_OPEN_HANDLE  *fp_cl_fmap_open_handle;
+    FN_CL_FMAP_CLOSE        *fp_cl_fmap_close;
+    FN_CL_SCANMAP_CALLBACK  *fp_cl_scanmap_callback;
     /* handle */
     char                     bLoaded;
     DLL_HDL                  dll_hdl;
@@ -78,6 +78,13 @@
 /*      freeVSA_INIT                                                  */
 /*      freeVSA_CONFIG                                                */
 /*      getFileSize                                                   */
+/*      vsaStreamSession                                              */
+/*      vsaSendChunk2Clamd                                            */
+/*      vsaCloseStream2Clamd                                          */
+/*      vsaCheckStreamTail                                            */
+/*      vsaReleaseStream                                              */
+/*      vsaReleaseStreams                                             */
+/*      freeSTREAMSESSION                                             */
 /*                                                                    */
 /**********************************************************************/
 /*--------------------------------------------------------------------*/
@@ -115,6 +122,13 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <errno.h>
+#include <aio.h>
+#ifdef __linux
+#include <sys/syscall.h>
+#endif
 #endif
 
 #include <stdlib.h>
@@ -128,11 +142,9 @@
 /* Own includes                                                       */
 /*--------------------------------------------------------------------*/
 #include "vsaxxtyp.h"
-#include "vsclamd.h"
-#ifdef VSI2_COMPATIBLE
 #include "csdecompr.h"
+#include "vsclamd.h"
 #include "vsmime.h"
-#endif
 
 /*--------------------------------------------------------------------*/
 /* static globals                                                     */
@@ -148,7 +160,12 @@ static const char        version[]          =   "@[ C ]CLAMSAP: " VSA_ADAPTER_VE
 static PChar             pClamdaemon        = NULL;
 #ifdef VSI2_COMPATIBLE
 static PChar             pLoadError         = NULL;
+static size_t            lgSarEntryMax      = SAR_ENTRY_MAX_DEFAULT;
 #endif
+static VSA_MUTEX         tStreamLock;
+static PSTREAMSESSION    pStreamList        = NULL;
+static size_t            lgStreamMax        = STREAM_MAX_DEFAULT;
+static int               igIoDepth          = IO_DEPTH_DEFAULT;
 
 #define INT_2_BYTES(cres, num)                 \
 {                                              \
@@ -217,6 +234,24 @@ static VSA_RC scanCompressedBuffer(
     PChar           pszObjectName,
     PByte           pObject,
     size_t          lObjectSize,
+    struct SARIterator *pOuter,
+    USRDATA        *pUsrData,
+    PChar           errorReason);
+
+static VSA_RC scanStream(
+    void           *pEngine,
+    UInt            uiJobID,
+    PChar           pszObjectName,
+    PSTREAMSESSION  pSession,
+    USRDATA        *pUsrData,
+    PChar           errorReason);
+
+static VSA_RC scanSarEntry(
+    void           *pEngine,
+    UInt            uiJobID,
+    PChar           pszObjectName,
+    struct SARIterator *pSar,
+    struct SAREntry *_loc,
     USRDATA        *pUsrData,
     PChar           errorReason);
 
@@ -234,11 +269,38 @@ static VSA_RC setScanError(UInt            uiJobID,
 /*
  * socket conntect method
  */
-static VSA_RC vsaConnectd( PChar server, PChar port, PChar zCommand, PPChar zAnswer);
+static int vsaOpenClamd( PCLAMDCON pConnection);
+static VSA_RC vsaConnectd( PCLAMDCON pConnection, PChar zCommand, PPChar zAnswer);
 /*
  * send byte stream to clamd
  */
-static VSA_RC vsaSendBytes2Clamd( PChar server, PChar port, FILE *pFP, PByte pByte, size_t lByte, PPChar zAnswer);
+static VSA_RC vsaSendBytes2Clamd( PCLAMDCON pConnection, FILE *pFP, PByte pByte, size_t lByte, PPChar zAnswer);
+#ifndef _WIN32
+/*
+ * pass file descriptor to local clamd
+ */
+static VSA_RC vsaSendFd2Clamd( PCLAMDCON pConnection, FILE *pFP, PByte pByte, size_t lByte, PPChar zAnswer);
+static int vsaCreateSharedObject( PByte pByte, size_t lByte, FILE **ppFP);
+/*
+ * read ahead of files sent with zINSTREAM, see READAHEAD
+ */
+static VSA_RC vsaOpenReadAhead( PREADAHEAD pAhead, int iFd, size_t lLength);
+static void vsaQueueReadAhead( PREADAHEAD pAhead, int i);
+static int vsaReadAhead( PREADAHEAD pAhead, PPByte ppData);
+static void vsaCloseReadAhead( PREADAHEAD pAhead);
+#endif
+/*
+ * upload streams, see STREAMSESSION
+ */
+static VSA_RC vsaStreamSession( PVSA_INIT p_init, PVSA_SCANPARAM p_scanparam, PPSTREAMSESSION ppSession);
+static VSA_RC vsaSendChunk2Clamd( int s, PByte pByte, size_t lByte);
+static VSA_RC vsaCloseStream2Clamd( PSTREAMSESSION pSession, PPChar zAnswer);
+#ifdef VSI2_COMPATIBLE
+static VSA_RC vsaCheckStreamTail( PSTREAMSESSION pSession, PByte pByte, size_t lByte, VS_OBJECTTYPE_T tObjectType, Bool bPdfAllowOpenAction);
+#endif
+static void vsaReleaseStream( PSTREAMSESSION pSession, Bool bClose);
+static void vsaReleaseStreams( PVSA_INIT p_init);
+static void freeSTREAMSESSION( STREAMSESSION **pp_session);
 
 /*
  * parse URI
@@ -287,6 +349,10 @@ static VSA_RC getFileSize(Char *, size_t *);
 #ifndef DEFAULT_PORT
 #define DEFAULT_PORT       "3310"
 #endif
+
+#ifndef LOCAL_PROTOCOL
+#define LOCAL_PROTOCOL     "unix"
+#endif
 /*--------------------------------------------------------------------*/
 /* VSA public functions                                               */
 /*--------------------------------------------------------------------*/
@@ -335,7 +401,23 @@ DLL_EXPORT VsaStartup( void )
             return VSA_E_LOAD_FAILED;
         }
 #endif
+        VSA_MUTEX_INIT(&tStreamLock);
+        if(getenv(STREAM_MAX_ENV) != NULL && atol(getenv(STREAM_MAX_ENV)) > 0)
+            lgStreamMax = (size_t)atol(getenv(STREAM_MAX_ENV));
+        if(getenv(IO_DEPTH_ENV) != NULL) {
+            igIoDepth = atoi(getenv(IO_DEPTH_ENV));
+            if(igIoDepth < 1) igIoDepth = 1;
+            if(igIoDepth > IO_DEPTH_MAX) igIoDepth = IO_DEPTH_MAX;
+        }
+        vsaSetIoPolicy((PChar)getenv(IO_POLICY_ENV));
+        vsaSetIoMap((PChar)getenv(IO_MAP_ENV));
 #ifdef VSI2_COMPATIBLE
+        if(getenv(SAR_ENTRY_MAX_ENV) != NULL && atol(getenv(SAR_ENTRY_MAX_ENV)) > 0)
+            lgSarEntryMax = (size_t)atol(getenv(SAR_ENTRY_MAX_ENV));
+        if(getenv(SAR_INFLATE_THREADS_ENV) != NULL && atoi(getenv(SAR_INFLATE_THREADS_ENV)) > 0)
+            SarSetInflateThreads((unsigned int)atoi(getenv(SAR_INFLATE_THREADS_ENV)));
+        if(getenv(SAR_INDEX_CACHE_ENV) != NULL && atoi(getenv(SAR_INDEX_CACHE_ENV)) > 0)
+            SarSetIndexCache((unsigned int)atoi(getenv(SAR_INDEX_CACHE_ENV)));
         InitializeTable();
         if(pLoadError) free(pLoadError);
         /* load libmagic library */
@@ -598,7 +680,8 @@ DLL_EXPORT VsaGetConfig(PPVSA_CONFIG pp_config)
     (*pp_config)->uiVsaActionFlags = VSA_AP_SCAN;
 #endif
 
-    (*pp_config)->uiVsaScanFlags   =     VSA_SP_FILE | VSA_SP_BYTES;
+    (*pp_config)->uiVsaScanFlags   =     VSA_SP_FILE | VSA_SP_BYTES |
+                                         VSA_SP_STREAM_OPEN | VSA_SP_STREAM_WRITE | VSA_SP_STREAM_CLOSE;
 
     (*pp_config)->uiVsaEvtMsgFlags =     uigVS_SAP_ALL;
     /* No client I/O callback supported for this VSA version
@@ -735,7 +818,7 @@ DLL_EXPORT VsaInit( const PVSA_CALLBACK p_callback,
         SETERRORTEXT((*pp_init)->pszErrorText, "Parsing INITSERVERS failed");
         CLEANUP(rc);
     }
-    rc = vsaConnectd(pConnection->pServer, pConnection->pPort, (PChar)"VERSION",&pDriverName);
+    rc = vsaConnectd(pConnection, (PChar)"VERSION",&pDriverName);
     if(rc) {
         Char  _error[1024];
         (*pp_init)->iErrorRC = 7;
@@ -898,6 +981,7 @@ DLL_EXPORT VsaScan(
     PCLAMDCON           pConnection     = NULL;
     FILE                *_fp            = NULL;
     PChar               pAnswer         = NULL;
+    PSTREAMSESSION      pSession        = NULL;
 #ifndef VSI2_COMPATIBLE
     char                command[1024];
 #endif
@@ -1022,6 +1106,26 @@ DLL_EXPORT VsaScan(
     if (_vsa_rc == VS_CB_NEXT || _vsa_rc == VS_CB_TERMINATE)
         CLEANUP(VSA_E_CBC_TERMINATED);
 
+    if(p_scanparam->tScanCode == VSA_SP_STREAM_OPEN  ||
+       p_scanparam->tScanCode == VSA_SP_STREAM_WRITE ||
+       p_scanparam->tScanCode == VSA_SP_STREAM_CLOSE)
+    {
+        rc = vsaStreamSession(p_init,p_scanparam,&pSession);
+        if(rc == VSA_E_INVALID_PARAM) {
+            pszReason = (PChar)"Stream was not opened with VSA_SP_STREAM_OPEN";
+            CLEANUP(rc);
+        }
+        else if(rc == VSA_E_NOT_SCANNED) {
+            pszReason = (PChar)"Not scanned: limit";
+            CLEANUP(rc);
+        }
+        else if(rc) {
+            pszReason = (PChar)"The stream could not be sent to the server!";
+            CLEANUP(VSA_E_SCAN_FAILED);
+        }
+        usrdata.lObjectSize = pSession->lFill;
+    }
+
 #ifdef VSI2_COMPATIBLE
     /*--------------------------------------------------------------------*/
     /* example callbacks to query whether we should start                 */
@@ -1040,6 +1144,9 @@ DLL_EXPORT VsaScan(
         if(p_scanparam->tScanCode == VSA_SP_BYTES) {
             usrdata.lObjectSize = p_scanparam->lLength;
         }
+        else if(pSession != NULL) {
+            usrdata.lObjectSize = pSession->lFill;
+        }
         else {
             rc = getFileSize(p_scanparam->pszObjectName,&usrdata.lObjectSize);
             if(rc) {
@@ -1050,16 +1157,32 @@ DLL_EXPORT VsaScan(
         if(p_scanparam->tScanCode == VSA_SP_BYTES) {
             checkcontent = TRUE;
         }
+        else if(pSession != NULL) {
+            /* only the new chunk is checked, the type detection
+             * continues with the state of the previous chunks, the
+             * active content check also with the tail of the last one
+             */
+            status = pSession->pType->iStatus;
+            text   = pSession->pType->bText;
+            a      = pSession->pType->tType;
+            b      = pSession->pType->tEnd;
+            usrdata.tObjectType = pSession->pType->tObjectType;
+            strcpy((char*)szExt,(const char*)pSession->pType->szExt);
+            strcpy((char*)szMimeType,(const char*)pSession->pType->szMimeType);
+            if(p_scanparam->pbByte != NULL && p_scanparam->lLength > 0)
+                checkcontent = TRUE;
+        }
         else {
             memset(bbyte,0,sizeof(bbyte));
             _fp = fopen((const char*)p_scanparam->pszObjectName,"rb");
             if(_fp != NULL) {
+                vsaIoAdviseOpen(fileno(_fp),usrdata.lObjectSize);
                 checkcontent = TRUE;
             }
         }
         if(checkcontent) {
             do {
-                if(p_scanparam->tScanCode == VSA_SP_BYTES) {
+                if(p_scanparam->tScanCode == VSA_SP_BYTES || pSession != NULL) {
                     pBuff = p_scanparam->pbByte;
                     current_read =  p_scanparam->lLength;
                     rc = getByteType(pBuff,p_scanparam->lLength,p_scanparam->pszObjectName,szExt2,szExt,szMimeType,0,&status,&text,&a,&b,&usrdata.tFileType,&usrdata.tObjectType);
@@ -1072,6 +1195,8 @@ DLL_EXPORT VsaScan(
                 if(usrdata.bActiveContent == TRUE)
                 {
                     rc = check4ActiveContent(pBuff,current_read,usrdata.tObjectType,usrdata.bPdfAllowOpenAction);
+                    if(rc == VSA_OK && pSession != NULL)
+                        rc = vsaCheckStreamTail(pSession,pBuff,current_read,usrdata.tObjectType,usrdata.bPdfAllowOpenAction);
                     if(rc) {
                         if(pp_scinfo != NULL && (*pp_scinfo) != NULL) {
                             addVirusInfo(p_scanparam->uiJobID,
@@ -1125,14 +1250,26 @@ DLL_EXPORT VsaScan(
                         CLEANUP(rc);
                     }
                 }
-                /* no loop for byte scan */
-                if(p_scanparam->tScanCode == VSA_SP_BYTES) {
+                /* no loop for byte and stream scan */
+                if(p_scanparam->tScanCode != VSA_SP_FILE) {
                     current_read = 0;
                 }
             } while(current_read > 0 || rc != VSA_OK);
         }
         FCLOSE_SAFE(_fp);
         if(rc) CLEANUP(rc);
+        if(pSession != NULL)
+        {
+            pSession->pType->iStatus     = status;
+            pSession->pType->bText       = text;
+            pSession->pType->tType       = a;
+            pSession->pType->tEnd        = b;
+            pSession->pType->tObjectType = usrdata.tObjectType;
+            strcpy((char*)pSession->pType->szExt,(const char*)szExt);
+            strcpy((char*)pSession->pType->szMimeType,(const char*)szMimeType);
+            if(p_scanparam->tScanCode != VSA_SP_STREAM_CLOSE)
+                CLEANUP(VSA_OK); /* the type is final with the close */
+        }
         if(usrdata.tFileType != usrdata.tObjectType)
         {
             if(strlen((const char*)szExt2) == 0 || (usrdata.tFileType == VS_OT_UNKNOWN && usrdata.tObjectType == VS_OT_BINARY))
@@ -1150,7 +1287,8 @@ DLL_EXPORT VsaScan(
             }
             else
             {
-                rc = getFileSize(p_scanparam->pszObjectName,&usrdata.lObjectSize);
+                if(p_scanparam->tScanCode == VSA_SP_FILE)
+                    rc = getFileSize(p_scanparam->pszObjectName,&usrdata.lObjectSize);
                 if(usrdata.bMimeCheck == TRUE)
                 {
                     sprintf((char*)szErrorName,"Extension (%.100s) is not compatible to MIME type (%.850s)",(const char*)szExt2,(const char*)szMimeType);
@@ -1195,6 +1333,8 @@ DLL_EXPORT VsaScan(
             sprintf((char*)szExt,"%s",szExt2);
         }
     }
+    if(pSession != NULL && p_scanparam->tScanCode != VSA_SP_STREAM_CLOSE)
+        CLEANUP(VSA_OK); /* content info and scan follow with the close */
     if(usrdata.tObjectType == VS_OT_UNKNOWN)
     {
         /* Here we found an unknown binary object, use external MIME type detection
@@ -1238,6 +1378,32 @@ DLL_EXPORT VsaScan(
     */
     switch(p_scanparam->tScanCode)
     {
+    case VSA_SP_STREAM_OPEN:
+    case VSA_SP_STREAM_WRITE:
+        CLEANUP(VSA_OK); /* sent, the answer follows with VSA_SP_STREAM_CLOSE */
+    case VSA_SP_STREAM_CLOSE:
+#ifdef VSI2_COMPATIBLE
+        if(pp_scinfo != NULL && (*pp_scinfo) != NULL)
+        {
+            usrdata.pScanInfo = (*pp_scinfo);
+        }
+        rc = scanStream(
+            p_init->hEngine,
+            p_scanparam->uiJobID,
+            p_scanparam->pszObjectName,
+            pSession,
+            &usrdata,
+            szErrorName);
+        if(rc) SET_VSA_RC(rc);
+#else
+        rc = vsaCloseStream2Clamd(pSession,&pAnswer);
+        if (rc)
+           {
+               pszReason = (PChar)"The stream could not be scanned!";
+               CLEANUP( VSA_E_SCAN_FAILED );
+           }
+#endif
+    break;
     case VSA_SP_BYTES:
 #ifdef VSI2_COMPATIBLE
         if(pp_scinfo != NULL && (*pp_scinfo) != NULL)
@@ -1255,7 +1421,7 @@ DLL_EXPORT VsaScan(
         if(rc) SET_VSA_RC(rc);
 #else
         usrdata.lObjectSize = p_scanparam->lLength;
-        rc = vsaSendBytes2Clamd(pConnection->pServer,pConnection->pPort,NULL,p_scanparam->pbByte,usrdata.lObjectSize,&pAnswer);
+        rc = vsaSendBytes2Clamd(pConnection,NULL,p_scanparam->pbByte,usrdata.lObjectSize,&pAnswer);
         if (rc) 
            {
                pszReason = (PChar)"The buffer could not be scanned!";
@@ -1292,7 +1458,7 @@ DLL_EXPORT VsaScan(
            }
            if(usrdata.bScanFileLocal == TRUE) {
               sprintf((char*)command,"SCAN %s", p_scanparam->pszObjectName);
-              rc = vsaConnectd((PChar)pConnection->pServer,(PChar)pConnection->pPort, (PChar)command,&pAnswer);
+              rc = vsaConnectd(pConnection, (PChar)command,&pAnswer);
               if (rc) 
               {
                  sprintf((char*)command,"The file %256s could not be scanned locally.", p_scanparam->pszObjectName);
@@ -1303,7 +1469,7 @@ DLL_EXPORT VsaScan(
               rc = VSA_E_CIO_FAILED;
               _fp = fopen((const char*)p_scanparam->pszObjectName,"rb");
               if(_fp != NULL)
-              rc = vsaSendBytes2Clamd(pConnection->pServer,pConnection->pPort,_fp,NULL,usrdata.lObjectSize,&pAnswer);
+              rc = vsaSendBytes2Clamd(pConnection,_fp,NULL,usrdata.lObjectSize,&pAnswer);
               if (rc)
               {
                  sprintf((char*)command,"The file %256s could not be send as stream to server %50s", p_scanparam->pszObjectName,pConnection->pServer);
@@ -1315,7 +1481,7 @@ DLL_EXPORT VsaScan(
         }
     break;  
     default:
-        pszReason = (PChar)"ClamAV engine supports only the scan of local files";
+        pszReason = (PChar)"ClamAV engine supports only the scan of local files, byte buffers and streams";
         CLEANUP(VSA_E_INVALID_SCANOBJECT);
     }
 #ifndef VSI2_COMPATIBLE
@@ -1436,6 +1602,10 @@ DLL_EXPORT VsaScan(
     /* Exception handling */
 cleanup:
     FCLOSE_SAFE(_fp);
+    if(p_scanparam != NULL && p_scanparam->tScanCode == VSA_SP_FILE)
+        vsaIoAdviseDoneFile(p_scanparam->pszObjectName); /* also read by clamd itself */
+    if(pSession != NULL) /* closed or blocked streams leave the list */
+        vsaReleaseStream(pSession,(rc != VSA_OK || p_scanparam->tScanCode == VSA_SP_STREAM_CLOSE));
     switch(rc)
     {
     case VSA_E_NOT_SUPPORTED:
@@ -1497,6 +1667,10 @@ cleanup:
             freescanerror(&p_scanerror);
         }
     }
+    if (rc == VSA_E_ENTRY_NOT_SCANNED)
+        rc = VSA_E_NOT_SCANNED; /* the entry is already in the scan errors */
+    if (usrdata.vsa_rc == VSA_E_ENTRY_NOT_SCANNED)
+        usrdata.vsa_rc = VSA_E_NOT_SCANNED;
     if (rc == 0)
         rc = usrdata.vsa_rc; /* set now the saved RC to return value */
     if (rc == 0)
@@ -1617,6 +1791,7 @@ DLL_EXPORT VsaEnd(PPVSA_INIT pp_init, PPVSA_CONFIG pp_config)
     if (pp_init != NULL && (*pp_init) != NULL)
     {
         PCLAMDCON pConnection = (PCLAMDCON)(*pp_init)->hEngine;
+        vsaReleaseStreams((*pp_init)); /* uploads without VSA_SP_STREAM_CLOSE */
         if(pConnection) {
             if(pConnection->pProtocol) free(pConnection->pProtocol);
             if(pConnection->pServer)   free(pConnection->pServer);
@@ -1661,6 +1836,8 @@ DLL_EXPORT VsaCleanup( void )
     /*--------------------------------------------------------------------*/
     /* The cleanup will be called process global                          */
     /*--------------------------------------------------------------------*/
+    vsaReleaseStreams(NULL);
+    VSA_MUTEX_FREE(&tStreamLock);
 #ifdef _WIN32
     WSACleanup();
 #endif
@@ -1670,6 +1847,7 @@ DLL_EXPORT VsaCleanup( void )
         pLoadError = NULL;
     }
     vsaCloseMagicLibrary();
+    SarFreeIndexCache();
 #endif
     bgInit = FALSE;
     return VSA_OK;
@@ -1879,7 +2057,7 @@ static VSA_RC scanFile(
         }
         if(pUsrData->bScanFileLocal == TRUE) {
             sprintf((char*)command,"SCAN %s",pszObjectName);
-            rc = vsaConnectd((PChar)pConnection->pServer,(PChar)pConnection->pPort,(PChar)command,&pAnswer);
+            rc = vsaConnectd(pConnection,(PChar)command,&pAnswer);
             if(rc)
             {
                 sprintf((char*)errorReason,"The file %256s could not be scanned locally.", pszObjectName);
@@ -1898,7 +2076,7 @@ static VSA_RC scanFile(
             rc = VSA_E_CIO_FAILED;
             _fp = fopen((const char*)pszObjectName,"rb");
             if(_fp != NULL)
-                rc = vsaSendBytes2Clamd(pConnection->pServer,pConnection->pPort,_fp,NULL,pUsrData->lObjectSize,&pAnswer);
+                rc = vsaSendBytes2Clamd(pConnection,_fp,NULL,pUsrData->lObjectSize,&pAnswer);
             if(rc)
             {
                 sprintf((char*)errorReason,"The file %256s could not be send as stream to server %50s",pszObjectName,pConnection->pServer);
@@ -1987,24 +2165,179 @@ cleanup:
     return rc;
 } /* scanFile */
 
-static VSA_RC scanCompressed(
+/*
+ * Send the current SAR entry block by block as zINSTREAM to clamd, the
+ * entry is never held as a whole. The blocks are checked while they are
+ * sent, a marker across two blocks by the tail of the previous one. An
+ * archive inside the archive is read by scanCompressedBuffer instead.
+ */
+static VSA_RC scanSarEntry(
     void           *pEngine,
     UInt            uiJobID,
     PChar           pszObjectName,
+    struct SARIterator *pSar,
+    struct SAREntry *_loc,
     USRDATA        *pUsrData,
     PChar           errorReason)
 {
     VSA_RC          rc = VSA_OK;
-    int             counter = 0;
-    size_t          lLength = 0;
-    PChar           pszFileName = NULL;
+    const char      zCommand[11] = "zINSTREAM\0";
+    STREAMSESSION   tEntry;
+    PChar           pszFileName = (PChar)_loc->name;
     Char            szExt[EXT_LN] = ".*";
-    PByte           _decompr = NULL;
     Char            szMimeType[MIME_LN] = "unknown/unknown";
-    struct SAREntry *_loc = NULL,
-        *sentry = ParseEntriesFromFile(pszObjectName);
+    PByte           pbBlock = NULL;
+    size_t          lBlock = 0;
+    size_t          lLength = 0;
+    int             iBlock = 0;
+    Bool            bActive = FALSE;
+    Bool            text = TRUE;
+    int             status = 1;
+    VS_OBJECTTYPE_T a = VS_OT_UNKNOWN;
+    VS_OBJECTTYPE_T b = VS_OT_UNKNOWN;
+
+    memset(&tEntry,0,sizeof(STREAMSESSION));
+    tEntry.iSocket = -1;
+    /* clamd stops reading a stream above its StreamMaxLength */
+    if(_loc->uncompressed_size > lgSarEntryMax)
+    {
+        rc = addNotScanned(uiJobID,
+            pszFileName,
+            _loc->uncompressed_size,
+            (PChar)"Not scanned: limit",
+            pUsrData->pScanInfo);
+        if(rc) CLEANUP(rc);
+        CLEANUP(VSA_E_ENTRY_NOT_SCANNED);
+    }
+    if(pUsrData->bActiveContent == TRUE && pUsrData->bScanAllFiles == TRUE && pUsrData->bScanCompressed == TRUE)
+        bActive = TRUE;
+    rc = getFileType(pszFileName,szExt,szMimeType,&a);
+    if(rc) CLEANUP(rc);
+    iBlock = SarReadBlock(pSar,&pbBlock,&lBlock);
+    if(iBlock > 0) {
+        rc = getByteType(pbBlock,lBlock,pszFileName,NULL,szExt,szMimeType,0,&status,&text,&a,&b,&pUsrData->tFileType,&pUsrData->tObjectType);
+        if(rc) CLEANUP(rc);
+    }
+    /* an archive inside the archive is read through this entry */
+    if(iBlock > 0 && pUsrData->tObjectType == VS_OT_SAR)
+    {
+        if(pUsrData->bScanAllFiles == FALSE && pUsrData->bScanBestEffort == FALSE && pUsrData->bScanCompressed == FALSE)
+            CLEANUP(VSA_E_NOT_SCANNED);
 
-    if(sentry == NULL) {
+        rc = scanCompressedBuffer(
+            pEngine,
+            uiJobID,
+            pszFileName,
+            NULL,
+            _loc->uncompressed_size,
+            pSar,
+            pUsrData,
+            errorReason);
+        CLEANUP(rc);
+    }
+    tEntry.iSocket = vsaOpenClamd((PCLAMDCON)pEngine);
+    if(tEntry.iSocket < 0 ||
+       _sendmysocket(tEntry.iSocket, (const char*)zCommand, (int)(sizeof(zCommand)-1)) != (int)(sizeof(zCommand)-1))
+    {
+        sprintf((char*)errorReason,"The file %256s could not be send as stream to server %50s",pszFileName,((PCLAMDCON)pEngine)->pServer);
+        CLEANUP(VSA_E_SCAN_FAILED);
+    }
+    while(iBlock > 0) {
+        lLength += lBlock;
+        /*
+        * Comment:
+        * Perform the Active Content Check inside of archive
+        */
+        if(bActive == TRUE)
+        {
+            rc = check4ActiveContent(
+                pbBlock,
+                lBlock,
+                pUsrData->tObjectType,
+                pUsrData->bPdfAllowOpenAction);
+            if(rc == VSA_OK)
+                rc = vsaCheckStreamTail(&tEntry,pbBlock,lBlock,pUsrData->tObjectType,pUsrData->bPdfAllowOpenAction);
+            if(rc) CLEANUP(rc);
+        }
+        rc = vsaSendChunk2Clamd(tEntry.iSocket,pbBlock,lBlock);
+        if(rc)
+        {
+            sprintf((char*)errorReason,"The file %256s could not be send as stream to server %50s",pszFileName,((PCLAMDCON)pEngine)->pServer);
+            CLEANUP(VSA_E_SCAN_FAILED);
+        }
+        iBlock = SarReadBlock(pSar,&pbBlock,&lBlock);
+        if(iBlock > 0) {
+            rc = getByteType(pbBlock,lBlock,pszFileName,NULL,szExt,szMimeType,0,&status,&text,&a,&b,&pUsrData->tFileType,&pUsrData->tObjectType);
+            if(rc) CLEANUP(rc);
+        }
+    }
+    if(iBlock < 0 || lLength == 0)
+    {
+        rc = addNotScanned(uiJobID,
+            pszObjectName,
+            lLength,
+            (PChar)"Not extracted",
+            pUsrData->pScanInfo);
+        if(rc) CLEANUP(rc);
+        CLEANUP(VSA_E_ENTRY_NOT_SCANNED);
+    }
+    rc = addContentInfo(uiJobID,
+        pszFileName,
+        lLength,
+        pUsrData->tObjectType,
+        szExt,
+        szMimeType,
+        NULL,
+        pUsrData->pScanInfo->uiScanned++,
+        &pUsrData->pScanInfo->pContentInfo);
+    if(rc) CLEANUP(rc);
+    /*
+    * Comment:
+    * Perform the MIME Check inside of archive
+    */
+    if(pUsrData->bMimeCheck == TRUE && pUsrData->bScanAllFiles == TRUE && pUsrData->bScanCompressed == TRUE)
+    {
+        Char szErrorName[1024];
+        Char szErrorFreeName[1024];
+        rc = checkContentType(
+            szExt,
+            szMimeType,
+            pUsrData->pszScanMimeTypes,
+            pUsrData->pszBlockMimeTypes,
+            pUsrData->pszScanExtensions,
+            pUsrData->pszBlockExtensions,
+            pUsrData->bScanMimeTypesWildCard,
+            pUsrData->bBlockMimeTypesWildCard,
+            szErrorName,
+            szErrorFreeName);
+        if(rc) CLEANUP(rc);
+    }
+    /* terminates the stream and evaluates the answer of clamd */
+    rc = scanStream(
+        pEngine,
+        uiJobID,
+        pszFileName,
+        &tEntry,
+        pUsrData,
+        errorReason);
+cleanup:
+    if(tEntry.iSocket >= 0)
+        _closemysocket(tEntry.iSocket);
+    return rc;
+} /* scanSarEntry */
+
+static VSA_RC scanCompressed(
+    void           *pEngine,
+    UInt            uiJobID,
+    PChar           pszObjectName,
+    USRDATA        *pUsrData,
+    PChar           errorReason)
+{
+    VSA_RC          rc = VSA_OK;
+    struct SARIterator *pSar = SarOpenFile(pszObjectName);
+    struct SAREntry *_loc = SarNextEntry(pSar);
+
+    if(_loc == NULL) {
         if(pUsrData->bMimeCheck == TRUE || pUsrData->bScanAllFiles == TRUE)
         {
             if(pUsrData != NULL && pUsrData->pScanInfo != NULL) {
@@ -2041,7 +2374,6 @@ static VSA_RC scanCompressed(
             CLEANUP(VSA_E_SCAN_FAILED);
         }
     }
-    _loc = sentry;
     while(_loc != NULL) {
         if(_loc->type != FT_RG) {
             if(_loc->type != FT_RG) {
@@ -2055,103 +2387,18 @@ static VSA_RC scanCompressed(
                 CLEANUP(VSA_E_NOT_SCANNED);
             }
         }
-        if(_decompr == NULL) {
-            _decompr = (PByte)malloc(_loc->uncompressed_size);
-        }
-        else {
-            _decompr = (PByte)realloc(_decompr,_loc->uncompressed_size);
-        }
-        if(_decompr == NULL) {
-            sprintf((char*)errorReason,"The file buffer for %256s cannot be allocated",_loc->name);
-            CLEANUP(VSA_E_SCAN_FAILED);
-        }
-        lLength = _loc->uncompressed_size;
-        pszFileName = (PChar)_loc->name;
-        _loc = _loc->next;
-        lLength = ExtractEntryFromFile(pszObjectName,counter++,_decompr,lLength);
-        if(lLength == 0)
-        {
-            addScanError(uiJobID,
-                pszObjectName,
-                lLength,
-                13,
-                (PChar)"Not extracted",
-                pUsrData->pScanInfo->uiScanErrors,
-                &pUsrData->pScanInfo->pScanError);
-            pUsrData->pScanInfo->uiScanErrors++;
-            pUsrData->pScanInfo->uiNotScanned++;
-            CLEANUP(VSA_E_NOT_SCANNED);
-        }
-        else
-        {
-            Bool text = TRUE;
-            int status = 1;
-            VS_OBJECTTYPE_T a = VS_OT_UNKNOWN;
-            VS_OBJECTTYPE_T b = VS_OT_UNKNOWN;
-            rc = getFileType(pszFileName,szExt,szMimeType,&a);
-            if(rc) CLEANUP(rc);
-            rc = getByteType(_decompr,lLength,pszFileName,NULL,szExt,szMimeType,0,&status,&text,&a,&b,&pUsrData->tFileType,&pUsrData->tObjectType);
-            if(rc) CLEANUP(rc);
-            rc = addContentInfo(uiJobID,
-                pszFileName!=NULL?pszFileName:sentry->name,
-                lLength,
-                pUsrData->tObjectType,
-                szExt,
-                szMimeType,
-                NULL,
-                pUsrData->pScanInfo->uiScanned++,
-                &pUsrData->pScanInfo->pContentInfo);
-            if(rc) CLEANUP(rc);
-            /*
-            * Comment:
-            * Perform the Active Content Check inside of archive
-            */
-            if(pUsrData->bActiveContent == TRUE && pUsrData->bScanAllFiles == TRUE && pUsrData->bScanCompressed == TRUE)
-            {
-                rc = check4ActiveContent(
-                    _decompr,
-                    lLength,
-                    pUsrData->tObjectType,
-                    pUsrData->bPdfAllowOpenAction);
-                if(rc) CLEANUP(rc);
-            }
-            /*
-            * Comment:
-            * Perform the MIME Check inside of archive
-            */
-            if(pUsrData->bMimeCheck == TRUE && pUsrData->bScanAllFiles == TRUE && pUsrData->bScanCompressed == TRUE)
-            {
-                Char szErrorName[1024];
-                Char szErrorFreeName[1024];
-                rc = checkContentType(
-                    szExt,
-                    szMimeType,
-                    pUsrData->pszScanMimeTypes,
-                    pUsrData->pszBlockMimeTypes,
-                    pUsrData->pszScanExtensions,
-                    pUsrData->pszBlockExtensions,
-                    pUsrData->bScanMimeTypesWildCard,
-                    pUsrData->bBlockMimeTypesWildCard,
-                    szErrorName,
-                    szErrorFreeName);
-                if(rc) CLEANUP(rc);
-            }
-            rc = scanBuffer(
-                pEngine,
-                uiJobID,
-                sentry->name,
-                _decompr,
-                lLength,
-                pUsrData,
-                errorReason);
-        }
+        rc = scanSarEntry(
+            pEngine,
+            uiJobID,
+            pszObjectName,
+            pSar,
+            _loc,
+            pUsrData,
+            errorReason);
+        _loc = SarNextEntry(pSar);
     }
 cleanup:
-    if(_decompr) {
-        free(_decompr);
-        _decompr = NULL;
-    }
-    FreeInfo(sentry);
+    SarClose(pSar);
     return rc;
 } /* scanCompressed */
 
@@ -2191,12 +2438,13 @@ static VSA_RC scanBuffer(
                                     pszObjectName,
                                     pObject,
                                     lObjectSize,
+                                    NULL,
                                     pUsrData,
                                     errorReason);
     }
     else
     {
-        rc = vsaSendBytes2Clamd(pConnection->pServer,pConnection->pPort,NULL,pObject,lObjectSize,&pAnswer);
+        rc = vsaSendBytes2Clamd(pConnection,NULL,pObject,lObjectSize,&pAnswer);
         if(rc)
         {
             sprintf((char*)errorReason,"The file %256s could not be send as stream to server %50s",pszObjectName,pConnection->pServer);
@@ -2283,20 +2531,15 @@ static VSA_RC scanCompressedBuffer(
     PChar           pszObjectName,
     PByte           pObject,
     size_t          lObjectSize,
+    struct SARIterator *pOuter,
     USRDATA        *pUsrData,
     PChar           errorReason)
 {
     VSA_RC          rc = VSA_OK;
-    int             counter = 0;
-    size_t          lLength = 0;
-    PChar           pszFileName = NULL;
-    Char            szExt[EXT_LN] = ".*";
-    PByte           _decompr = NULL;
-    Char            szMimeType[MIME_LN] = "unknown/unknown";
-    struct SAREntry *_loc = NULL,
-        *sentry = ParseEntriesFromBuffer(pObject,(SAP_INT)lObjectSize);
+    struct SARIterator *pSar = pOuter != NULL ? SarOpenEntry(pOuter) : SarOpenBuffer(pObject,lObjectSize);
+    struct SAREntry *_loc = SarNextEntry(pSar);
 
-    if(sentry == NULL) {
+    if(_loc == NULL) {
         if(pUsrData->bMimeCheck == TRUE || pUsrData->bScanAllFiles == TRUE)
         {
             rc = addVirusInfo(uiJobID,
@@ -2328,7 +2571,6 @@ static VSA_RC scanCompressedBuffer(
             CLEANUP(VSA_E_SCAN_FAILED);
         }
     }
-    _loc = sentry;
     while(_loc != NULL) {
         if(_loc->type != FT_RG) {
             if(_loc->type != FT_RG) {
@@ -2342,106 +2584,135 @@ static VSA_RC scanCompressedBuffer(
                 CLEANUP(VSA_E_NOT_SCANNED);
             }
         }
-        if(_decompr == NULL) {
-            _decompr = (PByte)malloc(_loc->uncompressed_size);
+        rc = scanSarEntry(
+            pEngine,
+            uiJobID,
+            pszObjectName,
+            pSar,
+            _loc,
+            pUsrData,
+            errorReason);
+        _loc = SarNextEntry(pSar);
+    }
+cleanup:
+    SarClose(pSar);
+    return rc;
+} /* scanCompressedBuffer */
+
+static VSA_RC scanStream(
+    void           *pEngine,
+    UInt            uiJobID,
+    PChar           pszObjectName,
+    PSTREAMSESSION  pSession,
+    USRDATA        *pUsrData,
+    PChar           errorReason)
+{
+    VSA_RC         rc = VSA_OK;
+    VS_CALLRC _vsa_rc  = VS_CB_OK;
+    PChar      pAnswer = NULL;
+    PChar    pszBuffer = NULL;
+    PCLAMDCON  pConnection = NULL;
+    int         clam_rc = 0;
+    const char *virname = NULL;
+    if(pUsrData == NULL || pSession == NULL) {
+        sprintf((char*)errorReason,"User parameter not available");
+        return VSA_E_NULL_PARAM;
+    }
+    pConnection = (PCLAMDCON)pEngine;
+    if(pSession->bCollect == TRUE)
+    {
+        /* the SAR archive was collected, its entries are sent now */
+        rc = scanBuffer(
+                        pEngine,
+                        uiJobID,
+                        pszObjectName,
+                        pSession->pbData,
+                        pSession->lFill,
+                        pUsrData,
+                        errorReason);
+    }
+    else
+    {
+        rc = vsaCloseStream2Clamd(pSession,&pAnswer);
+        if(rc)
+        {
+            sprintf((char*)errorReason,"The stream %256s could not be send to server %50s",pszObjectName,pConnection->pServer);
+            CLEANUP(VSA_E_SCAN_FAILED);
         }
-        else {
-            _decompr = (PByte)realloc(_decompr,_loc->uncompressed_size);
+        pszBuffer = (PChar)strstr((const char*)pAnswer,"OK");
+        if(pszBuffer) /* Success */
+            clam_rc = 0;
+        pszBuffer = (PChar)strstr((const char*)pAnswer,"ERROR");
+        if(pszBuffer) /* Scan Error */
+        {
+            *pszBuffer = 0; /* terminate string */
+            clam_rc = VSA_E_SCAN_FAILED;
         }
-        if(_decompr == NULL) {
-            sprintf((char*)errorReason,"The file buffer for %256s cannot be allocated",_loc->name);
-            CLEANUP(VSA_E_SCAN_FAILED);
+        pszBuffer = (PChar)strstr((const char*)pAnswer,"FOUND");
+        if(pszBuffer) /* Scan Error */
+        {
+            *pszBuffer = 0; /* Virus Infection found */
+            virname = strchr((const char*)pAnswer,':');
+            if(virname && *(virname + 2) && *(virname + 1) == ' ')
+                virname += 2;
+            clam_rc = 1;
         }
-        lLength = _loc->uncompressed_size;
-        pszFileName = (PChar)_loc->name;
-        _loc = _loc->next;
-
-        lLength = ExtractEntryFromBuffer(pObject,(SAP_INT)lObjectSize,counter++,_decompr,lLength);
-        if(lLength == 0)
+        /* CCQ_ON */
+        if(clam_rc != 1)
         {
-            addScanError(uiJobID,
-                pszObjectName,
-                lObjectSize,
-                13,
-                (PChar)"Not extracted",
-                pUsrData->pScanInfo->uiScanErrors,
-                &pUsrData->pScanInfo->pScanError);
-            pUsrData->pScanInfo->uiScanErrors++;
-            pUsrData->pScanInfo->uiNotScanned++;
-            CLEANUP(VSA_E_NOT_SCANNED);
+            sprintf((char*)errorReason,"Not available");
+            switch(clam_rc)
+            {
+            case 0: rc = VSA_OK;
+                break;
+            case 1: rc = VSA_E_VIRUS_FOUND;
+                break;
+            case 13:
+                sprintf((char*)errorReason,"%s",(PChar)pAnswer);
+                CLEANUP(VSA_E_SCAN_FAILED);
+            default:       rc = VSA_E_SCAN_FAILED;
+                break;
+            }
         }
         else
         {
-            Bool text = TRUE;
-            int status = 1;
-            VS_OBJECTTYPE_T a = VS_OT_UNKNOWN;
-            VS_OBJECTTYPE_T b = VS_OT_UNKNOWN;
-            rc = getFileType(pszFileName,szExt,szMimeType,&a);
-            if(rc) CLEANUP(rc);
-            rc = getByteType(_decompr,lLength,pszFileName,NULL,szExt,szMimeType,0,&status,&text,&a,&b,&pUsrData->tFileType,&pUsrData->tObjectType);
-            if(rc) CLEANUP(rc);
-            rc = addContentInfo(uiJobID,
-                sentry->name,
-                lLength,
-                pUsrData->tObjectType,
-                szExt,
-                szMimeType,
-                NULL,
-                pUsrData->pScanInfo->uiScanned++,
-                &pUsrData->pScanInfo->pContentInfo);
-            if(rc) CLEANUP(rc);
-            /*
-            * Comment:
-            * Perform the Active Content Check inside of archive
-            */
-            if(pUsrData->bActiveContent == TRUE && pUsrData->bScanAllFiles == TRUE && pUsrData->bScanCompressed == TRUE)
-            {
-                rc = check4ActiveContent(
-                    _decompr,
-                    lLength,
+            rc = VSA_OK;
+        }
+        /*
+        * After the scan
+        */
+        if(clam_rc == 1)
+        {
+            if(pUsrData != NULL && pUsrData->pScanInfo != NULL) {
+                rc = addVirusInfo(uiJobID,
+                    pszObjectName,
+                    pUsrData->lObjectSize,
+                    FALSE,
+                    VS_DT_KNOWNVIRUS,
+                    VS_VT_TEST,
                     pUsrData->tObjectType,
-                    pUsrData->bPdfAllowOpenAction);
-                if(rc) CLEANUP(rc);
-            }
-            /*
-            * Comment:
-            * Perform the MIME Check inside of archive
-            */
-            if(pUsrData->bMimeCheck == TRUE && pUsrData->bScanAllFiles == TRUE && pUsrData->bScanCompressed == TRUE)
-            {
-                Char szErrorName[1024];
-                Char szErrorFreeName[1024];
-                rc = checkContentType(
-                    szExt,
-                    szMimeType,
-                    pUsrData->pszScanMimeTypes,
-                    pUsrData->pszBlockMimeTypes,
-                    pUsrData->pszScanExtensions,
-                    pUsrData->pszBlockExtensions,
-                    pUsrData->bScanMimeTypesWildCard,
-                    pUsrData->bBlockMimeTypesWildCard,
-                    szErrorName,
-                    szErrorFreeName);
+                    VS_AT_NOACTION,
+                    0,
+                    (PChar)virname,
+                    (PChar)"No info available",
+                    pUsrData->pScanInfo->uiInfections,
+                    &pUsrData->pScanInfo->pVirusInfo);
                 if(rc) CLEANUP(rc);
+                pUsrData->pScanInfo->uiInfections++;
+                pUsrData->vsa_rc = VSA_E_VIRUS_FOUND;
+                if(pUsrData->pvFncptr)
+                    _vsa_rc = (VS_CALLRC)pUsrData->pvFncptr((VSA_ENGINE)pEngine,(VS_MESSAGE_T)VS_M_VIRUS,pUsrData->pScanInfo->pVirusInfo,(VSA_USRDATA)pUsrData->pvUsrdata);
+                if(_vsa_rc == VS_CB_NEXT || _vsa_rc == VS_CB_TERMINATE)
+                    CLEANUP(VSA_E_CBC_TERMINATED);
             }
-            rc = scanBuffer(
-                pEngine,
-                uiJobID,
-                sentry->name,
-                _decompr,
-                lLength,
-                pUsrData,
-                errorReason);
+            CLEANUP(VSA_E_VIRUS_FOUND);
         }
+        rc = VSA_OK;
     }
 cleanup:
-    if(_decompr) {
-        free(_decompr);
-        _decompr = NULL;
-    }
-    FreeInfo(sentry);
+    if(pAnswer) free(pAnswer);
     return rc;
-} /* scanCompressedBuffer */
+} /* scanStream */
 
 static VSA_RC vsaSetContentTypeParametes(VSA_OPTPARAM *param,
     USRDATA *pUsrData
@@ -2770,6 +3041,13 @@ static VSA_RC vsaparseURI( PChar uri, PChar bLocal, PPChar prot, PPChar server,
        SETSTRINGLN((*prot),_uri,(ptr-_uri));
        _uri = ptr + 3; /* :// */
     }
+    if((*prot) != NULL && !strcmp((const char*)(*prot),LOCAL_PROTOCOL)) {
+       /* unix:///path/of/clamd/socket, clamd on this host */
+       SETSTRINGLN((*server),_uri,strlen((const char*)_uri));
+       (*port)   = (PChar)strdup("");
+       *bLocal   = TRUE;
+       return VSA_OK;
+    }
     ptr = (PChar)strstr((char*)_uri,(const char*)":");
     if(ptr!=NULL) {
        SETSTRINGLN((*server),_uri,(ptr-_uri));
@@ -2795,65 +3073,74 @@ cleanup:
 }
 
 /*
- * Connect to Server, send command and return the answer
+ * Open the socket to clamd, the local socket for unix:///path
  */
-static VSA_RC vsaConnectd( PChar server, PChar port, PChar zCommand, PPChar zAnswer)
-{/*
+static int vsaOpenClamd( PCLAMDCON pConnection)
+{
 #ifndef _WIN32
   struct    sockaddr_un strAddr;
-  socklen_t lenAddr;
-#endif  */
+#endif
   struct    addrinfo hints, *res, *r;
-  char      buff[1024];
-  int       buf_len= 0;
-  int       err = VSA_E_LOAD_FAILED, s = -1;
+  int       s = -1;
 
+#ifndef _WIN32
+  if(pConnection->pProtocol != NULL && !strcmp((const char*)pConnection->pProtocol,LOCAL_PROTOCOL))
+  {
+    if(strlen((const char*)pConnection->pServer) >= sizeof(strAddr.sun_path))
+        return -1;
+    memset(&strAddr, 0, sizeof(strAddr));
+    strAddr.sun_family=AF_UNIX;
+    strcpy(strAddr.sun_path, (const char*)pConnection->pServer);
+    if((s =socket (PF_UNIX, SOCK_STREAM, 0))<0)
+        return -1;
+    if (connect(s, (struct sockaddr*)&strAddr, sizeof(strAddr)) == -1)
+    {
+      _closemysocket(s);
+      return -1;
+    }
+    return s;
+  }
+#endif
   /* initialize data */
   memset(&hints, 0, sizeof(hints));
-  hints.ai_family = PF_INET;
+  hints.ai_family = AF_UNSPEC; /* IPv4 or IPv6, as the name resolves */
   hints.ai_socktype = SOCK_STREAM;
 
-  if ((err = getaddrinfo((const char*)server, (const char*)port, &hints, &res)) != 0) 
+  if (getaddrinfo((const char*)pConnection->pServer, (const char*)pConnection->pPort, &hints, &res) != 0)
   {
-      return VSA_E_LOAD_FAILED;
+      return -1;
   }
 
-  for( r = res; r != NULL; r = res->ai_next )
+  for( r = res; r != NULL; r = r->ai_next )
   {
-/*#ifdef _WIN32*/
-    if((s =(int)socket (PF_INET, SOCK_STREAM, 0))<0)
-/*#else
-    if((s =socket (PF_UNIX, SOCK_STREAM, 0))<0)
-#endif*/
+    if((s =(int)socket (r->ai_family, r->ai_socktype, r->ai_protocol))<0)
     {
         continue;
-    } 
-
-/*#ifdef _WIN32*/
+    }
     if (connect(s, r->ai_addr,(int)r->ai_addrlen) == -1)
-/*#else    
-    strAddr.sun_family=AF_UNIX; 
-    strcpy(strAddr.sun_path, LOCAL_SOCKET_PATH);
-    lenAddr=sizeof(strAddr.sun_family)+strlen((const char*)strAddr.sun_path);
-    if (connect((struct sockaddr*)&strAddr, lenAddr) == -1)
-#endif*/    
     {
-      freeaddrinfo(res);
+      /* try the next address of the server */
       _closemysocket(s);
-      return VSA_E_LOAD_FAILED;
-    } 
-    else 
-    {
-      break;
+      s = -1;
+      continue;
     }
+    break;
   }
-  if (res != NULL)
-  {
-    freeaddrinfo(res);
-  }
-  else
+  freeaddrinfo(res);
+  return s;
+}
+
+/*
+ * Connect to Server, send command and return the answer
+ */
+static VSA_RC vsaConnectd( PCLAMDCON pConnection, PChar zCommand, PPChar zAnswer)
+{
+  char      buff[1024];
+  int       buf_len= 0;
+  int       s = vsaOpenClamd(pConnection);
+
+  if (s < 0)
   {
-      _closemysocket(s);
       return VSA_E_LOAD_FAILED;
   }
     _sendmysocket(s, (const char*)zCommand, (int)strlen((const char*)zCommand));/* send command to server           */
@@ -2883,14 +3170,8 @@ static VSA_RC vsaConnectd( PChar server, PChar port, PChar zCommand, PPChar zAns
 /*
  * Connect to Server, send command and return the answer
  */
-static VSA_RC vsaSendBytes2Clamd( PChar server, PChar port, FILE *pFP, PByte pByte, size_t lByte, PPChar zAnswer)
+static VSA_RC vsaSendBytes2Clamd( PCLAMDCON pConnection, FILE *pFP, PByte pByte, size_t lByte, PPChar zAnswer)
 {
-/*
-#ifndef _WIN32
-  struct    sockaddr_un strAddr;
-  socklen_t lenAddr;
-#endif  */
-  struct    addrinfo hints, *res, *r;
   char      buff[4096];
   char      bufflen[4];
   char      endstream[5];
@@ -2899,61 +3180,41 @@ static VSA_RC vsaSendBytes2Clamd( PChar server, PChar port, FILE *pFP, PByte pBy
   size_t    restlen= lByte;
   const char  zCommand[11] = "zINSTREAM\0";
   int       err = VSA_E_LOAD_FAILED, s = -1;
+#ifndef _WIN32
+  READAHEAD tAhead;
 
-  /* initialize data */
-  memset(&hints, 0, sizeof(hints));
-  memset(endstream,0,sizeof(endstream));
-  hints.ai_family = PF_INET;
-  hints.ai_socktype = SOCK_STREAM;
-
-  if ((err = getaddrinfo((const char*)server, (const char*)port, &hints, &res)) != 0) 
-  {
-      return VSA_E_LOAD_FAILED;
-  }
-
-  for( r = res; r != NULL; r = res->ai_next )
-  {
-/*#ifdef _WIN32*/
-    if((s =(int)socket (PF_INET, SOCK_STREAM, 0))<0)
-/*#else
-    if((s =socket (PF_UNIX, SOCK_STREAM, 0))<0)
-#endif*/
-    {
-        continue;
-    } 
-
-/*#ifdef _WIN32*/
-    if (connect(s, r->ai_addr,(int)r->ai_addrlen) == -1)
-/*#else    
-    strAddr.sun_family=AF_UNIX; 
-    strcpy(strAddr.sun_path, LOCAL_SOCKET_PATH);
-    lenAddr=sizeof(strAddr.sun_family)+strlen((const char*)strAddr.sun_path);
-    if (connect((struct sockaddr*)&strAddr, lenAddr) == -1)
-#endif*/    
-    {
-      freeaddrinfo(res);
-      _closemysocket(s);
-      return VSA_E_LOAD_FAILED;
-    } 
-    else 
-    {
-      break;
-    }
-  }
-  if (res != NULL)
+  memset(&tAhead,0,sizeof(tAhead));
+  if(pFP != NULL)
+    vsaIoAdviseOpen(fileno(pFP),lByte);
+  if(pConnection->pProtocol != NULL && !strcmp((const char*)pConnection->pProtocol,LOCAL_PROTOCOL))
   {
-    freeaddrinfo(res);
+      return vsaSendFd2Clamd(pConnection,pFP,pByte,lByte,zAnswer);
   }
-  else
+#endif
+  memset(endstream,0,sizeof(endstream));
+  s = vsaOpenClamd(pConnection);
+  if (s < 0)
   {
-      _closemysocket(s);
       return VSA_E_LOAD_FAILED;
   }
   err = _sendmysocket(s, (const char*)zCommand, (int)(sizeof(zCommand)-1));/* sending byte stream to server */
   if(pFP) {
+#ifndef _WIN32
+    /* the next chunks are read while the current one is sent */
+    if(vsaOpenReadAhead(&tAhead,fileno(pFP),lByte) != VSA_OK) {
+      _closemysocket(s);
+      return VSA_E_NO_SPACE;
+    }
+    buf_len = vsaReadAhead(&tAhead,&ptr);
+    if(buf_len <= 0) {
+      buf_len = 0;
+      restlen = 0;
+    }
+#else
     buf_len = (int)fread(buff,1,sizeof(buff),pFP);
     if(buf_len == EOF) buf_len = 0;
     else ptr = (PByte)buff;
+#endif
   } else {
     buf_len = (int)(restlen < sizeof(buff) ? restlen : sizeof(buff));
   }
@@ -2972,13 +3233,24 @@ static VSA_RC vsaSendBytes2Clamd( PChar server, PChar port, FILE *pFP, PByte pBy
         restlen-=buf_len;
         ptr+=buf_len;
         if(pFP) {
+#ifndef _WIN32
+          buf_len = vsaReadAhead(&tAhead,&ptr);
+          if(buf_len <= 0) { /* file is shorter */
+            buf_len = 0;
+            restlen = 0;
+          }
+#else
           buf_len = (int)fread(buff,1,sizeof(buff),pFP);
           if(buf_len == EOF) buf_len = 0;
           ptr = (PByte)buff;
+#endif
         } else {
           buf_len = (int)(restlen < sizeof(buff) ? restlen : sizeof(buff));
         }
   } while( restlen > 0 );
+#ifndef _WIN32
+  vsaCloseReadAhead(&tAhead);
+#endif
   _sendmysocket(s, (const char*)endstream, (int)sizeof(endstream));
   if((buf_len=_readmysocket(s, buff, (sizeof(buff)-1)))<=0)             /* reciving information from server */
   {
@@ -3001,5 +3273,488 @@ static VSA_RC vsaSendBytes2Clamd( PChar server, PChar port, FILE *pFP, PByte pBy
   _closemysocket(s);
   return VSA_OK;
 }
+
+#ifndef _WIN32
+/*
+ * Pass the object as file descriptor to the local clamd (zFILDES).
+ * Files are passed as they are. Buffers are copied once into an
+ * anonymous shared memory object, which clamd maps and scans instead
+ * of receiving every byte through the socket.
+ */
+static VSA_RC vsaSendFd2Clamd( PCLAMDCON pConnection, FILE *pFP, PByte pByte, size_t lByte, PPChar zAnswer)
+{
+  struct    msghdr  msg;
+  struct    cmsghdr *cmsg;
+  struct    iovec   iov;
+  union {
+    struct cmsghdr  align;
+    char            buf[CMSG_SPACE(sizeof(int))];
+  }         ctrl;
+  char      buff[1024];
+  char      dummy  = 0;
+  const char  zCommand[9] = "zFILDES\0";
+  int       buf_len= 0;
+  int       fd = -1, s = -1;
+  FILE     *pShared = NULL;
+  VSA_RC    rc = VSA_E_CIO_FAILED;
+
+  if(pFP)
+    fd = fileno(pFP);
+  else
+    fd = vsaCreateSharedObject(pByte,lByte,&pShared);
+  if (fd < 0)
+  {
+      return VSA_E_CIO_FAILED;
+  }
+  s = vsaOpenClamd(pConnection);
+  if (s < 0)
+  {
+      if(pShared) fclose(pShared);
+      return VSA_E_LOAD_FAILED;
+  }
+  memset(&msg, 0, sizeof(msg));
+  memset(&ctrl, 0, sizeof(ctrl));
+  iov.iov_base       = &dummy;
+  iov.iov_len        = 1;
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = ctrl.buf;
+  msg.msg_controllen = sizeof(ctrl.buf);
+  cmsg               = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level   = SOL_SOCKET;
+  cmsg->cmsg_type    = SCM_RIGHTS;
+  cmsg->cmsg_len     = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  if(_sendmysocket(s, (const char*)zCommand, (int)(sizeof(zCommand)-1)) == (int)(sizeof(zCommand)-1) &&
+     sendmsg(s, &msg, 0) == 1 &&
+     (buf_len=_readmysocket(s, buff, (sizeof(buff)-1))) > 0)       /* reciving information from server */
+  {
+      *zAnswer = (PChar)malloc(buf_len + 1);
+      if(*zAnswer != NULL)
+      {
+          memcpy(*zAnswer,buff,buf_len);
+          if ((*zAnswer)[buf_len-1] == '\n')
+             (*zAnswer)[buf_len-1] = 0;
+          else
+             (*zAnswer)[buf_len] = 0;
+          rc = VSA_OK;
+      }
+  }
+  _closemysocket(s);
+  if(pShared) fclose(pShared);
+  return rc;
+}
+
+/*
+ * Copy a buffer into an anonymous shared memory object, a temporary
+ * file where memfd is not available. Returns the descriptor or -1.
+ */
+static int vsaCreateSharedObject( PByte pByte, size_t lByte, FILE **ppFP)
+{
+  int       fd  = -1;
+  size_t    len = 0;
+  ssize_t   err = 0;
+
+  (*ppFP) = NULL;
+#if defined(__linux) && defined(SYS_memfd_create)
+  fd = (int)syscall(SYS_memfd_create, "clamdsap", 1U /* MFD_CLOEXEC */);
+  if(fd >= 0) {
+    (*ppFP) = fdopen(fd,"w+b");
+    if((*ppFP) == NULL) close(fd);
+  }
+#endif
+  if((*ppFP) == NULL)
+    (*ppFP) = tmpfile();
+  if((*ppFP) == NULL)
+    return -1;
+  fd = fileno(*ppFP);
+  while(len < lByte) {
+    err = write(fd, pByte + len, lByte - len);
+    if(err <= 0) {
+      fclose(*ppFP);
+      (*ppFP) = NULL;
+      return -1;
+    }
+    len += (size_t)err;
+  }
+  return fd;
+}
+
+/*
+ * Allocate the slots of the read ahead and queue the first iDepth
+ * chunks of the file.
+ */
+static VSA_RC vsaOpenReadAhead( PREADAHEAD pAhead, int iFd, size_t lLength)
+{
+  int       i;
+
+  memset(pAhead,0,sizeof(READAHEAD));
+  pAhead->iFd       = iFd;
+  pAhead->iDepth    = igIoDepth;
+  pAhead->iPrev     = -1;
+  pAhead->lEnd      = (off_t)lLength;
+  pAhead->pbBuffers = (PByte)malloc((size_t)pAhead->iDepth * READAHEAD_CHUNK);
+  pAhead->pbState   = (PByte)calloc((size_t)pAhead->iDepth,sizeof(Byte));
+  pAhead->pCb       = (struct aiocb *)calloc((size_t)pAhead->iDepth,sizeof(struct aiocb));
+  if(pAhead->pbBuffers == NULL || pAhead->pbState == NULL || pAhead->pCb == NULL) {
+    vsaCloseReadAhead(pAhead);
+    return VSA_E_NO_SPACE;
+  }
+  for(i = 0; i < pAhead->iDepth; i++)
+    vsaQueueReadAhead(pAhead,i);
+  return VSA_OK;
+}
+
+/*
+ * Queue the next chunk of the file into slot i, the slot is read
+ * synchronously later if aio_read is not supported.
+ */
+static void vsaQueueReadAhead( PREADAHEAD pAhead, int i)
+{
+  struct aiocb *cb  = &pAhead->pCb[i];
+  size_t        len = READAHEAD_CHUNK;
+
+  pAhead->pbState[i] = AHEAD_EMPTY;
+  if(pAhead->lNext >= pAhead->lEnd)
+    return;
+  if((off_t)len > pAhead->lEnd - pAhead->lNext)
+    len = (size_t)(pAhead->lEnd - pAhead->lNext);
+  memset(cb,0,sizeof(struct aiocb));
+  cb->aio_fildes = pAhead->iFd;
+  cb->aio_buf    = pAhead->pbBuffers + (size_t)i * READAHEAD_CHUNK;
+  cb->aio_nbytes = len;
+  cb->aio_offset = pAhead->lNext;
+  pAhead->lNext += (off_t)len;
+  pAhead->pbState[i] = (aio_read(cb) == 0) ? AHEAD_QUEUED : AHEAD_SYNC;
+}
+
+/*
+ * Return the next chunk of the file in order. The slot of the previous
+ * chunk was sent in the meantime and is queued again for the next read.
+ * Returns the length, 0 at the end and -1 on read errors.
+ */
+static int vsaReadAhead( PREADAHEAD pAhead, PPByte ppData)
+{
+  int           i  = pAhead->iHead;
+  struct aiocb *cb = &pAhead->pCb[i];
+  ssize_t       n  = 0;
+
+  if(pAhead->iPrev >= 0)
+    vsaQueueReadAhead(pAhead,pAhead->iPrev);
+  switch(pAhead->pbState[i])
+  {
+  case AHEAD_QUEUED:
+    while(aio_error(cb) == EINPROGRESS) {
+      const struct aiocb *list[1];
+      list[0] = cb;
+      aio_suspend(list,1,NULL);
+    }
+    n = aio_return(cb);
+    break;
+  case AHEAD_SYNC:
+    n = pread(pAhead->iFd,(void*)cb->aio_buf,cb->aio_nbytes,cb->aio_offset);
+    break;
+  default:
+    return 0;
+  }
+  pAhead->pbState[i] = AHEAD_EMPTY;
+  pAhead->iPrev = i;
+  pAhead->iHead = (i + 1) % pAhead->iDepth;
+  if(n < 0)
+    return -1;
+  (*ppData) = (PByte)cb->aio_buf;
+  return (int)n;
+}
+
+/*
+ * Cancel or wait for reads in flight before the slots are released.
+ */
+static void vsaCloseReadAhead( PREADAHEAD pAhead)
+{
+  int       i;
+
+  if(pAhead->pCb != NULL && pAhead->pbState != NULL) {
+    for(i = 0; i < pAhead->iDepth; i++) {
+      struct aiocb *cb = &pAhead->pCb[i];
+      if(pAhead->pbState[i] != AHEAD_QUEUED)
+        continue;
+      aio_cancel(pAhead->iFd,cb);
+      while(aio_error(cb) == EINPROGRESS) {
+        const struct aiocb *list[1];
+        list[0] = cb;
+        aio_suspend(list,1,NULL);
+      }
+      aio_return(cb);
+    }
+  }
+  if(pAhead->pbBuffers) free(pAhead->pbBuffers);
+  if(pAhead->pbState) free(pAhead->pbState);
+  if(pAhead->pCb) free(pAhead->pCb);
+  memset(pAhead,0,sizeof(READAHEAD));
+}
+#endif
+
+/*
+ * Find the upload stream of the VSA_INIT handle and job ID. The open
+ * connects to clamd and starts zINSTREAM, it drops an abandoned stream
+ * with the same key. The bytes of the call are sent as next chunk, a
+ * stream above CLAMSAP_STREAM_MAX is not scanned. The caller holds a
+ * reference on the stream until vsaReleaseStream.
+ */
+static VSA_RC vsaStreamSession( PVSA_INIT p_init, PVSA_SCANPARAM p_scanparam, PPSTREAMSESSION ppSession)
+{
+  const char  zCommand[11] = "zINSTREAM\0";
+  PPSTREAMSESSION ppEntry  = NULL;
+  PSTREAMSESSION  pSession = NULL;
+  PSTREAMSESSION  pOld     = NULL;
+  PByte           pbData   = NULL;
+  size_t          lAlloc   = 0;
+
+  (*ppSession) = NULL;
+  if(p_scanparam->tScanCode == VSA_SP_STREAM_OPEN)
+  {
+    pSession = (PSTREAMSESSION)calloc(1,sizeof(STREAMSESSION));
+    if(pSession == NULL)
+      return VSA_E_NO_SPACE;
+    pSession->pInit   = p_init;
+    pSession->uiJobID = p_scanparam->uiJobID;
+    pSession->uiRefs  = 1; /* reference of the list */
+    pSession->iSocket = -1;
+#ifdef VSI2_COMPATIBLE
+    pSession->pType   = (PTYPESTATE)calloc(1,sizeof(TYPESTATE));
+    if(pSession->pType == NULL) {
+      freeSTREAMSESSION(&pSession);
+      return VSA_E_NO_SPACE;
+    }
+    pSession->pType->iStatus = 1;
+    pSession->pType->bText   = TRUE;
+    strcpy((char*)pSession->pType->szExt,".*");
+    strcpy((char*)pSession->pType->szMimeType,"unknown/unknown");
+#endif
+    pSession->iSocket = vsaOpenClamd((PCLAMDCON)p_init->hEngine);
+    if(pSession->iSocket < 0 ||
+       _sendmysocket(pSession->iSocket, (const char*)zCommand, (int)(sizeof(zCommand)-1)) != (int)(sizeof(zCommand)-1))
+    {
+      freeSTREAMSESSION(&pSession);
+      return VSA_E_CIO_FAILED;
+    }
+  }
+  VSA_LOCK(&tStreamLock);
+  for(ppEntry = &pStreamList; (*ppEntry) != NULL; ppEntry = &(*ppEntry)->pNext)
+  {
+    if((*ppEntry)->pInit == p_init && (*ppEntry)->uiJobID == p_scanparam->uiJobID)
+      break;
+  }
+  if(pSession != NULL)
+  {
+    if((*ppEntry) != NULL) {
+      pOld       = (*ppEntry);
+      (*ppEntry) = pOld->pNext;
+      if(--pOld->uiRefs > 0)
+        pOld = NULL; /* still in use, freed by the last release */
+    }
+    pSession->pNext = pStreamList;
+    pStreamList     = pSession;
+  }
+  else
+  {
+    pSession = (*ppEntry);
+  }
+  if(pSession != NULL)
+    pSession->uiRefs++;
+  VSA_UNLOCK(&tStreamLock);
+  freeSTREAMSESSION(&pOld);
+  if(pSession == NULL)
+    return VSA_E_INVALID_PARAM;
+
+  (*ppSession) = pSession;
+  if(p_scanparam->pbByte == NULL || p_scanparam->lLength == 0)
+    return VSA_OK;
+  if(p_scanparam->lLength > lgStreamMax || pSession->lFill > lgStreamMax - p_scanparam->lLength)
+    return VSA_E_NOT_SCANNED;
+#ifdef VSI2_COMPATIBLE
+  if(pSession->lFill == 0 && p_scanparam->lLength > 7 && 0 == memcmp(p_scanparam->pbByte,"CAR 2.0",7))
+    pSession->bCollect = TRUE; /* SAR archive, see scanStream */
+#endif
+  if(pSession->bCollect == FALSE)
+  {
+    pSession->lFill += p_scanparam->lLength;
+    return vsaSendChunk2Clamd(pSession->iSocket,p_scanparam->pbByte,p_scanparam->lLength);
+  }
+  if(pSession->lFill + p_scanparam->lLength > pSession->lAlloc)
+  {
+    lAlloc = pSession->lAlloc > 0 ? pSession->lAlloc : STREAM_ALLOC_MIN;
+    while(lAlloc < pSession->lFill + p_scanparam->lLength)
+      lAlloc *= 2;
+    pbData = (PByte)realloc(pSession->pbData,lAlloc);
+    if(pbData == NULL)
+      return VSA_E_NO_SPACE;
+    pSession->pbData = pbData;
+    pSession->lAlloc = lAlloc;
+  }
+  memcpy(pSession->pbData + pSession->lFill,p_scanparam->pbByte,p_scanparam->lLength);
+  pSession->lFill += p_scanparam->lLength;
+  return VSA_OK;
+}
+
+/*
+ * Send one zINSTREAM chunk: 4 byte length in network order and the data
+ */
+static VSA_RC vsaSendChunk2Clamd( int s, PByte pByte, size_t lByte)
+{
+  char      bufflen[4];
+  size_t    len = 0;
+  int       err = 0;
+
+  if(s < 0)
+    return VSA_E_CIO_FAILED;
+  INT_2_BYTES(bufflen,lByte);
+  if(_sendmysocket(s, (const char*)bufflen, 4) != 4)
+    return VSA_E_CIO_FAILED;
+  while(len < lByte) {
+    err = _sendmysocket(s, (const char*)(pByte + len), (int)(lByte - len));
+    if(err <= 0)
+      return VSA_E_CIO_FAILED;
+    len += (size_t)err;
+  }
+  return VSA_OK;
+}
+
+/*
+ * Terminate the zINSTREAM of the upload stream and return the answer
+ */
+static VSA_RC vsaCloseStream2Clamd( PSTREAMSESSION pSession, PPChar zAnswer)
+{
+  char      buff[1024];
+  char      endstream[4];
+  int       buf_len= 0;
+  VSA_RC    rc = VSA_E_CIO_FAILED;
+
+  if(pSession == NULL || pSession->iSocket < 0)
+    return VSA_E_CIO_FAILED;
+  memset(endstream,0,sizeof(endstream));
+  if(_sendmysocket(pSession->iSocket, (const char*)endstream, (int)sizeof(endstream)) == (int)sizeof(endstream) &&
+     (buf_len=_readmysocket(pSession->iSocket, buff, (sizeof(buff)-1))) > 0)   /* reciving information from server */
+  {
+      *zAnswer = (PChar)malloc(buf_len + 1);
+      if(*zAnswer != NULL)
+      {
+          memcpy(*zAnswer,buff,buf_len);
+          if ((*zAnswer)[buf_len-1] == '\n')
+             (*zAnswer)[buf_len-1] = 0;
+          else
+             (*zAnswer)[buf_len] = 0;
+          rc = VSA_OK;
+      }
+  }
+  _closemysocket(pSession->iSocket);
+  pSession->iSocket = -1;
+  return rc;
+}
+
+#ifdef VSI2_COMPATIBLE
+/*
+ * Check the end of the previous chunk together with the head of the new
+ * one for a marker, which spans both, and keep the end of the new chunk
+ */
+static VSA_RC vsaCheckStreamTail( PSTREAMSESSION pSession, PByte pByte, size_t lByte, VS_OBJECTTYPE_T tObjectType, Bool bPdfAllowOpenAction)
+{
+  Byte      abJoin[2*STREAM_TAIL_LN];
+  size_t    lHead = lByte < STREAM_TAIL_LN ? lByte : STREAM_TAIL_LN;
+  size_t    lJoin = 0;
+  VSA_RC    rc    = VSA_OK;
+
+  if(pByte == NULL || lByte == 0)
+    return VSA_OK;
+  memcpy(abJoin,pSession->abTail,pSession->lTail);
+  memcpy(abJoin + pSession->lTail,pByte,lHead);
+  lJoin = pSession->lTail + lHead;
+  if(pSession->lTail > 0)
+    rc = check4ActiveContent(abJoin,lJoin,tObjectType,bPdfAllowOpenAction);
+  if(lByte >= STREAM_TAIL_LN) {
+    memcpy(pSession->abTail,pByte + lByte - STREAM_TAIL_LN,STREAM_TAIL_LN);
+    pSession->lTail = STREAM_TAIL_LN;
+  }
+  else {
+    pSession->lTail = lJoin < STREAM_TAIL_LN ? lJoin : STREAM_TAIL_LN;
+    memcpy(pSession->abTail,abJoin + lJoin - pSession->lTail,pSession->lTail);
+  }
+  return rc;
+}
+#endif
+
+/*
+ * Drop the reference of the caller on the upload stream, bClose also
+ * removes it from the list. The last reference frees it.
+ */
+static void vsaReleaseStream( PSTREAMSESSION pSession, Bool bClose)
+{
+  PPSTREAMSESSION ppEntry = NULL;
+
+  VSA_LOCK(&tStreamLock);
+  for(ppEntry = &pStreamList; bClose == TRUE && (*ppEntry) != NULL; ppEntry = &(*ppEntry)->pNext)
+  {
+    if((*ppEntry) == pSession) {
+      (*ppEntry) = pSession->pNext;
+      pSession->uiRefs--;
+      break;
+    }
+  }
+  if(--pSession->uiRefs > 0)
+    pSession = NULL;
+  VSA_UNLOCK(&tStreamLock);
+  freeSTREAMSESSION(&pSession);
+}
+
+/*
+ * Free the upload streams of a VSA_INIT handle, which were never
+ * closed. NULL frees all of them.
+ */
+static void vsaReleaseStreams( PVSA_INIT p_init)
+{
+  PPSTREAMSESSION ppEntry  = NULL;
+  PSTREAMSESSION  pSession = NULL;
+  PSTREAMSESSION  pFree    = NULL;
+
+  VSA_LOCK(&tStreamLock);
+  ppEntry = &pStreamList;
+  while((*ppEntry) != NULL)
+  {
+    pSession = (*ppEntry);
+    if(p_init == NULL || pSession->pInit == p_init) {
+      (*ppEntry)      = pSession->pNext;
+      if(--pSession->uiRefs == 0) { /* else freed by the last scan */
+        pSession->pNext = pFree;
+        pFree           = pSession;
+      }
+    }
+    else {
+      ppEntry = &pSession->pNext;
+    }
+  }
+  VSA_UNLOCK(&tStreamLock);
+  while(pFree != NULL)
+  {
+    pSession = pFree;
+    pFree    = pFree->pNext;
+    freeSTREAMSESSION(&pSession);
+  }
+}
+
+static void freeSTREAMSESSION( STREAMSESSION **pp_session)
+{
+  if(pp_session != NULL && (*pp_session) != NULL)
+  {
+    if ((*pp_session)->iSocket >= 0)
+        _closemysocket((*pp_session)->iSocket);
+    if ((*pp_session)->pbData != NULL)
+        free((*pp_session)->pbData);
+    if ((*pp_session)->pType != NULL)
+        free((*pp_session)->pType);
+    free((*pp_session));
+    (*pp_session) = NULL;
+  }
+}
 /* CCQ_ON */
 
@@ -155,6 +155,61 @@ struct clamdconnect {
 };
 typedef struct clamdconnect CLAMDCON, *PCLAMDCON, **PPCLAMDCON;
 
+/* upload stream of VSA_SP_STREAM_OPEN/WRITE/CLOSE. Each write is sent as
+ * zINSTREAM chunk over the connection of the stream, so clamd receives
+ * the upload while it arrives. A SAR archive is collected in memory
+ * instead, clamd does not know this format. The active content check
+ * runs on each chunk and on abTail, the end of the previous chunk, with
+ * the head of the new one. The list and each VsaScan call on the stream
+ * hold a reference in uiRefs.
+ */
+#define STREAM_TAIL_LN       32   /* > longest marker of check4ActiveContent */
+struct streamsession {
+    PVSA_INIT               pInit;
+    UInt                    uiJobID;
+    UInt                    uiRefs;
+    int                     iSocket;
+    Bool                    bCollect;
+    PByte                   pbData;
+    size_t                  lFill;
+    size_t                  lAlloc;
+    Byte                    abTail[STREAM_TAIL_LN];
+    size_t                  lTail;
+    struct typestate       *pType;
+    struct streamsession   *pNext;
+};
+typedef struct streamsession STREAMSESSION, *PSTREAMSESSION, **PPSTREAMSESSION;
+#define STREAM_ALLOC_MIN     65536
+/* size limit of an upload stream, CLAMSAP_STREAM_MAX overrides the default */
+#define STREAM_MAX_ENV       "CLAMSAP_STREAM_MAX"
+#define STREAM_MAX_DEFAULT   ((size_t)1024*1024*1024)
+
+/* read ahead of the zINSTREAM file sender. Up to iDepth chunks of the
+ * file are read with POSIX AIO while the previous chunk is sent, a slot
+ * without AIO support is read with pread when it is needed.
+ */
+#ifndef _WIN32
+struct readahead {
+    int                     iFd;
+    int                     iDepth;
+    int                     iHead;
+    int                     iPrev;
+    off_t                   lNext;
+    off_t                   lEnd;
+    PByte                   pbBuffers;
+    PByte                   pbState;
+    struct aiocb           *pCb;
+};
+typedef struct readahead READAHEAD, *PREADAHEAD;
+#endif
+#define IO_DEPTH_ENV         "CLAMSAP_IO_DEPTH"
+#define IO_DEPTH_DEFAULT     4
+#define IO_DEPTH_MAX         64
+#define READAHEAD_CHUNK      65536
+#define AHEAD_EMPTY          0
+#define AHEAD_QUEUED         1
+#define AHEAD_SYNC           2
+
 struct initdata {
    PVSA_INITPARAM   initdirectory;
    PVSA_INITPARAM   drivers;
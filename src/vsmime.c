@@ -49,6 +49,11 @@
 #include <locale.h>
 #include <string.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 /*--------------------------------------------------------------------*/
 /* SAP includes                                                       */
@@ -66,12 +71,15 @@ static struct magic_function_s magic_fps[] =
     DLL_MAGIC_DEFINE(magic_load),
     DLL_MAGIC_DEFINE(magic_buffer),
     DLL_MAGIC_DEFINE(magic_file),
+    DLL_MAGIC_DEFINE(magic_descriptor),
     {NULL}
 };
 
-static magic_function_pointers clptr = {NULL,NULL,NULL,NULL,NULL,FALSE,NULL};
+static magic_function_pointers clptr = {NULL,NULL,NULL,NULL,NULL,NULL,FALSE,NULL};
 static magic_function_pointers *pMagicFPtr = &clptr;
 static magic_t gMagic;
+static IO_POLICY_T tgIoPolicy = IO_POLICY_NONE;
+static Bool        bgIoMap    = FALSE;
 
 static Bool isHTMLCharacter(int c);
 static void setByteType(PChar fileName,
@@ -420,6 +428,45 @@ cleanup:
 #endif
 }
 
+/* same as vsaGetFileMimeType, but libmagic reads the already opened
+ * descriptor, so the object is not opened again by name
+ */
+PChar vsaGetDescMimeType(PChar pszFileName, int iFd)
+{
+#ifdef _WIN32
+    return vsaGetFileMimeType(pszFileName);
+#else
+    VSA_RC rc = VSA_OK;
+    PChar pMimeType = NULL;
+    size_t len = 0;
+    const char *pMTyp = 0;
+    if(iFd < 0) return vsaGetFileMimeType(pszFileName);
+    if(pMagicFPtr && pMagicFPtr->bLoaded) {
+       magic_t lMagic = pMagicFPtr->fp_magic_open(0x000200 | 0x000010 | 0x000400);
+       pMagicFPtr->fp_magic_load(lMagic,NULL);
+       pMTyp = pMagicFPtr->fp_magic_descriptor(lMagic, iFd);
+       if(pMTyp != 0) {
+          const char *p = strrchr((const char*)pMTyp,(int)';');
+          if(p == NULL) /* no extras */ {
+             SETSTRING(pMimeType,pMTyp);
+          } else {
+             size_t magLen = (p - pMTyp);
+             if(magLen > 0 && magLen < MAX_PATH_LN) {
+                SETSTRINGLN(pMimeType,pMTyp,magLen);
+             } else {
+                SETSTRING(pMimeType,pMTyp);
+             }
+          }
+       }
+       pMagicFPtr->fp_magic_close(lMagic);
+    }
+    if(pMTyp == 0) return NULL;
+cleanup:
+    if(rc != VSA_OK) return NULL;
+    return pMimeType;
+#endif
+}
+
 VSA_RC addContentInfo(
     UInt              uiJobID,
     PChar             pszObjectName,
@@ -520,6 +567,30 @@ cleanup:
     return rc;
 } /* addScanError */
 
+VSA_RC addNotScanned(UInt            uiJobID,
+    PChar           pszObjectName,
+    size_t          lObjectSize,
+    PChar           pszErrorText,
+    PVSA_SCANINFO   pScanInfo)
+{
+    VSA_RC rc = VSA_OK;
+
+    if(pScanInfo == NULL)
+        return VSA_OK; /* the scan returns no VSA_SCANINFO */
+    rc = addScanError(uiJobID,
+        pszObjectName,
+        lObjectSize,
+        13,
+        pszErrorText,
+        pScanInfo->uiScanErrors,
+        &pScanInfo->pScanError);
+    if(rc)
+        return rc;
+    pScanInfo->uiScanErrors++;
+    pScanInfo->uiNotScanned++;
+    return VSA_OK;
+} /* addNotScanned */
+
 VSA_RC addVirusInfo(UInt            uiJobID,
     PChar           pszObjectName,
     size_t          lObjectSize,
@@ -577,6 +648,60 @@ cleanup:
     return rc;
 } /* addVirusInfo */
 
+/*
+ * Appends the results of pFrom to pTo. The structures of pFrom are moved,
+ * only its arrays are released.
+ */
+VSA_RC mergeScanInfo(PVSA_SCANINFO pTo,
+    PVSA_SCANINFO   pFrom)
+{
+    PVSA_CONTENTINFO pContent = NULL;
+    PVSA_VIRUSINFO   pVirus   = NULL;
+    PVSA_SCANERROR   pError   = NULL;
+
+    if(pTo == NULL || pFrom == NULL)
+        return VSA_E_NULL_PARAM;
+
+    if(pFrom->uiScanned > 0 && pFrom->pContentInfo != NULL) {
+        pContent = (PVSA_CONTENTINFO)realloc(pTo->pContentInfo,(pTo->uiScanned + pFrom->uiScanned) * sizeof(VSA_CONTENTINFO));
+        if(pContent == NULL)
+            return VSA_E_NO_SPACE;
+        memcpy(pContent + pTo->uiScanned,pFrom->pContentInfo,pFrom->uiScanned * sizeof(VSA_CONTENTINFO));
+        pTo->pContentInfo = pContent;
+        pTo->uiScanned   += pFrom->uiScanned;
+        free(pFrom->pContentInfo);
+        pFrom->pContentInfo = NULL;
+        pFrom->uiScanned    = 0;
+    }
+    if(pFrom->uiInfections > 0 && pFrom->pVirusInfo != NULL) {
+        pVirus = (PVSA_VIRUSINFO)realloc(pTo->pVirusInfo,(pTo->uiInfections + pFrom->uiInfections) * sizeof(VSA_VIRUSINFO));
+        if(pVirus == NULL)
+            return VSA_E_NO_SPACE;
+        memcpy(pVirus + pTo->uiInfections,pFrom->pVirusInfo,pFrom->uiInfections * sizeof(VSA_VIRUSINFO));
+        pTo->pVirusInfo    = pVirus;
+        pTo->uiInfections += pFrom->uiInfections;
+        free(pFrom->pVirusInfo);
+        pFrom->pVirusInfo   = NULL;
+        pFrom->uiInfections = 0;
+    }
+    if(pFrom->uiScanErrors > 0 && pFrom->pScanError != NULL) {
+        pError = (PVSA_SCANERROR)realloc(pTo->pScanError,(pTo->uiScanErrors + pFrom->uiScanErrors) * sizeof(VSA_SCANERROR));
+        if(pError == NULL)
+            return VSA_E_NO_SPACE;
+        memcpy(pError + pTo->uiScanErrors,pFrom->pScanError,pFrom->uiScanErrors * sizeof(VSA_SCANERROR));
+        pTo->pScanError    = pError;
+        pTo->uiScanErrors += pFrom->uiScanErrors;
+        free(pFrom->pScanError);
+        pFrom->pScanError   = NULL;
+        pFrom->uiScanErrors = 0;
+    }
+    pTo->uiNotScanned  += pFrom->uiNotScanned;
+    pTo->uiClean       += pFrom->uiClean;
+    pFrom->uiNotScanned = 0;
+    pFrom->uiClean      = 0;
+    return VSA_OK;
+} /* mergeScanInfo */
+
 VSA_RC getFileType(PChar filename,PChar ext,PChar mimetype,VS_OBJECTTYPE_T *tType)
 {
     const char *p = NULL;
@@ -1493,14 +1618,6 @@ static Bool isHTMLCharacter(int c)
     return FALSE;
 } /* isHTMLCharacter */
 
-static char* memstr(char* input,const unsigned char* search,int len_input,int len_search)
-{
-    int i;
-    for(i = 0; (memcmp(input,search,len_search)) && (i != len_input - len_search); input++,i++)
-        ;
-    return (i == len_input - len_search) ? 0 : input;
-} /* memstr */
-
 static void * memstr2(const char *l,size_t l_len,const char *s,size_t s_len)
 {
     char *cur = 0,*last = 0;
@@ -1599,9 +1716,9 @@ VSA_RC check4ActiveContent(
     }
     else if(tObjectType == VS_OT_MSO)
     {
-        p = memstr(str,(const unsigned char*)".class",(int)lObjectSize,6);
+        p = memstr2(str,lObjectSize,(const char*)".class",6);
         if(p == NULL)
-            p = memstr(str,(const unsigned char*)"vbaProject.bin",(int)lObjectSize,14);
+            p = memstr2(str,lObjectSize,(const char*)"vbaProject.bin",14);
     }
     else
     {
@@ -1810,3 +1927,90 @@ static Bool WildcardMatch(PChar wildcard, size_t wildcarLen, PChar string, size_
     }
     return !(wildIndex < wildcarLen);
 } /* WildcardMatch */
+
+/**********************************************************************
+ *  vsaSetIoPolicy()
+ *
+ *  Description:
+ *  Selects the page cache policy of the deployment from the value of
+ *  CLAMSAP_IO_POLICY: "none" (default), "sequential" or "dropbehind".
+ *  The scanned objects are typically read once, with "dropbehind" they
+ *  do not displace the working set of the SAP kernel from the cache.
+ *
+ **********************************************************************/
+void vsaSetIoPolicy(PChar pszPolicy)
+{
+    tgIoPolicy = IO_POLICY_NONE;
+    if(pszPolicy == NULL)
+        return;
+    if(0 == strcmp((const char*)pszPolicy,"sequential"))
+        tgIoPolicy = IO_POLICY_SEQUENTIAL;
+    else if(0 == strcmp((const char*)pszPolicy,"dropbehind"))
+        tgIoPolicy = IO_POLICY_DROPBEHIND;
+}
+
+/**********************************************************************
+ *  vsaSetIoMap()
+ *
+ *  Description:
+ *  Enables the mapping of scanned files with CLAMSAP_IO_MAP=1. It is
+ *  only safe if no other process shrinks a file during its scan, the
+ *  files are read with stdio otherwise.
+ *
+ **********************************************************************/
+void vsaSetIoMap(PChar pszMap)
+{
+    bgIoMap = (pszMap != NULL && atoi((const char*)pszMap) != 0) ? TRUE : FALSE;
+}
+
+/* the scanned file may be mapped instead of read */
+Bool vsaIoMapFile(void)
+{
+    return bgIoMap;
+}
+
+/* before the object is read, lLength 0 means up to the end of file */
+void vsaIoAdviseOpen(int iFd, size_t lLength)
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_SEQUENTIAL)
+    if(tgIoPolicy == IO_POLICY_NONE || iFd < 0)
+        return;
+    posix_fadvise(iFd,0,(off_t)lLength,POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(iFd,0,(off_t)lLength,POSIX_FADV_WILLNEED);
+#endif
+}
+
+/* before a mapping of the object is read */
+void vsaIoAdviseMap(PByte pbMap, size_t lLength)
+{
+#if !defined(_WIN32) && defined(MADV_SEQUENTIAL)
+    if(tgIoPolicy == IO_POLICY_NONE || pbMap == NULL || lLength == 0)
+        return;
+    madvise((void*)pbMap,lLength,MADV_SEQUENTIAL);
+#endif
+}
+
+/* after the scan of the object is complete */
+void vsaIoAdviseDone(int iFd, size_t lLength)
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+    if(tgIoPolicy != IO_POLICY_DROPBEHIND || iFd < 0)
+        return;
+    posix_fadvise(iFd,0,(off_t)lLength,POSIX_FADV_DONTNEED);
+#endif
+}
+
+/* same as vsaIoAdviseDone for objects without an open descriptor */
+void vsaIoAdviseDoneFile(PChar pszFileName)
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+    int fd = -1;
+    if(tgIoPolicy != IO_POLICY_DROPBEHIND || pszFileName == NULL)
+        return;
+    fd = open((const char*)pszFileName,O_RDONLY);
+    if(fd < 0)
+        return;
+    posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED);
+    close(fd);
+#endif
+}
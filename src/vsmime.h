@@ -64,6 +64,7 @@ typedef void         (FN_MAGIC_CLOSE)(magic_t cookie);
 typedef int          (FN_MAGIC_LOAD)(magic_t cookie,const char *magicfile);
 typedef const char * (FN_MAGIC_BUFFER)(magic_t cookie,const void *buffer,size_t length);
 typedef const char * (FN_MAGIC_FILE)(magic_t cookie,const char *filename);
+typedef const char * (FN_MAGIC_DESCRIPTOR)(magic_t cookie,int fd);
 
 typedef void     *DLL_MAGIC_HDL;
 typedef struct {
@@ -73,6 +74,7 @@ typedef struct {
     FN_MAGIC_LOAD           *fp_magic_load;
     FN_MAGIC_BUFFER         *fp_magic_buffer;
     FN_MAGIC_FILE           *fp_magic_file;
+    FN_MAGIC_DESCRIPTOR     *fp_magic_descriptor;
     /* handle */
     char                     bLoaded;
     DLL_MAGIC_HDL            dll_hdl;
@@ -92,6 +94,18 @@ typedef DLL_MAGIC_CALL *DLL_MAGIC_ADR;
 #define EXT_LN                  10
 #define MIME_LN                 255
 
+/* state of getByteType between the chunks of a stream */
+struct typestate {
+    int             iStatus;
+    Bool            bText;
+    VS_OBJECTTYPE_T tType;
+    VS_OBJECTTYPE_T tEnd;
+    VS_OBJECTTYPE_T tObjectType;
+    Char            szExt[EXT_LN];
+    Char            szMimeType[MIME_LN];
+};
+typedef struct typestate TYPESTATE, *PTYPESTATE;
+
 /*--------------------------------------------------------------------*/
 /* helper defines                                                     */
 /*--------------------------------------------------------------------*/
@@ -140,6 +154,7 @@ typedef DLL_MAGIC_CALL *DLL_MAGIC_ADR;
 int vsaLoadMagicLibrary(PPChar ppszErrorText);
 void vsaCloseMagicLibrary(void);
 PChar vsaGetFileMimeType(PChar pszFileName);
+PChar vsaGetDescMimeType(PChar pszFileName, int iFd);
 VSA_RC getFileType(PChar,PChar,PChar,
                    VS_OBJECTTYPE_T *);
 VSA_RC getByteType(PByte pByte,
@@ -193,6 +208,18 @@ VSA_RC addScanError(UInt            uiJobID,
     UInt            lError,
     PPVSA_SCANERROR pp_scanerror);
 
+/* internal return code of an archive entry, which is not scanned.
+ * addNotScanned records it in VSA_SCANINFO, so VsaScan returns
+ * VSA_E_NOT_SCANNED without a further scan error.
+ */
+#define VSA_E_ENTRY_NOT_SCANNED ((VSA_RC)(VSA_E_CBC_TERMINATED + 1))
+
+VSA_RC addNotScanned(UInt            uiJobID,
+    PChar           pszObjectName,
+    size_t          lObjectSize,
+    PChar           pszErrorText,
+    PVSA_SCANINFO   pScanInfo);
+
 VSA_RC addVirusInfo(UInt            uiJobID,
     PChar           pszObjectName,
     size_t          lObjectSize,
@@ -207,7 +234,34 @@ VSA_RC addVirusInfo(UInt            uiJobID,
     UInt            lInfected,
     PPVSA_VIRUSINFO pp_virusinfo);
 
+VSA_RC mergeScanInfo(PVSA_SCANINFO pTo,
+    PVSA_SCANINFO   pFrom);
+
 PChar getCleanFilePatch(PChar orgFileName, size_t maxlen, PChar resultBuffer);
+
+/*--------------------------------------------------------------------*/
+/* page cache policy for scanned files                                */
+/*--------------------------------------------------------------------*/
+#define IO_POLICY_ENV        "CLAMSAP_IO_POLICY"
+typedef enum {
+    IO_POLICY_NONE       = 0,   /* no hints, the kernel defaults        */
+    IO_POLICY_SEQUENTIAL = 1,   /* sequential read ahead before reading */
+    IO_POLICY_DROPBEHIND = 2    /* as sequential, pages are dropped     */
+                                /* from the cache after the scan        */
+} IO_POLICY_T;
+
+void vsaSetIoPolicy(PChar pszPolicy);
+
+/* scanned files are mapped only with CLAMSAP_IO_MAP=1, as a file which
+ * is truncated while it is mapped raises SIGBUS on the next access
+ */
+#define IO_MAP_ENV           "CLAMSAP_IO_MAP"
+void vsaSetIoMap(PChar pszMap);
+Bool vsaIoMapFile(void);
+void vsaIoAdviseOpen(int iFd, size_t lLength);
+void vsaIoAdviseMap(PByte pbMap, size_t lLength);
+void vsaIoAdviseDone(int iFd, size_t lLength);
+void vsaIoAdviseDoneFile(PChar pszFileName);
 #ifdef __cplusplus
 }
 #endif